@@ -1,6 +1,8 @@
 #include "arguments.h"
 #include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
+#include <grp.h>
 #include <limits.h>
 #include <pwd.h>
 #include <stdbool.h>
@@ -32,17 +34,64 @@ static int parseOpt(int opt)
         return 4;
     case 't':
         return 5;
-    case 'a':
+    case 'j':
         return 6;
-    case '0':
+    case 'd':
         return 7;
-    case 'h':
+    case 'g':
         return 8;
-    default:
+    case 'p':
         return 9;
+    case 'x':
+        return 10;
+    case 'N':
+        return 11;
+    case 'G':
+        return 12;
+    case 'r':
+        return 13;
+    case 'k':
+        return 14;
+    case 'b':
+        return 15;
+    case 'q':
+        return 16;
+    case 'U':
+        return 17;
+    case 'T':
+        return 18;
+    case 'F':
+        return 19;
+    case 'a':
+        return 20;
+    case '0':
+        return 21;
+    case 'h':
+        return 22;
+    case 'S':
+        return 23;
+    case 'I':
+        return 24;
+    case 'A':
+        return 25;
+    case 'l':
+        return 26;
+    case 'i':
+        return 27;
+    case 'o':
+        return 28;
+    case 'w':
+        return 29;
+    case 'J':
+        return 30;
+    default:
+        return 31;
     }
 }
 
+// Upper limit for the number of threads
+const int MAX_THREAD_COUNT = 1024;
+
 
 // Check if a given argument is made of digits only
 static bool isOnlyDigits(char *arg)
@@ -107,7 +156,7 @@ static bool parseNumberFromArg(char *arg, int *num)
 
 // all of the set<*> functions defined below print help if parsing is not successful
 
-// Set name into pArgs
+// Add name into pArgs (can be repeated, files matching any of the names are found)
 static bool setName(ParsedArguments *pArgs, char *arg)
 {
     if (isOpt(arg)) {
@@ -117,8 +166,87 @@ static bool setName(ParsedArguments *pArgs, char *arg)
         return false;
     }
 
+    if (!addToStringList(&pArgs->namePatterns, arg)) {
+        fprintf(stderr, "Program is out of memory. Terminating program.\n");
+        return false;
+    }
+
+    pArgs->setName = true;
+    return true;
+}
+
+// Read the whole content of a file into a nullchar terminated string, NULL on fail
+static char *readWholeFile(char *fileName)
+{
+    FILE *file = fopen(fileName, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    size_t length = 0;
+    size_t allocatedSize = 4096;
+    char *content = malloc(allocatedSize);
+
+    while (content != NULL) {
+        length += fread(content + length, 1, allocatedSize - length - 1, file);
+        if (length + 1 < allocatedSize) {
+            break;
+        }
+
+        allocatedSize *= 2;
+        char *reallocated = realloc(content, allocatedSize);
+        if (reallocated == NULL) {
+            free(content);
+        }
+        content = reallocated;
+    }
+
+    if (content != NULL && ferror(file)) {
+        free(content);
+        content = NULL;
+    }
+
+    fclose(file);
+    if (content != NULL) {
+        content[length] = '\0';
+    }
+    return content;
+}
+
+// Add every line of a file into names in pArgs (empty lines are skipped)
+static bool setPatternFile(ParsedArguments *pArgs, char *arg)
+{
+    char *content = readWholeFile(arg);
+    if (content == NULL || !addToStringList(&pArgs->patternFiles, content)) {
+        fprintf(stderr, "\'-N\' couldn't read patterns from \'%s\'. Terminating program.\n", arg);
+        free(content);
+        return false;
+    }
+
+    // lines are cut in place, the patterns point into the content
+    char *line = content;
+    while (*line != '\0') {
+        char *end = strchr(line, '\n');
+        char *next = (end != NULL) ? end + 1 : line + strlen(line);
+        if (end == NULL) {
+            end = next;
+        }
+
+        // windows line endings
+        if (end > line && end[-1] == '\r') {
+            end--;
+        }
+        *end = '\0';
+
+        if (*line != '\0' && !addToStringList(&pArgs->namePatterns, line)) {
+            fprintf(stderr, "Program is out of memory. Terminating program.\n");
+            return false;
+        }
+        line = next;
+    }
+
+    // an empty file means that no name can match
     pArgs->setName = true;
-    pArgs->nameArg = arg;
     return true;
 }
 
@@ -131,10 +259,14 @@ static bool setSort(ParsedArguments *pArgs, char *arg)
     } else if (strcmp(arg, "s") == 0) {
         pArgs->sortType = 2;
         return true;
+    } else if (strcmp(arg, "none") == 0) {
+        pArgs->sortType = 3;
+        return true;
     }
 
-    fprintf(stderr, "\'-s\' takes \'f\' | \'s\' an argument and sorts"
-                    " the results either by file name, file path (\'f\') or by size (\'s\')."
+    fprintf(stderr, "\'-s\' takes \'f\' | \'s\' | \'none\' an argument and sorts"
+                    " the results either by file name, file path (\'f\') or by size (\'s\'),"
+                    " \'none\' prints them unsorted as soon as they are found."
                     " The program will now terminate.\n");
     return false;
 }
@@ -159,7 +291,67 @@ static bool setMask(ParsedArguments *pArgs, char *arg)
     return true;
 }
 
-// Set user in pArgs
+// Try to parse a numeric user or group id, true on success, false on fail
+static bool parseIdFromArg(char *arg, id_t *id)
+{
+    if (*arg == '\0' || !isOnlyDigits(arg)) {
+        return false;
+    }
+
+    errno = 0;
+    unsigned long parsed = strtoul(arg, NULL, 10);
+    if (errno != 0 || parsed > UINT32_MAX) {
+        return false;
+    }
+
+    *id = (id_t) parsed;
+    return true;
+}
+
+// Resolve every comma separated name (or numeric id) of arg and add it into a set,
+// names are looked up only here, never during the search
+static bool addIdsFromArg(IdSet *set, char *arg, bool isUser)
+{
+    char *name = arg;
+
+    while (name != NULL) {
+        // cut the list at the next comma
+        char *comma = strchr(name, ',');
+        if (comma != NULL) {
+            *comma = '\0';
+        }
+
+        id_t id = 0;
+        if (!parseIdFromArg(name, &id)) {
+            if (isUser) {
+                struct passwd *pwd = getpwnam(name);
+                if (pwd == NULL) {
+                    fprintf(stderr, "User \'%s\' doesn't exist.\n", name);
+                    return false;
+                }
+                id = pwd->pw_uid;
+            } else {
+                struct group *grp = getgrnam(name);
+                if (grp == NULL) {
+                    fprintf(stderr, "Group \'%s\' doesn't exist.\n", name);
+                    return false;
+                }
+                id = grp->gr_gid;
+            }
+        }
+
+        if (!addToIdSet(set, id)) {
+            fprintf(stderr, "Program is out of memory. Terminating program.\n");
+            return false;
+        }
+
+        name = (comma != NULL) ? comma + 1 : NULL;
+    }
+
+    return true;
+}
+
+// Set user in pArgs (can be repeated, names and uids are resolved once)
 static bool setUser(ParsedArguments *pArgs, char *arg)
 {
     if (isOpt(arg)) {
@@ -170,13 +362,86 @@ static bool setUser(ParsedArguments *pArgs, char *arg)
         return false;
     }
 
-    if (getpwnam(arg) == NULL) {
-        fprintf(stderr, "User \'%s\' doesn't exist.\n", arg);
+    if (!addIdsFromArg(&pArgs->userIds, arg, true)) {
         return false;
     }
 
     pArgs->setUser = true;
-    pArgs->usernameArg = arg;
+    return true;
+}
+
+// Set group in pArgs (can be repeated, names and gids are resolved once)
+static bool setGroup(ParsedArguments *pArgs, char *arg)
+{
+    if (isOpt(arg)) {
+        fprintf(stderr, "\'-g\' takes group name as an argument and"
+                        " filters results to only those owned by specific group."
+                        " No group given!"
+                        " The program will now terminate.\n");
+        return false;
+    }
+
+    if (!addIdsFromArg(&pArgs->groupIds, arg, false)) {
+        return false;
+    }
+
+    pArgs->setGroup = true;
+    return true;
+}
+
+// Set glob the whole file name has to match
+static bool setGlob(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->setGlob = true;
+    pArgs->globArg = arg;
+    return true;
+}
+
+// Set regular expression the file name has to match
+static bool setRegex(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->setRegex = true;
+    pArgs->regexArg = arg;
+    return true;
+}
+
+// Add a name of directories that are not searched
+static bool setPruneName(ParsedArguments *pArgs, char *arg)
+{
+    if (isOpt(arg) || *arg == '\0') {
+        fprintf(stderr, "\'-p\' takes a directory name as an argument. No name given!"
+                        " The program will now terminate.\n");
+        return false;
+    }
+
+    if (!addToStringList(&pArgs->pruneNames, arg)) {
+        fprintf(stderr, "Program is out of memory. Terminating program.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Add a path of a directory that's not searched
+static bool setExcludedPath(ParsedArguments *pArgs, char *arg)
+{
+    if (isOpt(arg) || *arg == '\0') {
+        fprintf(stderr, "\'-x\' takes a directory path as an argument. No path given!"
+                        " The program will now terminate.\n");
+        return false;
+    }
+
+    // paths are compared without trailing slashes (but "/" stays as it is)
+    size_t length = strlen(arg);
+    while (length > 1 && arg[length - 1] == '/') {
+        arg[--length] = '\0';
+    }
+
+    if (!addToStringList(&pArgs->excludedPaths, arg)) {
+        fprintf(stderr, "Program is out of memory. Terminating program.\n");
+        return false;
+    }
+
     return true;
 }
 
@@ -208,6 +473,104 @@ static bool setMaxDepth(ParsedArguments *pArgs, char *arg)
     return true;
 }
 
+// Set number of results that are kept
+static bool setTopCount(ParsedArguments *pArgs, char *arg)
+{
+    int count = 0;
+    if (!parseNumberFromArg(arg, &count) || count < 1) {
+        fprintf(stderr, "\'-k\' expects a positive number of results as an argument."
+                        " Terminating program.\n");
+        return false;
+    }
+
+    pArgs->topCount = count;
+    return true;
+}
+
+// Write the tree into an index file
+static bool setBuildIndex(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->buildIndexPath = arg;
+    return true;
+}
+
+// Answer the search from an index file
+static bool setIndex(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->indexPath = arg;
+    return true;
+}
+
+// Refresh an index file, only changed directories are read again
+static bool setUpdateIndex(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->updateIndexPath = arg;
+    return true;
+}
+
+// Set the file the Chrome trace is written into
+static bool setTraceFile(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->tracePath = arg;
+    return true;
+}
+
+// Set the format of the results
+static bool setOutputFormat(ParsedArguments *pArgs, char *arg)
+{
+    if (strcmp(arg, "lines") == 0) {
+        pArgs->outputFormat = OUTPUT_FORMAT_LINES;
+    } else if (strcmp(arg, "nul") == 0) {
+        pArgs->outputFormat = OUTPUT_FORMAT_LINES;
+        pArgs->lineBreak = '\0';
+    } else if (strcmp(arg, "netstring") == 0) {
+        pArgs->outputFormat = OUTPUT_FORMAT_NETSTRING;
+    } else if (strcmp(arg, "json") == 0) {
+        pArgs->outputFormat = OUTPUT_FORMAT_JSON;
+    } else {
+        fprintf(stderr, "\'-F\' takes \'lines\' | \'nul\' | \'netstring\' | \'json\' as an argument."
+                        " Terminating program.\n");
+        return false;
+    }
+    return true;
+}
+
+// Set number of traversal threads
+static bool setThreads(ParsedArguments *pArgs, char *arg)
+{
+    int threads = 0;
+    if (!parseNumberFromArg(arg, &threads) || threads < 1 || threads > MAX_THREAD_COUNT) {
+        fprintf(stderr, "\'-j\' expects a number of threads between 1 and %d as an argument."
+                        " Terminating program.\n", MAX_THREAD_COUNT);
+        return false;
+    }
+
+    pArgs->threadCount = threads;
+    return true;
+}
+
+// Set the way directories are read
+static bool setReader(ParsedArguments *pArgs, char *arg)
+{
+    if (strcmp(arg, "readdir") == 0) {
+        pArgs->useGetdents = false;
+        return true;
+    } else if (strcmp(arg, "getdents") == 0) {
+        if (!getdentsAvailable()) {
+            fprintf(stderr, "The getdents reader is not available in this build."
+                            " The program will now terminate.\n");
+            return false;
+        }
+        pArgs->useGetdents = true;
+        return true;
+    }
+
+    fprintf(stderr, "\'-d\' takes \'readdir\' | \'getdents\' as an argument and selects"
+                    " how directories are read."
+                    " The program will now terminate.\n");
+    return false;
+}
+
 // Set hidden file checking
 static bool setHiddenFiles(ParsedArguments *pArgs, char *arg)
 {
@@ -232,6 +595,76 @@ static bool setHelp(ParsedArguments *pArgs, char *arg)
     return true;
 }
 
+// Set option to print run statistics in pArgs
+static bool setStatistics(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->useless = arg;
+    pArgs->showStatistics = true;
+    return true;
+}
+
+// Set batching of stat calls through io_uring in pArgs
+static bool setIoUring(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->useless = arg;
+    pArgs->useIoUring = true;
+    return true;
+}
+
+// Ignore case in glob and regex
+static bool setIgnoreCase(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->useless = arg;
+    pArgs->ignoreCase = true;
+    return true;
+}
+
+// Annotate results with the pattern that matched
+static bool setAnnotatePattern(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->useless = arg;
+    pArgs->annotatePattern = true;
+    return true;
+}
+
+// Reorder filters by their observed rejection rates
+static bool setAdaptiveFilters(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->useless = arg;
+    pArgs->adaptiveFilters = true;
+    return true;
+}
+
+// Walk directories in order and write results sorted by path immediately
+static bool setOrderedOutput(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->useless = arg;
+    pArgs->orderedOutput = true;
+    return true;
+}
+
+// Keep watching the tree after the search and report changes of the results
+static bool setWatch(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->useless = arg;
+    if (!treeWatcherAvailable()) {
+        fprintf(stderr, "Watching is not available in this build."
+                        " The program will now terminate.\n");
+        return false;
+    }
+    pArgs->watch = true;
+    return true;
+}
+
+// Print the statistics as JSON (implies "-S")
+static bool setStatisticsJson(ParsedArguments *pArgs, char *arg)
+{
+    pArgs->useless = arg;
+    pArgs->showStatistics = true;
+    pArgs->statisticsJson = true;
+    return true;
+}
+
 // Print info when argument is incorrect
 static bool incorrectOpt(ParsedArguments *pArgs, char *arg)
 {
@@ -254,10 +687,15 @@ bool parseArguments(ParsedArguments *pArgs, int argc, char *argv[])
 {
     int optResult = 0;
     bool (*parseActions[])(ParsedArguments *, char *) = { setName, setSort, setMask, 
-            setUser, setMinDepth, setMaxDepth, setHiddenFiles, setNullCharTerminator, setHelp, incorrectOpt };
+            setUser, setMinDepth, setMaxDepth, setThreads, setReader, setGroup,
+            setPruneName, setExcludedPath, setPatternFile, setGlob, setRegex, setTopCount,
+            setBuildIndex, setIndex, setUpdateIndex, setTraceFile, setOutputFormat,
+            setHiddenFiles, setNullCharTerminator, setHelp,
+            setStatistics, setIoUring, setAdaptiveFilters, setAnnotatePattern, setIgnoreCase,
+            setOrderedOutput, setWatch, setStatisticsJson, incorrectOpt };
 
     // loop through opts, parse them into pArgs structure
-    while ((optResult = getopt(argc, argv, "n:s:m:u:f:t:a0h")) != -1 && optResult != '?') {
+    while ((optResult = getopt(argc, argv, "n:s:m:u:f:t:j:d:g:p:x:N:G:r:k:b:q:U:T:F:a0hSIAliowJ")) != -1 && optResult != '?') {
         if (!(*parseActions[parseOpt(optResult)])(pArgs, optarg)) {
             return false;
         }
@@ -268,18 +706,81 @@ bool parseArguments(ParsedArguments *pArgs, int argc, char *argv[])
         return false;
     }
 
-    // loop through argument, find first non opt and use it as a startDirectory path.
-    for (int i = 1; i < argc; i++) {
-        if (isOpt(argv[i])) {
-            optResult = parseOpt(argv[i][1]);
-            if ((optResult >= 0) && (optResult <= 5)) {
-                i++;
-            }
-        } else {
-            pArgs->startDirectory = argv[i];
-            break;
+    // the first results are only defined by an order
+    if (pArgs->topCount > 0 && pArgs->sortType == 3) {
+        fprintf(stderr, "\'-k\' can't be combined with \'-s none\'. Terminating program.\n");
+        return false;
+    }
+
+    // an index is either written or read
+    if ((pArgs->buildIndexPath != NULL) + (pArgs->indexPath != NULL) + (pArgs->updateIndexPath != NULL) > 1) {
+        fprintf(stderr, "\'-b\', \'-q\' and \'-U\' can't be combined. Terminating program.\n");
+        return false;
+    }
+
+    // the watched tree is walked serially, every match is remembered
+    if (pArgs->watch && (pArgs->threadCount > 1 || pArgs->topCount > 0 || pArgs->buildIndexPath != NULL
+            || pArgs->indexPath != NULL || pArgs->updateIndexPath != NULL)) {
+        fprintf(stderr, "\'-w\' can't be combined with \'-j\', \'-k\', \'-b\', \'-q\' or \'-U\'."
+                        " Terminating program.\n");
+        return false;
+    }
+
+    // netstrings and JSON lines have their own framing
+    if (pArgs->lineBreak != '\n' && pArgs->outputFormat != OUTPUT_FORMAT_LINES) {
+        fprintf(stderr, "\'-0\' can't be combined with \'-F netstring\' or \'-F json\'. Terminating program.\n");
+        return false;
+    }
+
+    // events of the watch mode are written as lines
+    if (pArgs->watch && pArgs->outputFormat != OUTPUT_FORMAT_LINES) {
+        fprintf(stderr, "\'-w\' can't be combined with \'-F netstring\' or \'-F json\'. Terminating program.\n");
+        return false;
+    }
+
+    // only searches are traced, the watch mode doesn't end
+    if (pArgs->tracePath != NULL && (pArgs->watch || pArgs->buildIndexPath != NULL
+            || pArgs->updateIndexPath != NULL)) {
+        fprintf(stderr, "\'-T\' can't be combined with \'-w\', \'-b\' or \'-U\'. Terminating program.\n");
+        return false;
+    }
+
+    // the ordered walk produces the path order of a single serial traversal
+    if (pArgs->orderedOutput) {
+        if (pArgs->sortType == 2 || pArgs->sortType == 3 || pArgs->topCount > 0 || pArgs->threadCount > 1) {
+            fprintf(stderr, "\'-o\' prints the results sorted by path, it can't be combined with"
+                            " \'-s s\', \'-s none\', \'-k\' or \'-j\'. Terminating program.\n");
+            return false;
+        }
+        pArgs->sortType = 1;
+    }
+
+    // getopt moves the operands behind the options, every one of them is a start directory,
+    // the first one is startDirectory
+    for (int i = optind; i < argc; i++) {
+        if (!addToStringList(&pArgs->startDirectories, argv[i])) {
+            fprintf(stderr, "Couldn't allocate memory for start directories. Terminating program.\n");
+            return false;
         }
     }
 
+    if (pArgs->startDirectories.count == 0) {
+        return true;
+    }
+    pArgs->startDirectory = pArgs->startDirectories.items[0];
+
+    // an index and the watch mode belong to a single tree
+    if (pArgs->startDirectories.count > 1 && (pArgs->watch || pArgs->buildIndexPath != NULL
+            || pArgs->indexPath != NULL || pArgs->updateIndexPath != NULL)) {
+        fprintf(stderr, "'-w', '-b', '-q' and '-U' take a single start directory. Terminating program.\n");
+        return false;
+    }
+
+    // the ordered walk streams one tree, results of several ones would have to be held and sorted
+    if (pArgs->startDirectories.count > 1 && pArgs->orderedOutput) {
+        fprintf(stderr, "\'-o\' takes a single start directory. Terminating program.\n");
+        return false;
+    }
+
     return true;
 }
@@ -0,0 +1,41 @@
+#!/bin/sh
+# compare the output of '-o' with the output of '-s f' byte for byte, on a tree
+# of bench/treeGenerator with names that sort around '/' and non-ASCII names
+# usage: checkOrderedOutput.sh FIND TREE_GENERATOR
+# prints the option combinations that differ, exits with 1 when there's any
+
+FIND=${1:-./find}
+GENERATOR=${2:-./bench/treeGenerator}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+TREE="$DIR/tree"
+"$GENERATOR" -d 3 -f 4 -n 20 -H 10 -b 1 -B 2000 "$TREE" > /dev/null || exit 1
+
+# "a/" sorts after "a b", "a-b" and "a.c" although "a" sorts before them
+for directory in a a-b 'a b' a.c .a 'ž' 'Ä'; do
+    mkdir -p "$TREE/edge/$directory/a"
+    for name in a a-b 'a b' a.c .a 'ž' 'Ä' needle.txt; do
+        : > "$TREE/edge/$directory/$name.txt"
+        : > "$TREE/edge/$directory/a/$name"
+    done
+done
+
+# globs are passed to find as they are
+set -f
+failed=0
+for options in '' '-a' '-n needle' '-n a -n e -l' '-m 644' '-m 600 -a' '-f 2 -t 3' '-t 1' '-0' '-a -0' \
+        '-G *.txt' '-G [a-f]* -i' '-r ^a' '-d readdir' '-a -d readdir' '-I' '-a -I -n e' '-F json' '-F netstring'; do
+    "$FIND" $options -s f "$TREE" > "$DIR/sorted" 2>&1
+    "$FIND" $options -o "$TREE" > "$DIR/ordered" 2>&1
+    if ! cmp -s "$DIR/sorted" "$DIR/ordered"; then
+        echo "'$options -o' differs from '$options -s f'"
+        failed=1
+    elif [ ! -s "$DIR/sorted" ]; then
+        echo "'$options' found nothing, the check doesn't cover it"
+        failed=1
+    fi
+done
+
+[ $failed -eq 0 ] && echo "ordered output OK"
+exit $failed
@@ -0,0 +1,36 @@
+#!/bin/sh
+# compare the names found with '-r' (and '-i -r') with the names grep -E selects
+# usage: checkPatterns.sh FIND
+# prints the expressions that differ, exits with 1 when there's any
+
+FIND=${1:-./find}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+for name in a b ab ba abc cab x xa ax xb bx a.log b.log x.log a.txt log.txt \
+        abc.log.txt log logx A.LOG Ab.Txt 'a$b' 'a^b'; do
+    : > "$DIR/$name"
+done
+
+failed=0
+check() {
+    expected=$(ls "$DIR" | grep -E $1 -- "$2" | sort)
+    found=$("$FIND" $1 -r "$2" "$DIR" | sed "s|^$DIR/||" | sort)
+    if [ "$found" != "$expected" ]; then
+        echo "'$1 -r $2' found: $(echo $found), expected: $(echo $expected)"
+        failed=1
+    fi
+}
+
+# anchors are assertions anywhere in the expression, not only at its ends,
+# intervals repeat the atom (with its own operators) before them
+for regex in 'log' '^a' 'b$' '^ab$' '^a|b$' '\.log$|\.txt$' '(^a)' '(b$)' 'x$|^b' \
+        '^(a|b)$' '(^a|x)(b|$)' 'a$b' '^$' 'a\$b' 'a\^b' '[$^]' '^[^a].*g$' \
+        'b{2}' '^a{1}b' '^[a-c]{2,3}$' '^(a|b){2,}$' '^a.{0,1}$' 'x{0}a' '^(a{1,2}b?){2}$' 'a*{2}b' \
+        'ab{0,0}c' '^.{4,}$' '^[[:alpha:]]{1,2}(\.[a-z]{3}){1,2}$'; do
+    check '' "$regex"
+    check '-i' "$regex"
+done
+
+[ $failed -eq 0 ] && echo "patterns OK"
+exit $failed
@@ -0,0 +1,397 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ptrace.h>
+#define SYSCALL_COUNTER 1
+#endif
+
+// runs a fixed matrix of queries of the find utility against a tree
+// usage: findBench [-r REVISION] [-n RUNS] FIND DIRECTORY
+// one tab separated line is printed for every query and cache state, lines
+// starting with '#' are comments, so results of two commits can be compared
+
+const int DEFAULT_RUNS = 5;
+const int MAX_RUNS = 100;
+const size_t READ_SIZE = 64 * 1024;
+// arguments of a query (without the directory)
+#define MAX_QUERY_ARGUMENTS 6
+
+
+// one query of the matrix
+typedef struct
+{
+    const char *name;
+    const char *arguments[MAX_QUERY_ARGUMENTS + 1];
+} Query;
+
+
+// measurements of one run
+typedef struct
+{
+    // nanoseconds
+    uint64_t wall;
+    uint64_t user;
+    uint64_t system;
+    // from the start until the first byte of output (0 = no output)
+    uint64_t firstOutput;
+    long maxRss;
+    // lines (or null terminated paths) written
+    size_t results;
+} Measurement;
+
+
+/** \brief Get monotonic time in nanoseconds
+ *
+ *  @return the time
+ */
+static uint64_t now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000u + (uint64_t) time.tv_nsec;
+}
+
+
+/** \brief Convert a timeval into nanoseconds
+ *
+ *  @param time - the timeval
+ *  @return nanoseconds
+ */
+static uint64_t toNanoseconds(struct timeval time)
+{
+    return (uint64_t) time.tv_sec * 1000000000u + (uint64_t) time.tv_usec * 1000u;
+}
+
+
+/** \brief Build arguments of a run: the program, the query and the directory
+ *
+ *  @param argv - array of at least MAX_QUERY_ARGUMENTS + 3 pointers
+ *  @param find - path of the find utility
+ *  @param query - Query structure
+ *  @param directory - searched directory
+ */
+static void buildArguments(char **argv, char *find, const Query *query, char *directory)
+{
+    size_t count = 0;
+    argv[count++] = find;
+    for (size_t i = 0; query->arguments[i] != NULL; i++) {
+        argv[count++] = (char *) query->arguments[i];
+    }
+    argv[count++] = directory;
+    argv[count] = NULL;
+}
+
+
+/** \brief Run the utility once, its output is read (and counted) through a pipe
+ *
+ *  @param argv - arguments of the run
+ *  @param measurement - results of the run are stored here
+ *  @return true if the utility succeeded
+ */
+static bool runOnce(char **argv, Measurement *measurement)
+{
+    int output[2];
+    if (pipe(output) != 0) {
+        fprintf(stderr, "Pipe couldn't be created (%s).\n", strerror(errno));
+        return false;
+    }
+
+    uint64_t start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Process couldn't be created (%s).\n", strerror(errno));
+        close(output[0]);
+        close(output[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        dup2(output[1], STDOUT_FILENO);
+        close(output[0]);
+        close(output[1]);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    close(output[1]);
+    char *buffer = malloc(READ_SIZE);
+    memset(measurement, 0, sizeof(Measurement));
+
+    ssize_t bytes;
+    while (buffer != NULL && ((bytes = read(output[0], buffer, READ_SIZE)) > 0 || (bytes < 0 && errno == EINTR))) {
+        if (bytes > 0 && measurement->firstOutput == 0) {
+            measurement->firstOutput = now() - start;
+        }
+        for (ssize_t i = 0; i < bytes; i++) {
+            measurement->results += (buffer[i] == '\n' || buffer[i] == '\0');
+        }
+    }
+    free(buffer);
+    close(output[0]);
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) {
+        fprintf(stderr, "Process couldn't be waited for (%s).\n", strerror(errno));
+        return false;
+    }
+
+    measurement->wall = now() - start;
+    measurement->user = toNanoseconds(usage.ru_utime);
+    measurement->system = toNanoseconds(usage.ru_stime);
+    measurement->maxRss = usage.ru_maxrss;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "\'%s\' failed (status %d).\n", argv[0], status);
+        return false;
+    }
+
+    return true;
+}
+
+
+/** \brief Run the utility under ptrace and count system calls of all its threads
+ *
+ *  @param argv - arguments of the run
+ *  @return number of system calls, -1 if they can't be counted
+ */
+static long countSyscalls(char **argv)
+{
+#ifdef SYSCALL_COUNTER
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0) {
+            _exit(126);
+        }
+        raise(SIGSTOP);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+        return -1;
+    }
+
+    // threads of the traced process are traced too
+    ptrace(PTRACE_SETOPTIONS, pid, NULL,
+            (void *) (long) (PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL));
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+
+    long stops = 0;
+    bool succeeded = false;
+    pid_t thread;
+    while ((thread = waitpid(-1, &status, __WALL)) > 0) {
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            if (thread == pid) {
+                succeeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            }
+            continue;
+        }
+
+        // stops of system calls, clone events, the exec trap and starts of
+        // new threads are not passed to the process
+        int signal = WSTOPSIG(status);
+        if (signal == (SIGTRAP | 0x80)) {
+            stops++;
+            signal = 0;
+        } else if (signal == SIGTRAP || signal == SIGSTOP) {
+            signal = 0;
+        }
+        ptrace(PTRACE_SYSCALL, thread, NULL, (void *) (long) signal);
+    }
+
+    // every call stops on its entry and exit
+    return succeeded ? (stops + 1) / 2 : -1;
+#else
+    (void) argv;
+    return -1;
+#endif
+}
+
+
+/** \brief Drop the page, dentry and inode caches (needs root)
+ *
+ *  @return true if successful
+ */
+static bool dropCaches()
+{
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool success = write(fd, "3\n", 2) == 2;
+    close(fd);
+    return success;
+}
+
+
+/** \brief Compare two numbers for qsort
+ *
+ *  @param one - pointer to the first uint64_t
+ *  @param two - pointer to the second uint64_t
+ *  @return negative, zero or positive number
+ */
+static int compareNumbers(const void *one, const void *two)
+{
+    uint64_t first = *(const uint64_t *) one;
+    uint64_t second = *(const uint64_t *) two;
+    return (first > second) - (first < second);
+}
+
+
+/** \brief Get the median of the values (the array is sorted)
+ *
+ *  @param values - array of values
+ *  @param count - number of values
+ *  @return the median
+ */
+static uint64_t median(uint64_t *values, size_t count)
+{
+    qsort(values, count, sizeof(uint64_t), compareNumbers);
+    return (count % 2 == 1) ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+
+/** \brief Run a query several times and print one line of results
+ *
+ *  @param argv - arguments of the runs
+ *  @param query - Query structure
+ *  @param revision - revision of the utility
+ *  @param runs - number of measured runs
+ *  @param cold - caches are dropped before every run (a warm up run is done otherwise)
+ *  @param syscalls - number of system calls of the query
+ *  @return true if all runs succeeded
+ */
+static bool benchmarkQuery(char **argv, const Query *query, char *revision, int runs, bool cold, long syscalls)
+{
+    uint64_t wall[MAX_RUNS], cpu[MAX_RUNS], user[MAX_RUNS], system[MAX_RUNS], firstOutput[MAX_RUNS];
+    Measurement measurement;
+    uint64_t minWall = UINT64_MAX;
+    long maxRss = 0;
+
+    if (!cold && !runOnce(argv, &measurement)) {
+        return false;
+    }
+
+    for (int i = 0; i < runs; i++) {
+        if ((cold && !dropCaches()) || !runOnce(argv, &measurement)) {
+            return false;
+        }
+        wall[i] = measurement.wall;
+        user[i] = measurement.user;
+        system[i] = measurement.system;
+        cpu[i] = measurement.user + measurement.system;
+        firstOutput[i] = measurement.firstOutput;
+        minWall = (measurement.wall < minWall) ? measurement.wall : minWall;
+        maxRss = (measurement.maxRss > maxRss) ? measurement.maxRss : maxRss;
+    }
+
+    printf("%s\t%s\t", revision, query->name);
+    for (size_t i = 0; query->arguments[i] != NULL; i++) {
+        printf((i > 0) ? " %s" : "%s", query->arguments[i]);
+    }
+    printf("\t%s\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%ld\t%ld\t%zu\n",
+            cold ? "cold" : "warm", runs, median(wall, runs) / 1e6, minWall / 1e6,
+            median(cpu, runs) / 1e6, median(user, runs) / 1e6, median(system, runs) / 1e6,
+            median(firstOutput, runs) / 1e6, maxRss, syscalls, measurement.results);
+    fflush(stdout);
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    char *revision = "-";
+    int runs = DEFAULT_RUNS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:n:")) != -1) {
+        switch (opt) {
+        case 'r':
+            revision = (*optarg != '\0') ? optarg : "-";
+            break;
+        case 'n':
+            runs = atoi(optarg);
+            if (runs < 1 || runs > MAX_RUNS) {
+                fprintf(stderr, "\'-n\' expects 1 to %d runs.\n", MAX_RUNS);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 2 != argc) {
+        fprintf(stderr, "usage: findBench [-r REVISION] [-n RUNS] FIND DIRECTORY\n");
+        return EXIT_FAILURE;
+    }
+
+    char *find = argv[optind];
+    char *directory = argv[optind + 1];
+
+    // files of the tree are owned by several users when it was generated by root
+    char user[32];
+    snprintf(user, sizeof(user), "%lu", (unsigned long) geteuid());
+
+    const Query queries[] = {
+        { "all", { NULL } },
+        { "name", { "-n", "needle.txt", NULL } },
+        { "glob", { "-G", "*.log", NULL } },
+        { "mask", { "-m", "644", NULL } },
+        { "user", { "-u", user, NULL } },
+        { "depth", { "-f", "2", "-t", "4", NULL } },
+        { "sort-path", { "-s", "f", NULL } },
+        { "sort-size", { "-s", "s", NULL } },
+        { "unsorted", { "-s", "none", NULL } },
+        { "ordered", { "-o", NULL } },
+        { "threads", { "-j", "4", NULL } },
+        { "top", { "-k", "100", "-s", "s", NULL } },
+    };
+    size_t queryCount = sizeof(queries) / sizeof(queries[0]);
+
+    // cold runs need root, without it only warm ones are measured
+    bool cold = dropCaches();
+    printf("# find: %s, tree: %s, runs: %d\n", find, directory, runs);
+    if (!cold) {
+        printf("# caches can't be dropped (%s), cold runs are skipped\n", strerror(errno));
+    }
+    printf("revision\tquery\targuments\tcache\truns\twall_ms\twall_min_ms\tcpu_ms\tuser_ms"
+           "\tsys_ms\tfirst_output_ms\tmax_rss_kb\tsyscalls\tresults\n");
+    fflush(stdout);
+
+    char *arguments[MAX_QUERY_ARGUMENTS + 3];
+    for (size_t i = 0; i < queryCount; i++) {
+        buildArguments(arguments, find, queries + i, directory);
+        long syscalls = countSyscalls(arguments);
+
+        if (!benchmarkQuery(arguments, queries + i, revision, runs, false, syscalls)
+                || (cold && !benchmarkQuery(arguments, queries + i, revision, runs, true, syscalls))) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+#include "../nameMatcher.h"
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// microbenchmark of the -n substring matchers
+// usage: nameMatcherBench [DIRECTORY]
+// names are collected from DIRECTORY (recursively), a synthetic corpus is used without it
+
+const size_t MAX_NAMES = 1000000;
+const size_t SYNTHETIC_NAMES = 200000;
+const int ROUNDS = 20;
+
+
+// corpus of names, stored one after another
+typedef struct
+{
+    char *data;
+    size_t used;
+    size_t size;
+    char **names;
+    size_t *lengths;
+    size_t count;
+} Corpus;
+
+
+/** \brief Add a copy of a name into the corpus
+ *
+ *  @param corpus - Corpus structure
+ *  @param name - the name
+ *  @return true if successful
+ */
+static bool addName(Corpus *corpus, const char *name)
+{
+    if (corpus->count == MAX_NAMES) {
+        return false;
+    }
+
+    // names are packed one after another like in a directory buffer
+    size_t length = strlen(name);
+    if (corpus->used + length + 1 > corpus->size) {
+        return false;
+    }
+    corpus->names[corpus->count] = corpus->data + corpus->used;
+    memcpy(corpus->names[corpus->count], name, length + 1);
+    corpus->used += length + 1;
+    corpus->lengths[corpus->count] = length;
+    corpus->count++;
+    return true;
+}
+
+
+/** \brief Collect names of a directory tree (symbolic links are not followed)
+ *
+ *  @param corpus - Corpus structure
+ *  @param path - path to the directory
+ */
+static void collectNames(Corpus *corpus, const char *path)
+{
+    DIR *directory = opendir(path);
+    if (directory == NULL) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (!addName(corpus, entry->d_name)) {
+            break;
+        }
+
+        if (entry->d_type == DT_DIR) {
+            size_t length = strlen(path) + strlen(entry->d_name) + 2;
+            char *subdirectory = malloc(length);
+            if (subdirectory != NULL) {
+                snprintf(subdirectory, length, "%s/%s", path, entry->d_name);
+                collectNames(corpus, subdirectory);
+                free(subdirectory);
+            }
+        }
+    }
+
+    closedir(directory);
+}
+
+
+/** \brief Generate names looking like a source tree / photo library / build output
+ *
+ *  @param corpus - Corpus structure
+ */
+static void generateNames(Corpus *corpus)
+{
+    const char *words[] = { "main", "user", "structures", "config", "index", "test",
+            "readme", "IMG", "thread", "pool", "directory", "reader", "node", "module",
+            "build", "output", "parser", "vendor", "lib", "cache", "report", "final" };
+    const char *extensions[] = { ".c", ".h", ".o", ".js", ".json", ".md", ".JPG",
+            ".txt", ".tar.gz", ".py", "", ".cpp", ".d" };
+    size_t wordCount = sizeof(words) / sizeof(words[0]);
+    size_t extensionCount = sizeof(extensions) / sizeof(extensions[0]);
+    uint32_t seed = 42;
+    char name[256];
+
+    for (size_t i = 0; i < SYNTHETIC_NAMES; i++) {
+        size_t length = 0;
+        seed = seed * 1103515245u + 12345u;
+        size_t parts = 1 + (seed >> 16) % 3;
+
+        for (size_t part = 0; part < parts; part++) {
+            seed = seed * 1103515245u + 12345u;
+            const char *word = words[(seed >> 16) % wordCount];
+            length += snprintf(name + length, sizeof(name) - length, "%s%s",
+                    (part > 0) ? "_" : "", word);
+        }
+
+        // some names carry numbers or hashes
+        seed = seed * 1103515245u + 12345u;
+        if ((seed >> 16) % 4 == 0) {
+            length += snprintf(name + length, sizeof(name) - length, "-%08x", seed);
+        }
+
+        seed = seed * 1103515245u + 12345u;
+        snprintf(name + length, sizeof(name) - length, "%s", extensions[(seed >> 16) % extensionCount]);
+        addName(corpus, name);
+    }
+}
+
+
+/** \brief Get monotonic time in nanoseconds
+ *
+ *  @return the time
+ */
+static uint64_t now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000u + (uint64_t) time.tv_nsec;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *patterns[] = { "a", ".c", "test", "config", "zq", "_module.json", "directory_reader" };
+    size_t patternCount = sizeof(patterns) / sizeof(patterns[0]);
+    Corpus corpus = { malloc(MAX_NAMES * 256), 0, MAX_NAMES * 256,
+            malloc(MAX_NAMES * sizeof(char *)), malloc(MAX_NAMES * sizeof(size_t)), 0 };
+
+    if (corpus.data == NULL || corpus.names == NULL || corpus.lengths == NULL) {
+        fprintf(stderr, "Couldn't allocate the corpus.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (argc > 1) {
+        collectNames(&corpus, argv[1]);
+    } else {
+        generateNames(&corpus);
+    }
+
+    size_t totalLength = 0;
+    for (size_t i = 0; i < corpus.count; i++) {
+        totalLength += corpus.lengths[i];
+    }
+    printf("# corpus: %zu names, average length %.1f\n", corpus.count,
+            corpus.count ? (double) totalLength / corpus.count : 0.0);
+    printf("pattern\tmethod\tmatches\tns_per_name\n");
+
+    bool consistent = true;
+    for (size_t p = 0; p < patternCount; p++) {
+        size_t expected = 0;
+
+        for (int method = NAME_MATCH_STRSTR; method < NAME_MATCH_COUNT; method++) {
+            if (!nameMatchMethodSupported(method)) {
+                continue;
+            }
+
+            NameMatcher matcher;
+            initNameMatcher(&matcher, patterns[p], method);
+
+            size_t matches = 0;
+            uint64_t start = now();
+            for (int round = 0; round < ROUNDS; round++) {
+                for (size_t i = 0; i < corpus.count; i++) {
+                    // the length is measured as well, the traversal has to do the same
+                    matches += matchName(&matcher, corpus.names[i], strlen(corpus.names[i]));
+                }
+            }
+            uint64_t elapsed = now() - start;
+            matches /= ROUNDS;
+
+            if (method == NAME_MATCH_STRSTR) {
+                expected = matches;
+            } else if (matches != expected) {
+                consistent = false;
+            }
+
+            printf("%s\t%s\t%zu\t%.2f\n", patterns[p], nameMatchMethodName(method), matches,
+                    corpus.count ? (double) elapsed / ((double) corpus.count * ROUNDS) : 0.0);
+        }
+    }
+
+    free(corpus.data);
+    free(corpus.names);
+    free(corpus.lengths);
+
+    if (!consistent) {
+        fprintf(stderr, "Matchers don't agree on the number of matches!\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,356 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// deterministic directory tree for the find benchmark
+// usage: treeGenerator [-d DEPTH] [-f FANOUT] [-n FILES] [-l MIN:MAX] [-H PERCENT]
+//                      [-b BIG_DIRS] [-B BIG_SIZE] [-s SEED] DIRECTORY
+// the same parameters always give the same tree, an existing tree built with
+// the same parameters is kept (they're stored in DIRECTORY/.benchTree)
+
+const char *STAMP_NAME = ".benchTree";
+const char *NEEDLE_NAME = "needle.txt";
+// every directory whose number is divisible by this gets a needle
+const size_t NEEDLE_INTERVAL = 7;
+
+
+// parameters of the tree
+typedef struct
+{
+    // levels of directories under the root and subdirectories of each directory
+    size_t depth;
+    size_t fanout;
+    // regular files in every directory of the levels
+    size_t files;
+    // limits of the name length (without the extension)
+    size_t minNameLength;
+    size_t maxNameLength;
+    // percent of hidden files and directories
+    size_t hiddenPercent;
+    // directories with a huge number of files under the root
+    size_t bigDirectories;
+    size_t bigDirectorySize;
+    uint64_t seed;
+} TreeParameters;
+
+
+// state of the generator
+typedef struct
+{
+    TreeParameters params;
+    uint64_t random;
+    // numbers of the created directories and files
+    size_t directories;
+    size_t files;
+    // owners are mixed only when the generator runs as root
+    bool changeOwners;
+} Generator;
+
+
+/** \brief Next number of the xorshift64* generator
+ *
+ *  @param generator - Generator structure
+ *  @return the number
+ */
+static uint64_t nextRandom(Generator *generator)
+{
+    generator->random ^= generator->random >> 12;
+    generator->random ^= generator->random << 25;
+    generator->random ^= generator->random >> 27;
+    return generator->random * 2685821657736338717u;
+}
+
+
+/** \brief Generate a name, short names are more common than long ones
+ *
+ *  @param generator - Generator structure
+ *  @param name - buffer for the name (at least maxNameLength + 16 bytes)
+ *  @param directory - the name is for a directory (no extension)
+ */
+static void generateName(Generator *generator, char *name, bool directory)
+{
+    const char *extensions[] = { ".log", ".txt", ".c", ".h", ".json", ".tar.gz", "", ".JPG" };
+    const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789_-";
+    TreeParameters *params = &generator->params;
+    size_t length = 0;
+
+    if (nextRandom(generator) % 100 < params->hiddenPercent) {
+        name[length++] = '.';
+    }
+
+    // every extra character has a probability of 3/4
+    size_t nameLength = params->minNameLength;
+    while (nameLength < params->maxNameLength && nextRandom(generator) % 4 != 0) {
+        nameLength++;
+    }
+
+    for (size_t i = 0; i < nameLength; i++) {
+        name[length++] = letters[nextRandom(generator) % (sizeof(letters) - 1)];
+    }
+
+    // a number keeps the names unique within the tree
+    length += sprintf(name + length, "%zu", generator->directories + generator->files);
+    const char *extension = directory ? "" : extensions[nextRandom(generator) % 8];
+    strcpy(name + length, extension);
+}
+
+
+/** \brief Give the element a permission, an owner and a size
+ *
+ *  @param generator - Generator structure
+ *  @param fd - descriptor of the file (-1 for a directory)
+ *  @param path - path of the element
+ *  @return true if successful
+ */
+static bool setAttributes(Generator *generator, int fd, char *path)
+{
+    const mode_t fileModes[] = { 0644, 0644, 0600, 0640, 0755, 0444 };
+    const mode_t directoryModes[] = { 0755, 0755, 0750, 0700 };
+    const uid_t owners[] = { 0, 1, 2, 65534 };
+
+    uint64_t random = nextRandom(generator);
+    mode_t mode = (fd < 0) ? directoryModes[random % 4] : fileModes[random % 6];
+    uid_t owner = owners[(random >> 8) % 4];
+
+    if (fd >= 0) {
+        // sizes from bytes to gigabytes, the files are sparse
+        off_t size = (off_t) ((random >> 16) % 1024) << ((random >> 32) % 21);
+        if (ftruncate(fd, size) != 0 || fchmod(fd, mode) != 0
+                || (generator->changeOwners && fchown(fd, owner, owner) != 0)) {
+            return false;
+        }
+        return true;
+    }
+
+    // directories keep their write permission for the owner, so that the tree can be removed
+    return chmod(path, mode) == 0 && (!generator->changeOwners || chown(path, owner, owner) == 0);
+}
+
+
+/** \brief Create a file
+ *
+ *  @param generator - Generator structure
+ *  @param path - path of the file
+ *  @return true if successful
+ */
+static bool createFile(Generator *generator, char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "File \'%s\' couldn't be created (%s).\n", path, strerror(errno));
+        return false;
+    }
+
+    bool success = setAttributes(generator, fd, path);
+    close(fd);
+    generator->files++;
+
+    if (!success) {
+        fprintf(stderr, "Attributes of \'%s\' couldn't be set (%s).\n", path, strerror(errno));
+    }
+    return success;
+}
+
+
+/** \brief Create a directory with its files and subdirectories
+ *
+ *  @param generator - Generator structure
+ *  @param path - path of the directory (it's created already)
+ *  @param level - level of the directory (0 = root)
+ *  @return true if successful
+ */
+static bool fillDirectory(Generator *generator, char *path, size_t level)
+{
+    TreeParameters *params = &generator->params;
+    size_t pathLength = strlen(path);
+    char *child = malloc(pathLength + params->maxNameLength + 64);
+    char *name = child + pathLength + 1;
+    bool success = (child != NULL);
+
+    if (success) {
+        memcpy(child, path, pathLength);
+        child[pathLength] = '/';
+    }
+
+    for (size_t i = 0; success && i < params->files; i++) {
+        generateName(generator, name, false);
+        success = createFile(generator, child);
+    }
+
+    // some directories contain a file with a known name
+    if (success && generator->directories % NEEDLE_INTERVAL == 0) {
+        strcpy(name, NEEDLE_NAME);
+        success = createFile(generator, child);
+    }
+
+    for (size_t i = 0; success && level < params->depth && i < params->fanout; i++) {
+        generateName(generator, name, true);
+        generator->directories++;
+        if (mkdir(child, 0755) != 0) {
+            fprintf(stderr, "Directory \'%s\' couldn't be created (%s).\n", child, strerror(errno));
+            success = false;
+            break;
+        }
+        success = fillDirectory(generator, child, level + 1) && setAttributes(generator, -1, child);
+    }
+
+    free(child);
+    return success;
+}
+
+
+/** \brief Create the directories with a huge number of files
+ *
+ *  @param generator - Generator structure
+ *  @param root - path of the root directory
+ *  @return true if successful
+ */
+static bool createBigDirectories(Generator *generator, char *root)
+{
+    TreeParameters *params = &generator->params;
+    size_t rootLength = strlen(root);
+    char *path = malloc(rootLength + params->maxNameLength + 128);
+    if (path == NULL) {
+        return false;
+    }
+
+    bool success = true;
+    for (size_t i = 0; success && i < params->bigDirectories; i++) {
+        int length = sprintf(path, "%s/big%zu", root, i);
+        generator->directories++;
+        if (mkdir(path, 0755) != 0) {
+            fprintf(stderr, "Directory \'%s\' couldn't be created (%s).\n", path, strerror(errno));
+            success = false;
+            break;
+        }
+
+        path[length] = '/';
+        for (size_t j = 0; success && j < params->bigDirectorySize; j++) {
+            generateName(generator, path + length + 1, false);
+            success = createFile(generator, path);
+        }
+    }
+
+    free(path);
+    return success;
+}
+
+
+/** \brief Parse "MIN:MAX" into two numbers
+ *
+ *  @param arg - the argument
+ *  @param min - first number
+ *  @param max - second number
+ *  @return true if the argument is valid
+ */
+static bool parseRange(char *arg, size_t *min, size_t *max)
+{
+    char *end = NULL;
+    *min = strtoul(arg, &end, 10);
+    if (*end != ':') {
+        return false;
+    }
+    *max = strtoul(end + 1, &end, 10);
+    return *end == '\0' && *min <= *max && *max <= 200;
+}
+
+
+int main(int argc, char *argv[])
+{
+    TreeParameters params = { 4, 6, 20, 3, 24, 5, 2, 1000000, 42 };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:f:n:l:H:b:B:s:")) != -1) {
+        switch (opt) {
+        case 'd':
+            params.depth = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            params.fanout = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            params.files = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            if (!parseRange(optarg, &params.minNameLength, &params.maxNameLength)) {
+                fprintf(stderr, "\'-l\' expects MIN:MAX name lengths (at most 200).\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'H':
+            params.hiddenPercent = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            params.bigDirectories = strtoul(optarg, NULL, 10);
+            break;
+        case 'B':
+            params.bigDirectorySize = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            params.seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        fprintf(stderr, "usage: treeGenerator [-d DEPTH] [-f FANOUT] [-n FILES] [-l MIN:MAX]"
+                        " [-H PERCENT] [-b BIG_DIRS] [-B BIG_SIZE] [-s SEED] DIRECTORY\n");
+        return EXIT_FAILURE;
+    }
+
+    char *root = argv[optind];
+    char stamp[512];
+    char stampPath[4096];
+    snprintf(stamp, sizeof(stamp), "depth=%zu fanout=%zu files=%zu names=%zu:%zu hidden=%zu big=%zux%zu seed=%llu\n",
+            params.depth, params.fanout, params.files, params.minNameLength, params.maxNameLength,
+            params.hiddenPercent, params.bigDirectories, params.bigDirectorySize,
+            (unsigned long long) params.seed);
+    snprintf(stampPath, sizeof(stampPath), "%s/%s", root, STAMP_NAME);
+
+    // the tree is kept if it was built with the same parameters
+    FILE *stampFile = fopen(stampPath, "r");
+    if (stampFile != NULL) {
+        char existing[512] = "";
+        bool same = fgets(existing, sizeof(existing), stampFile) != NULL && strcmp(existing, stamp) == 0;
+        fclose(stampFile);
+        if (same) {
+            printf("# tree \'%s\' is up to date (%s", root, stamp);
+            printf("# remove it to generate it again)\n");
+            return EXIT_SUCCESS;
+        }
+        fprintf(stderr, "\'%s\' holds a tree with other parameters, remove it first.\n", root);
+        return EXIT_FAILURE;
+    }
+
+    if (mkdir(root, 0755) != 0) {
+        fprintf(stderr, "Directory \'%s\' couldn't be created (%s).\n", root, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    Generator generator = { params, params.seed * 2 + 1, 0, 0, geteuid() == 0 };
+    if (!generator.changeOwners) {
+        printf("# not running as root, all files are owned by the current user\n");
+    }
+
+    if (!fillDirectory(&generator, root, 0) || !createBigDirectories(&generator, root)) {
+        return EXIT_FAILURE;
+    }
+
+    // written last, an interrupted tree is not reused
+    stampFile = fopen(stampPath, "w");
+    if (stampFile == NULL || fputs(stamp, stampFile) == EOF || fclose(stampFile) != 0) {
+        fprintf(stderr, "\'%s\' couldn't be written.\n", stampPath);
+        return EXIT_FAILURE;
+    }
+
+    printf("# tree \'%s\': %zu directories, %zu files\n", root, generator.directories, generator.files);
+    return EXIT_SUCCESS;
+}
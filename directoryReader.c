@@ -0,0 +1,386 @@
+#include "directoryReader.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(USE_GETDENTS) && defined(__linux__)
+#include <sys/syscall.h>
+#define GETDENTS_READER 1
+#endif
+
+// first size of a getdents buffer
+const size_t READ_BUFFER_INITIAL_SIZE = 32 * 1024;
+// buffers don't grow over this size
+const size_t READ_BUFFER_MAXIMAL_SIZE = 4 * 1024 * 1024;
+const int READ_BUFFER_STACK_REALLOCATION = 16;
+// first number of elements and bytes of names of a sorted directory
+const size_t SORTED_ENTRIES_INITIAL_SIZE = 64;
+const size_t SORTED_NAMES_INITIAL_SIZE = 1024;
+
+
+#ifdef GETDENTS_READER
+// record returned by getdents64 (not exported by all C libraries)
+struct linuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+
+/** \brief Return an empty ReadBufferStack, buffers are allocated when needed
+ *
+ *  @return ReadBufferStack structure
+ */
+ReadBufferStack initReadBufferStack()
+{
+    ReadBufferStack stack;
+    stack.buffers = NULL;
+    stack.used = 0;
+    stack.allocatedSize = 0;
+    return stack;
+}
+
+
+/** \brief Free all buffers of the stack
+ *
+ *  @param stack - ReadBufferStack structure
+ */
+void freeReadBufferStack(ReadBufferStack *stack)
+{
+    for (size_t i = 0; i < stack->allocatedSize; i++) {
+        free(stack->buffers[i].data);
+    }
+
+    if (stack->buffers != NULL)
+        free(stack->buffers);
+
+    *stack = initReadBufferStack();
+}
+
+
+/** \brief Determine if the getdents64 reader is compiled in
+ *
+ *  @return true if it is
+ */
+bool getdentsAvailable()
+{
+#ifdef GETDENTS_READER
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+#ifdef GETDENTS_READER
+/** \brief Take the next free buffer from the stack, the stack grows when needed
+ *
+ *  @param stack - ReadBufferStack structure
+ *  @param level - index of the buffer is stored here
+ *  @return true on success
+ *          false on memory allocation fail
+ */
+static bool pushReadBuffer(ReadBufferStack *stack, size_t *level)
+{
+    if (stack->used == stack->allocatedSize) {
+        size_t newSize = stack->allocatedSize + READ_BUFFER_STACK_REALLOCATION;
+        ReadBuffer *reallocated = realloc(stack->buffers, newSize * sizeof(ReadBuffer));
+
+        if (reallocated == NULL) {
+            return false;
+        }
+
+        // new buffers get their memory on the first use
+        memset(reallocated + stack->allocatedSize, 0,
+                (newSize - stack->allocatedSize) * sizeof(ReadBuffer));
+        stack->buffers = reallocated;
+        stack->allocatedSize = newSize;
+    }
+
+    ReadBuffer *buffer = stack->buffers + stack->used;
+    if (buffer->data == NULL) {
+        buffer->data = malloc(READ_BUFFER_INITIAL_SIZE);
+        if (buffer->data == NULL) {
+            return false;
+        }
+        buffer->size = READ_BUFFER_INITIAL_SIZE;
+    }
+
+    *level = stack->used++;
+    return true;
+}
+#endif
+
+
+/** \brief Start reading a directory with readdir or getdents
+ *
+ *  @param reader - DirectoryReader structure
+ *  @param fd - descriptor of the directory (owned by the reader)
+ *  @param stack - buffers for the getdents reader, NULL selects readdir
+ *  @return true on success
+ */
+bool openDirectoryReader(DirectoryReader *reader, int fd, ReadBufferStack *stack)
+{
+    reader->fd = fd;
+    reader->stream = NULL;
+    reader->stack = NULL;
+    reader->level = 0;
+    reader->position = 0;
+    reader->filled = 0;
+    reader->finished = false;
+    reader->sortedEntries = NULL;
+    reader->sortedNames = NULL;
+    reader->sortedCount = 0;
+    reader->sortedNext = 0;
+
+#ifdef GETDENTS_READER
+    if (stack != NULL) {
+        if (!pushReadBuffer(stack, &reader->level)) {
+            close(fd);
+            errno = ENOMEM;
+            return false;
+        }
+        reader->stack = stack;
+        return true;
+    }
+#else
+    (void) stack;
+#endif
+
+    reader->stream = fdopendir(fd);
+    if (reader->stream == NULL) {
+        int savedErrno = errno;
+        close(fd);
+        errno = savedErrno;
+        return false;
+    }
+
+    return true;
+}
+
+
+#ifdef GETDENTS_READER
+/** \brief Fill the reader's buffer with records from the kernel. When a read
+ *  fills most of the buffer, the directory is large and the buffer is doubled
+ *  so that the following reads need fewer system calls.
+ *
+ *  @param reader - DirectoryReader structure
+ *  @return true if some records were read
+ *          false at the end of the directory or on error
+ */
+static bool fillReadBuffer(DirectoryReader *reader)
+{
+    ReadBuffer *buffer = reader->stack->buffers + reader->level;
+
+    // the previous read was almost full, grow the buffer (keep the old one on fail)
+    if (reader->filled > buffer->size / 2 && buffer->size < READ_BUFFER_MAXIMAL_SIZE) {
+        char *reallocated = realloc(buffer->data, buffer->size * 2);
+        if (reallocated != NULL) {
+            buffer->data = reallocated;
+            buffer->size *= 2;
+        }
+    }
+
+    long bytes = syscall(SYS_getdents64, reader->fd, buffer->data, buffer->size);
+    if (bytes <= 0) {
+        reader->finished = true;
+        return false;
+    }
+
+    reader->position = 0;
+    reader->filled = (size_t) bytes;
+    return true;
+}
+#endif
+
+
+/** \brief Read the next element, records of getdents are parsed in place
+ *
+ *  @param reader - DirectoryReader structure
+ *  @param entry - name and type of the element are stored here
+ *  @return true if an element was read
+ *          false at the end of the directory
+ */
+bool readDirectoryEntry(DirectoryReader *reader, DirectoryEntry *entry)
+{
+    // sorted elements were read already
+    if (reader->sortedEntries != NULL) {
+        if (reader->sortedNext >= reader->sortedCount) {
+            return false;
+        }
+        *entry = reader->sortedEntries[reader->sortedNext++];
+        return true;
+    }
+
+#ifdef GETDENTS_READER
+    if (reader->stack != NULL) {
+        if (reader->position >= reader->filled
+                && (reader->finished || !fillReadBuffer(reader))) {
+            return false;
+        }
+
+        struct linuxDirent64 *record = (struct linuxDirent64 *)
+                (reader->stack->buffers[reader->level].data + reader->position);
+        reader->position += record->d_reclen;
+
+        entry->name = record->d_name;
+        entry->type = record->d_type;
+        return true;
+    }
+#endif
+
+    struct dirent *directoryElement = readdir(reader->stream);
+    if (directoryElement == NULL) {
+        return false;
+    }
+
+    entry->name = directoryElement->d_name;
+#ifdef DT_UNKNOWN
+    entry->type = directoryElement->d_type;
+#else
+    entry->type = 0;
+#endif
+    return true;
+}
+
+
+/** \brief Determine which element goes first in the walk, the name of
+ *  a directory is followed by '/' in the paths of its files
+ *
+ *  @param entryOne - pointer to the first DirectoryEntry
+ *  @param entryTwo - pointer to the second DirectoryEntry
+ *  @return negative num if entryOne goes first, positive num if it goes second
+ */
+int compareDirectoryEntries(const void *entryOne, const void *entryTwo)
+{
+    const DirectoryEntry *one = entryOne;
+    const DirectoryEntry *two = entryTwo;
+    const unsigned char *nameOne = (const unsigned char *) one->name;
+    const unsigned char *nameTwo = (const unsigned char *) two->name;
+
+    while (*nameOne != '\0' && *nameOne == *nameTwo) {
+        nameOne++;
+        nameTwo++;
+    }
+
+    // the end of a name is compared as the character that follows it in a path
+    int charOne = *nameOne;
+    int charTwo = *nameTwo;
+#ifdef DT_UNKNOWN
+    charOne = (charOne == '\0' && one->type == DT_DIR) ? '/' : charOne;
+    charTwo = (charTwo == '\0' && two->type == DT_DIR) ? '/' : charTwo;
+#endif
+
+    return charOne - charTwo;
+}
+
+
+/** \brief Read all elements of the directory and sort them for the walk
+ *
+ *  @param reader - DirectoryReader structure, no element was read yet
+ *  @return true on success
+ *          false on memory allocation fail
+ */
+bool sortDirectoryEntries(DirectoryReader *reader)
+{
+    size_t entriesSize = SORTED_ENTRIES_INITIAL_SIZE;
+    size_t namesSize = SORTED_NAMES_INITIAL_SIZE;
+    size_t namesUsed = 0;
+    size_t count = 0;
+
+    // names are referenced by offsets until the block stops moving
+    size_t *offsets = malloc(entriesSize * sizeof(size_t));
+    DirectoryEntry *entries = malloc(entriesSize * sizeof(DirectoryEntry));
+    char *names = malloc(namesSize);
+    bool failed = (offsets == NULL || entries == NULL || names == NULL);
+    DirectoryEntry entry;
+
+    // the whole directory has to be read, otherwise the order would be wrong
+    while (!failed && readDirectoryEntry(reader, &entry)) {
+        size_t length = strlen(entry.name) + 1;
+
+        if (count == entriesSize) {
+            entriesSize *= 2;
+            size_t *newOffsets = realloc(offsets, entriesSize * sizeof(size_t));
+            offsets = (newOffsets == NULL) ? offsets : newOffsets;
+            DirectoryEntry *newEntries = realloc(entries, entriesSize * sizeof(DirectoryEntry));
+            entries = (newEntries == NULL) ? entries : newEntries;
+            failed = (newOffsets == NULL || newEntries == NULL);
+        }
+
+        if (!failed && namesSize - namesUsed < length) {
+            namesSize = (namesSize * 2 > namesUsed + length) ? namesSize * 2 : namesUsed + length;
+            char *newNames = realloc(names, namesSize);
+            names = (newNames == NULL) ? names : newNames;
+            failed = (newNames == NULL);
+        }
+
+        if (failed) {
+            break;
+        }
+
+#ifdef DT_UNKNOWN
+        // directories have to be recognized for the order
+        struct stat buf;
+        if (entry.type == DT_UNKNOWN && fstatat(reader->fd, entry.name, &buf, AT_SYMLINK_NOFOLLOW) == 0) {
+            entry.type = IFTODT(buf.st_mode);
+        }
+#endif
+
+        memcpy(names + namesUsed, entry.name, length);
+        offsets[count] = namesUsed;
+        entries[count++] = entry;
+        namesUsed += length;
+    }
+
+    if (failed) {
+        free(offsets);
+        free(entries);
+        free(names);
+        errno = ENOMEM;
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        entries[i].name = names + offsets[i];
+    }
+    free(offsets);
+
+    qsort(entries, count, sizeof(DirectoryEntry), compareDirectoryEntries);
+
+    reader->sortedEntries = entries;
+    reader->sortedNames = names;
+    reader->sortedCount = count;
+    reader->sortedNext = 0;
+    return true;
+}
+
+
+/** \brief Close the directory, its buffer is returned to the stack
+ *
+ *  @param reader - DirectoryReader structure
+ */
+void closeDirectoryReader(DirectoryReader *reader)
+{
+    free(reader->sortedEntries);
+    free(reader->sortedNames);
+
+    if (reader->stream != NULL) {
+        closedir(reader->stream);
+        return;
+    }
+
+    // directories are closed in reverse order, so the buffer is on top of the stack
+    reader->stack->used--;
+    close(reader->fd);
+}
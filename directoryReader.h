@@ -0,0 +1,138 @@
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef DIRECTORY_READER_DEFINED
+#define DIRECTORY_READER_DEFINED
+
+// buffer used by the getdents reader, buffers are kept between directories
+typedef struct
+{
+    // raw records returned by the kernel
+    char *data;
+    // allocated size of data
+    size_t size;
+} ReadBuffer;
+
+
+// stack of buffers, every opened directory (recursion level) uses its own one
+typedef struct
+{
+    // array of buffers
+    ReadBuffer *buffers;
+    // buffers used by currently opened directories
+    size_t used;
+    // maximum allocated size, used in realloc
+    size_t allocatedSize;
+} ReadBufferStack;
+
+
+// one element of a directory, the name points into the reader's memory
+// and is valid until the next element is read
+typedef struct
+{
+    char *name;
+    // DT_* type of the element (DT_UNKNOWN if not provided)
+    unsigned char type;
+} DirectoryEntry;
+
+
+// opened directory, read either by readdir or by getdents64
+typedef struct
+{
+    // descriptor of the directory
+    int fd;
+    // stream used by the readdir reader (NULL for getdents reader)
+    DIR *stream;
+
+    // getdents reader, index of the buffer within the stack
+    ReadBufferStack *stack;
+    size_t level;
+    // position of the next record and number of valid bytes in the buffer
+    size_t position;
+    size_t filled;
+    // set when the kernel has no more records
+    bool finished;
+
+    // sorted reader: all elements are read at once and returned in order,
+    // their names are copied into one block
+    DirectoryEntry *sortedEntries;
+    char *sortedNames;
+    size_t sortedCount;
+    size_t sortedNext;
+} DirectoryReader;
+
+
+/** \brief Create an empty ReadBufferStack structure
+ *
+ *  @return new ReadBufferStack structure
+ */
+ReadBufferStack initReadBufferStack();
+
+
+/** \brief Free heap memory used by all buffers of the stack
+ *
+ *  @param stack - ReadBufferStack structure
+ */
+void freeReadBufferStack(ReadBufferStack *stack);
+
+
+/** \brief Determine if the getdents64 reader is compiled in
+ *
+ *  @return true if the program was built with USE_GETDENTS on Linux
+ */
+bool getdentsAvailable();
+
+
+/** \brief Start reading an opened directory
+ *
+ *  @param reader - DirectoryReader structure that's initialized
+ *  @param fd - descriptor of the directory (owned by the reader afterwards)
+ *  @param stack - buffers for the getdents reader, NULL selects readdir
+ *  @return true on success
+ *          false if the directory stream or buffer couldn't be created
+ *          (the descriptor is closed in that case, errno is set)
+ */
+bool openDirectoryReader(DirectoryReader *reader, int fd, ReadBufferStack *stack);
+
+
+/** \brief Read the next element of the directory
+ *
+ *  @param reader - DirectoryReader structure
+ *  @param entry - name and type of the element are stored here
+ *  @return true if an element was read
+ *          false at the end of the directory (or when reading fails)
+ */
+bool readDirectoryEntry(DirectoryReader *reader, DirectoryEntry *entry);
+
+
+/** \brief Read all elements of the directory and sort them, so that a walk
+ *  in their order visits files in the order of their paths (strcmp): names
+ *  of directories are compared as if they ended with '/'. Types of elements
+ *  that the filesystem doesn't provide are found out by fstatat.
+ *  readDirectoryEntry returns the sorted elements afterwards.
+ *
+ *  @param reader - DirectoryReader structure, no element was read yet
+ *  @return true on success
+ *          false on memory allocation fail
+ */
+bool sortDirectoryEntries(DirectoryReader *reader);
+
+
+/** \brief Determine which element goes first in the ordered walk
+ *  (comparator of sortDirectoryEntries)
+ *
+ *  @param entryOne - pointer to the first DirectoryEntry
+ *  @param entryTwo - pointer to the second DirectoryEntry
+ *  @return negative num if entryOne goes first, positive num if it goes second
+ */
+int compareDirectoryEntries(const void *entryOne, const void *entryTwo);
+
+
+/** \brief Close the directory and release its buffer
+ *
+ *  @param reader - DirectoryReader structure
+ */
+void closeDirectoryReader(DirectoryReader *reader);
+
+#endif
@@ -0,0 +1,908 @@
+#include "fileIndex.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// identifies index files
+static const char FILE_INDEX_MAGIC[8] = "FINDIDX";
+// first allocated sizes of the builder's arrays
+const size_t INDEX_ENTRIES_INITIAL_SIZE = 1024;
+const size_t INDEX_NAMES_INITIAL_SIZE = 64 * 1024;
+// names longer than this can't be stored by any common filesystem
+const size_t INDEX_MAX_NAME_LENGTH = 64 * 1024;
+
+
+// everything collected during the walk, written into the file at the end
+typedef struct
+{
+    IndexEntry *entries;
+    size_t entryCount;
+    size_t entriesAllocated;
+
+    // front coded names and offsets of the buckets within them
+    uint8_t *names;
+    size_t namesUsed;
+    size_t namesAllocated;
+    uint64_t *buckets;
+    size_t bucketsAllocated;
+
+    // name of the last entry, the next name is coded against it
+    char *previousName;
+    size_t previousLength;
+    size_t previousAllocated;
+
+    size_t maxDepth;
+    size_t maxNameLength;
+
+    // index that's being updated (NULL for a new one) and a cursor over its names
+    const FileIndex *old;
+    IndexCursor oldCursor;
+
+    // path of the inspected element (for messages)
+    PathBuffer path;
+    // buffers of the getdents reader (NULL selects readdir)
+    ReadBufferStack readBuffers;
+    bool useGetdents;
+    RunStatistics *stats;
+} IndexBuilder;
+
+
+/** \brief Grow an array so that at least one more item fits into it
+ *
+ *  @param array - pointer to the array
+ *  @param allocated - allocated number of items (updated)
+ *  @param used - number of items used
+ *  @param itemSize - size of one item
+ *  @param initialSize - number of items of the first allocation
+ *  @return true on success
+ *          false on memory allocation fail
+ */
+static bool reserveItems(void **array, size_t *allocated, size_t used, size_t itemSize, size_t initialSize)
+{
+    if (used < *allocated) {
+        return true;
+    }
+
+    size_t newSize = (*allocated == 0) ? initialSize : *allocated * 2;
+    void *reallocated = realloc(*array, newSize * itemSize);
+    if (reallocated == NULL) {
+        return false;
+    }
+
+    *array = reallocated;
+    *allocated = newSize;
+    return true;
+}
+
+
+/** \brief Append a number as a varint (7 bits per byte, lowest bits first)
+ *
+ *  @param builder - IndexBuilder structure (enough memory is reserved)
+ *  @param value - the number
+ */
+static void appendVarint(IndexBuilder *builder, size_t value)
+{
+    while (value >= 0x80) {
+        builder->names[builder->namesUsed++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    builder->names[builder->namesUsed++] = (uint8_t) value;
+}
+
+
+/** \brief Append a name to the name table, it's coded as the length of the
+ *  prefix it shares with the previous name and the rest of it
+ *
+ *  @param builder - IndexBuilder structure
+ *  @param name - name of the new entry
+ *  @return true on success
+ *          false on memory allocation fail
+ */
+static bool appendName(IndexBuilder *builder, const char *name)
+{
+    size_t length = strlen(name);
+    size_t shared = 0;
+    size_t entry = builder->entryCount;
+
+    // every bucket starts with a whole name
+    if (entry % FILE_INDEX_BUCKET_SIZE == 0) {
+        if (!reserveItems((void **) &builder->buckets, &builder->bucketsAllocated,
+                entry / FILE_INDEX_BUCKET_SIZE, sizeof(uint64_t), INDEX_ENTRIES_INITIAL_SIZE)) {
+            return false;
+        }
+        builder->buckets[entry / FILE_INDEX_BUCKET_SIZE] = builder->namesUsed;
+    } else {
+        while (shared < length && shared < builder->previousLength
+                && name[shared] == builder->previousName[shared]) {
+            shared++;
+        }
+    }
+
+    // two varints take at most 20 bytes
+    while (builder->namesAllocated - builder->namesUsed < length - shared + 20) {
+        size_t newSize = (builder->namesAllocated == 0) ? INDEX_NAMES_INITIAL_SIZE : builder->namesAllocated * 2;
+        uint8_t *reallocated = realloc(builder->names, newSize);
+        if (reallocated == NULL) {
+            return false;
+        }
+        builder->names = reallocated;
+        builder->namesAllocated = newSize;
+    }
+
+    if (builder->previousAllocated < length + 1) {
+        char *reallocated = realloc(builder->previousName, length + 1);
+        if (reallocated == NULL) {
+            return false;
+        }
+        builder->previousName = reallocated;
+        builder->previousAllocated = length + 1;
+    }
+
+    appendVarint(builder, shared);
+    appendVarint(builder, length - shared);
+    memcpy(builder->names + builder->namesUsed, name + shared, length - shared);
+    builder->namesUsed += length - shared;
+
+    memcpy(builder->previousName, name, length + 1);
+    builder->previousLength = length;
+    builder->maxNameLength = (length > builder->maxNameLength) ? length : builder->maxNameLength;
+    return true;
+}
+
+
+/** \brief Add an entry, the next entry of a directory is set after its subtree
+ *
+ *  @param builder - IndexBuilder structure
+ *  @param name - name of the entry
+ *  @param stats - stats of the element
+ *  @param parent - index of the parent directory
+ *  @param depth - depth of the element
+ *  @param index - index of the new entry is stored here
+ *  @return true on success
+ *          false on memory allocation fail (or too many entries)
+ */
+static bool addIndexEntry(IndexBuilder *builder, const char *name, struct stat *stats,
+        uint32_t parent, size_t depth, uint32_t *index)
+{
+    if (builder->entryCount >= UINT32_MAX - 1) {
+        errno = EOVERFLOW;
+        return false;
+    }
+
+    if (!reserveItems((void **) &builder->entries, &builder->entriesAllocated,
+            builder->entryCount, sizeof(IndexEntry), INDEX_ENTRIES_INITIAL_SIZE)
+            || !appendName(builder, name)) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    *index = (uint32_t) builder->entryCount;
+    IndexEntry *entry = builder->entries + builder->entryCount++;
+    entry->size = (uint64_t) stats->st_size;
+    entry->mtime = (int64_t) stats->st_mtim.tv_sec;
+    entry->mtimeNsec = (uint32_t) stats->st_mtim.tv_nsec;
+    entry->ctime = (int64_t) stats->st_ctim.tv_sec;
+    entry->ctimeNsec = (uint32_t) stats->st_ctim.tv_nsec;
+    entry->parent = parent;
+    entry->next = *index + 1;
+    entry->mode = (uint32_t) stats->st_mode;
+    entry->uid = (uint32_t) stats->st_uid;
+    entry->gid = (uint32_t) stats->st_gid;
+    entry->depth = (uint32_t) depth;
+    entry->flags = 0;
+    entry->reserved = 0;
+
+    builder->maxDepth = (depth > builder->maxDepth) ? depth : builder->maxDepth;
+    return true;
+}
+
+
+// defined below, directories and their elements recurse into each other
+static bool indexDirectory(IndexBuilder *builder, int parentFd, char *name, uint32_t index, uint32_t oldIndex);
+
+
+/** \brief Store one element of a directory, subdirectories are stored with their content
+ *
+ *  @param builder - IndexBuilder structure, path contains path to the element
+ *  @param directoryFd - descriptor of the directory the element is in
+ *  @param name - name of the element
+ *  @param parent - index of the directory's entry
+ *  @param oldIndex - entry of the element in the old index (FILE_INDEX_NO_PARENT if none)
+ *  @return true if successful (elements that can't be stat-ed are skipped)
+ *          false if an allocation error occurred
+ */
+static bool indexElement(IndexBuilder *builder, int directoryFd, char *name, uint32_t parent, uint32_t oldIndex)
+{
+    struct stat buf;
+
+    builder->stats->entries++;
+    builder->stats->statCalls++;
+    if (fstatat(directoryFd, name, &buf, AT_SYMLINK_NOFOLLOW) != 0) {
+        fprintf(stderr, "Stats of \'%s\' couldn't be read (%s).\n", builder->path.path, strerror(errno));
+        return true;
+    }
+
+    // only directories and regular files can be part of a result
+    if (!S_ISDIR(buf.st_mode) && !S_ISREG(buf.st_mode)) {
+        return true;
+    }
+
+    uint32_t child = 0;
+    if (!addIndexEntry(builder, name, &buf, parent, builder->entries[parent].depth + 1, &child)) {
+        fprintf(stderr, "Couldn't store index entry (%s).\n", strerror(errno));
+        return false;
+    }
+
+    if (!S_ISDIR(buf.st_mode)) {
+        return true;
+    }
+
+    // an element that wasn't a directory before has nothing to reuse
+    if (oldIndex != FILE_INDEX_NO_PARENT && !S_ISDIR(builder->old->entries[oldIndex].mode)) {
+        oldIndex = FILE_INDEX_NO_PARENT;
+    }
+
+    bool success = indexDirectory(builder, directoryFd, name, child, oldIndex);
+    builder->entries[child].next = (uint32_t) builder->entryCount;
+    return success;
+}
+
+
+/** \brief Decode the name of an old entry and check that the entry is sane
+ *
+ *  @param builder - IndexBuilder structure with an old index
+ *  @param oldIndex - entry of the old index
+ *  @param end - the entry has to be before this one
+ *  @return true if the name is in oldCursor
+ *          false if the old index is damaged
+ */
+static bool readOldEntry(IndexBuilder *builder, uint32_t oldIndex, uint32_t end)
+{
+    const IndexEntry *entries = builder->old->entries;
+    return oldIndex < end && entries[oldIndex].next > oldIndex && entries[oldIndex].next <= end
+            && seekIndexCursor(&builder->oldCursor, oldIndex);
+}
+
+
+/** \brief Store the elements of an unchanged directory, its listing is taken
+ *  from the old index instead of being read
+ *
+ *  @param builder - IndexBuilder structure, path contains path to the directory
+ *  @param directoryFd - descriptor of the directory
+ *  @param index - index of the directory's entry
+ *  @param oldIndex - entry of the directory in the old index
+ *  @return true if successful
+ *          false if an allocation error occurred or the old index is damaged
+ */
+static bool indexReusedDirectory(IndexBuilder *builder, int directoryFd, uint32_t index, uint32_t oldIndex)
+{
+    const IndexEntry *oldEntries = builder->old->entries;
+    uint32_t end = oldEntries[oldIndex].next;
+    size_t baseLength = builder->path.length;
+    bool success = true;
+
+    for (uint32_t oldChild = oldIndex + 1; success && oldChild < end; oldChild = oldEntries[oldChild].next) {
+        if (!readOldEntry(builder, oldChild, end)) {
+            fprintf(stderr, "The old index is damaged, build a new one.\n");
+            success = false;
+            break;
+        }
+
+        // the name is used before the cursor moves on (the recursion opens it first)
+        char *name = builder->oldCursor.name;
+        truncatePath(&builder->path, baseLength);
+        if (!appendToPath(&builder->path, name)) {
+            fprintf(stderr, "Couldn't allocate file path.\n");
+            success = false;
+            break;
+        }
+
+        success = indexElement(builder, directoryFd, name, index, oldChild);
+    }
+
+    truncatePath(&builder->path, baseLength);
+    return success;
+}
+
+
+/** \brief Read a directory and store its elements, subdirectories are matched
+ *  with the old index (if any) so that their unchanged content can be reused.
+ *  Both listings are in the order of the ordered walk, so they're merged.
+ *
+ *  @param builder - IndexBuilder structure, path contains path to the directory
+ *  @param directoryFd - descriptor of the directory (owned by the function)
+ *  @param index - index of the directory's entry
+ *  @param oldIndex - entry of the directory in the old index (FILE_INDEX_NO_PARENT if none)
+ *  @return true if successful (directories that can't be read are stored empty)
+ *          false if the root can't be read or an allocation error occurred
+ */
+static bool indexListedDirectory(IndexBuilder *builder, int directoryFd, uint32_t index, uint32_t oldIndex)
+{
+    ReadBufferStack *readBuffers = builder->useGetdents ? &builder->readBuffers : NULL;
+    DirectoryReader reader;
+
+    if (!openDirectoryReader(&reader, directoryFd, readBuffers)) {
+        fprintf(stderr, "Directory \'%s\' couldn't be read (%s).\n", builder->path.path, strerror(errno));
+        builder->entries[index].flags |= INDEX_ENTRY_UNREAD;
+        return (builder->entries[index].depth != 0);
+    }
+
+    if (!sortDirectoryEntries(&reader)) {
+        fprintf(stderr, "Couldn't allocate directory entries.\n");
+        closeDirectoryReader(&reader);
+        return false;
+    }
+
+    // next unmatched element of the old listing
+    uint32_t oldChild = (oldIndex == FILE_INDEX_NO_PARENT) ? 0 : oldIndex + 1;
+    uint32_t oldEnd = (oldIndex == FILE_INDEX_NO_PARENT) ? 0 : builder->old->entries[oldIndex].next;
+
+    size_t baseLength = builder->path.length;
+    DirectoryEntry element;
+    bool success = true;
+
+    while (success && readDirectoryEntry(&reader, &element)) {
+        if ((strcmp(element.name, ".") == 0) || (strcmp(element.name, "..") == 0)) {
+            continue;
+        }
+
+        truncatePath(&builder->path, baseLength);
+        if (!appendToPath(&builder->path, element.name)) {
+            fprintf(stderr, "Couldn't allocate file path.\n");
+            success = false;
+            break;
+        }
+
+        // old elements before this one were removed
+        uint32_t match = FILE_INDEX_NO_PARENT;
+        while (oldChild < oldEnd) {
+            if (!readOldEntry(builder, oldChild, oldEnd)) {
+                fprintf(stderr, "The old index is damaged, build a new one.\n");
+                success = false;
+                break;
+            }
+
+            const IndexEntry *old = builder->old->entries + oldChild;
+            DirectoryEntry oldElement = { builder->oldCursor.name, S_ISDIR(old->mode) ? DT_DIR : DT_REG };
+            int order = compareDirectoryEntries(&oldElement, &element);
+            if (order > 0) {
+                break;
+            }
+            if (order == 0) {
+                match = oldChild;
+            }
+            oldChild = old->next;
+        }
+
+        if (success) {
+            success = indexElement(builder, reader.fd, element.name, index, match);
+        }
+    }
+
+    truncatePath(&builder->path, baseLength);
+    closeDirectoryReader(&reader);
+    return success;
+}
+
+
+/** \brief Store the content of a directory (its entry exists already) and
+ *  recurse into its subdirectories. Siblings are sorted like in the ordered walk.
+ *
+ *  @param builder - IndexBuilder structure, path contains path to the directory
+ *  @param parentFd - descriptor of the parent directory (AT_FDCWD for the root)
+ *  @param name - name of the directory within its parent (or the root path)
+ *  @param index - index of the directory's entry
+ *  @param oldIndex - entry of the directory in the old index (FILE_INDEX_NO_PARENT if none)
+ *  @return true if successful (directories that can't be read are stored empty)
+ *          false if the root can't be read or an allocation error occurred
+ */
+static bool indexDirectory(IndexBuilder *builder, int parentFd, char *name, uint32_t index, uint32_t oldIndex)
+{
+    IndexEntry *entry = builder->entries + index;
+    int openFlags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | ((entry->depth == 0) ? 0 : O_NOFOLLOW);
+    int directoryFd = openat(parentFd, name, openFlags);
+
+    if (directoryFd < 0) {
+        fprintf(stderr, "Directory \'%s\' couldn't be read (%s).\n", builder->path.path, strerror(errno));
+        entry->flags |= INDEX_ENTRY_UNREAD;
+        return (entry->depth != 0);
+    }
+
+    builder->stats->directories++;
+
+    // elements are added or removed only together with a change of the times
+    const IndexEntry *old = (oldIndex == FILE_INDEX_NO_PARENT) ? NULL : builder->old->entries + oldIndex;
+    if (old != NULL && (old->flags & INDEX_ENTRY_UNREAD) == 0
+            && old->mtime == entry->mtime && old->mtimeNsec == entry->mtimeNsec
+            && old->ctime == entry->ctime && old->ctimeNsec == entry->ctimeNsec) {
+        builder->stats->directoriesReused++;
+        bool success = indexReusedDirectory(builder, directoryFd, index, oldIndex);
+        close(directoryFd);
+        return success;
+    }
+
+    if (builder->old != NULL) {
+        builder->stats->directoriesRescanned++;
+    }
+    return indexListedDirectory(builder, directoryFd, index, oldIndex);
+}
+
+
+/** \brief Write a part of the file, the position is aligned to 8 bytes first
+ *
+ *  @param file - opened file
+ *  @param position - position in the file (updated)
+ *  @param data - written data
+ *  @param size - size of the data
+ *  @return true if successful
+ */
+static bool writeAligned(FILE *file, uint64_t *position, const void *data, size_t size)
+{
+    static const char padding[8] = { 0 };
+    size_t paddingSize = (8 - *position % 8) % 8;
+
+    if (fwrite(padding, 1, paddingSize, file) != paddingSize
+            || (size > 0 && fwrite(data, 1, size, file) != size)) {
+        return false;
+    }
+
+    *position += paddingSize + size;
+    return true;
+}
+
+
+/** \brief Round a position up to a multiple of 8
+ *
+ *  @param position - position in the file
+ *  @return aligned position
+ */
+static inline uint64_t alignPosition(uint64_t position)
+{
+    return (position + 7) / 8 * 8;
+}
+
+
+/** \brief Write the collected tree into the index file (under a temporary
+ *  name that replaces the file at the end)
+ *
+ *  @param builder - IndexBuilder structure
+ *  @param root - path of the root directory
+ *  @param indexPath - path of the index file
+ *  @return true if successful
+ *          false if the file couldn't be written
+ */
+static bool writeFileIndex(IndexBuilder *builder, char *root, char *indexPath)
+{
+    IndexHeader header;
+    memset(&header, 0, sizeof(IndexHeader));
+    memcpy(header.magic, FILE_INDEX_MAGIC, sizeof(header.magic));
+    header.version = FILE_INDEX_VERSION;
+    header.bucketSize = FILE_INDEX_BUCKET_SIZE;
+    header.entryCount = builder->entryCount;
+    header.maxDepth = builder->maxDepth;
+    header.maxNameLength = builder->maxNameLength;
+    header.buildTime = (int64_t) time(NULL);
+
+    size_t bucketCount = (builder->entryCount + FILE_INDEX_BUCKET_SIZE - 1) / FILE_INDEX_BUCKET_SIZE;
+    header.entriesOffset = alignPosition(sizeof(IndexHeader));
+    header.bucketsOffset = alignPosition(header.entriesOffset + builder->entryCount * sizeof(IndexEntry));
+    header.rootOffset = alignPosition(header.bucketsOffset + bucketCount * sizeof(uint64_t));
+    header.rootLength = strlen(root);
+    header.namesOffset = alignPosition(header.rootOffset + header.rootLength);
+    header.namesSize = builder->namesUsed;
+
+    size_t pathLength = strlen(indexPath);
+    char *temporaryPath = malloc(pathLength + sizeof(".tmp"));
+    if (temporaryPath == NULL) {
+        fprintf(stderr, "Couldn't allocate file path.\n");
+        return false;
+    }
+    memcpy(temporaryPath, indexPath, pathLength);
+    memcpy(temporaryPath + pathLength, ".tmp", sizeof(".tmp"));
+
+    FILE *file = fopen(temporaryPath, "wb");
+    uint64_t position = 0;
+    bool success = (file != NULL)
+            && writeAligned(file, &position, &header, sizeof(IndexHeader))
+            && writeAligned(file, &position, builder->entries, builder->entryCount * sizeof(IndexEntry))
+            && writeAligned(file, &position, builder->buckets, bucketCount * sizeof(uint64_t))
+            && writeAligned(file, &position, root, header.rootLength)
+            && writeAligned(file, &position, builder->names, builder->namesUsed);
+
+    if (file != NULL && fclose(file) != 0) {
+        success = false;
+    }
+
+    if (!success || rename(temporaryPath, indexPath) != 0) {
+        fprintf(stderr, "Couldn't write index file \'%s\' (%s).\n", indexPath, strerror(errno));
+        if (file != NULL) {
+            unlink(temporaryPath);
+        }
+        success = false;
+    }
+
+    free(temporaryPath);
+    return success;
+}
+
+
+/** \brief Walk the tree from the root and write the index, the old index
+ *  is reused if it's given
+ *
+ *  @param root - path of the root directory
+ *  @param indexPath - path of the index file
+ *  @param old - index that's updated (NULL for a new one)
+ *  @param useGetdents - directories are read by getdents64 instead of readdir
+ *  @param stats - counters of the walk are added here
+ *  @return true if successful
+ */
+static bool walkIntoIndex(char *root, char *indexPath, const FileIndex *old, bool useGetdents, RunStatistics *stats)
+{
+    IndexBuilder builder;
+    memset(&builder, 0, sizeof(IndexBuilder));
+    builder.path = initPathBuffer();
+    builder.readBuffers = initReadBufferStack();
+    builder.useGetdents = useGetdents;
+    builder.stats = stats;
+    builder.old = old;
+
+    struct stat buf;
+    uint32_t rootIndex = 0;
+    bool success = false;
+
+    // the root is followed if it's a symbolic link
+    if (stat(root, &buf) != 0 || !S_ISDIR(buf.st_mode)) {
+        fprintf(stderr, "\'%s\' is not a valid directory. Terminating program.\n", root);
+    } else if (old != NULL && !initIndexCursor(&builder.oldCursor, old)) {
+        fprintf(stderr, "The old index is damaged, build a new one.\n");
+        builder.old = NULL;
+    } else if (!setPath(&builder.path, root)
+            || !addIndexEntry(&builder, "", &buf, FILE_INDEX_NO_PARENT, 0, &rootIndex)) {
+        fprintf(stderr, "Program is out of memory. Terminating program.\n");
+    } else if (indexDirectory(&builder, AT_FDCWD, root, rootIndex, (old != NULL) ? 0 : FILE_INDEX_NO_PARENT)) {
+        builder.entries[rootIndex].next = (uint32_t) builder.entryCount;
+        success = writeFileIndex(&builder, root, indexPath);
+    }
+
+    if (builder.old != NULL) {
+        freeIndexCursor(&builder.oldCursor);
+    }
+    free(builder.entries);
+    free(builder.names);
+    free(builder.buckets);
+    free(builder.previousName);
+    freePathBuffer(&builder.path);
+    freeReadBufferStack(&builder.readBuffers);
+    return success;
+}
+
+
+/** \brief Walk the directory tree and write it into an index file
+ *
+ *  @param root - path of the root directory (it's stored resolved)
+ *  @param indexPath - path of the index file
+ *  @param useGetdents - directories are read by getdents64 instead of readdir
+ *  @param stats - counters of the walk are added here
+ *  @return true if successful
+ */
+bool buildFileIndex(char *root, char *indexPath, bool useGetdents, RunStatistics *stats)
+{
+    // the absolute path is stored, so the index can be searched and updated from anywhere
+    char *absoluteRoot = realpath(root, NULL);
+    if (absoluteRoot == NULL) {
+        fprintf(stderr, "\'%s\' is not a valid directory (%s). Terminating program.\n", root, strerror(errno));
+        return false;
+    }
+
+    bool success = walkIntoIndex(absoluteRoot, indexPath, NULL, useGetdents, stats);
+    free(absoluteRoot);
+    return success;
+}
+
+
+/** \brief Refresh an index file, only changed directories are read again
+ *
+ *  @param indexPath - path of the index file (it's replaced)
+ *  @param startDirectory - directory given on the command line (NULL if none)
+ *  @param useGetdents - directories are read by getdents64 instead of readdir
+ *  @param stats - counters of the walk are added here
+ *  @return true if successful
+ */
+bool updateFileIndex(char *indexPath, char *startDirectory, bool useGetdents, RunStatistics *stats)
+{
+    FileIndex old;
+    if (!openFileIndex(&old, indexPath)) {
+        return false;
+    }
+
+    // the old mapping stays readable after the new file replaces it
+    char *root = fileIndexRoot(&old);
+    bool success = false;
+    if (root == NULL) {
+        fprintf(stderr, "Couldn't allocate file path.\n");
+    } else if (fileIndexMatchesRoot(&old, indexPath, startDirectory)) {
+        success = walkIntoIndex(root, indexPath, &old, useGetdents, stats);
+    }
+
+    free(root);
+    closeFileIndex(&old);
+    return success;
+}
+
+
+/** \brief Check that a part of the file lies within it
+ *
+ *  @param index - FileIndex structure (data and size are set)
+ *  @param offset - start of the part
+ *  @param count - number of items
+ *  @param itemSize - size of an item
+ *  @return true if the part is valid
+ */
+static bool validPart(const FileIndex *index, uint64_t offset, uint64_t count, size_t itemSize)
+{
+    return offset <= index->size
+            && (itemSize == 0 || count <= (index->size - offset) / itemSize)
+            && offset % 8 == 0;
+}
+
+
+/** \brief Map an index file into memory and check its header
+ *
+ *  @param index - FileIndex structure that's initialized
+ *  @param indexPath - path of the index file
+ *  @return true if successful
+ */
+bool openFileIndex(FileIndex *index, char *indexPath)
+{
+    memset(index, 0, sizeof(FileIndex));
+
+    int fd = open(indexPath, O_RDONLY | O_CLOEXEC);
+    struct stat buf;
+    if (fd < 0 || fstat(fd, &buf) != 0) {
+        fprintf(stderr, "Index file \'%s\' couldn't be opened (%s).\n", indexPath, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    if ((size_t) buf.st_size < sizeof(IndexHeader)) {
+        fprintf(stderr, "\'%s\' is not an index file.\n", indexPath);
+        close(fd);
+        return false;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void *data = mmap(NULL, (size_t) buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Index file \'%s\' couldn't be mapped (%s).\n", indexPath, strerror(errno));
+        return false;
+    }
+
+    index->data = data;
+    index->size = (size_t) buf.st_size;
+    index->header = data;
+
+    const IndexHeader *header = index->header;
+    uint64_t bucketCount = (header->entryCount + FILE_INDEX_BUCKET_SIZE - 1) / FILE_INDEX_BUCKET_SIZE;
+
+    if (memcmp(header->magic, FILE_INDEX_MAGIC, sizeof(header->magic)) != 0
+            || header->version != FILE_INDEX_VERSION
+            || header->bucketSize != FILE_INDEX_BUCKET_SIZE
+            || header->entryCount == 0 || header->entryCount >= UINT32_MAX
+            || header->maxNameLength > INDEX_MAX_NAME_LENGTH
+            || header->maxDepth >= header->entryCount
+            || !validPart(index, header->entriesOffset, header->entryCount, sizeof(IndexEntry))
+            || !validPart(index, header->bucketsOffset, bucketCount, sizeof(uint64_t))
+            || !validPart(index, header->rootOffset, header->rootLength, 1)
+            || !validPart(index, header->namesOffset, header->namesSize, 1)) {
+        fprintf(stderr, "\'%s\' is not a valid index file (version %d).\n", indexPath, FILE_INDEX_VERSION);
+        closeFileIndex(index);
+        return false;
+    }
+
+    index->entries = (const IndexEntry *) (index->data + header->entriesOffset);
+    index->buckets = (const uint64_t *) (index->data + header->bucketsOffset);
+    index->names = index->data + header->namesOffset;
+
+    // entries and names are mostly read from the start to the end
+    posix_madvise(data, index->size, POSIX_MADV_SEQUENTIAL);
+    return true;
+}
+
+
+/** \brief Unmap the index file
+ *
+ *  @param index - FileIndex structure
+ */
+void closeFileIndex(FileIndex *index)
+{
+    if (index->data != NULL) {
+        munmap((void *) index->data, index->size);
+    }
+    memset(index, 0, sizeof(FileIndex));
+}
+
+
+/** \brief Get the root path of the index as a new string
+ *
+ *  @param index - FileIndex structure
+ *  @return terminated copy of the root path (NULL on allocation fail)
+ */
+char *fileIndexRoot(const FileIndex *index)
+{
+    size_t length = index->header->rootLength;
+    char *root = malloc(length + 1);
+    if (root != NULL) {
+        memcpy(root, index->data + index->header->rootOffset, length);
+        root[length] = '\0';
+    }
+    return root;
+}
+
+
+/** \brief Determine if the index was built for the directory
+ *
+ *  @param index - FileIndex structure
+ *  @param indexPath - path of the index file (for the message)
+ *  @param directory - directory given on the command line (NULL matches any root)
+ *  @return true if the directory is the root of the index
+ */
+bool fileIndexMatchesRoot(const FileIndex *index, char *indexPath, char *directory)
+{
+    if (directory == NULL) {
+        return true;
+    }
+
+    // the root is stored resolved, the directory has to resolve to it
+    const char *root = (const char *) index->data + index->header->rootOffset;
+    size_t rootLength = index->header->rootLength;
+    char *resolved = realpath(directory, NULL);
+    bool matches = (resolved != NULL && strlen(resolved) == rootLength && memcmp(resolved, root, rootLength) == 0);
+
+    if (!matches) {
+        fprintf(stderr, "The index \'%s\' was built for \'%.*s\', not for \'%s\'. Terminating program.\n",
+                indexPath, (int) rootLength, root, directory);
+    }
+    free(resolved);
+    return matches;
+}
+
+
+/** \brief Read a varint from the name table
+ *
+ *  @param cursor - IndexCursor structure, its position is moved after the number
+ *  @param value - the number is stored here
+ *  @return true if successful
+ *          false if the table ends within the number
+ */
+static bool readVarint(IndexCursor *cursor, size_t *value)
+{
+    const uint8_t *names = cursor->index->names;
+    size_t size = cursor->index->header->namesSize;
+    size_t result = 0;
+
+    for (unsigned shift = 0; shift < 64 && cursor->namePosition < size; shift += 7) {
+        uint8_t byte = names[cursor->namePosition++];
+        result |= (size_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** \brief Decode the next name of the table over the current one
+ *
+ *  @param cursor - IndexCursor structure
+ *  @return true if successful
+ *          false if the name is damaged
+ */
+static bool decodeNextName(IndexCursor *cursor)
+{
+    size_t shared = 0;
+    size_t suffix = 0;
+
+    if (!readVarint(cursor, &shared) || !readVarint(cursor, &suffix)
+            || shared > cursor->nameLength
+            || suffix > cursor->index->header->maxNameLength - shared
+            || suffix > cursor->index->header->namesSize - cursor->namePosition) {
+        return false;
+    }
+
+    memcpy(cursor->name + shared, cursor->index->names + cursor->namePosition, suffix);
+    cursor->namePosition += suffix;
+    cursor->nameLength = shared + suffix;
+    cursor->name[cursor->nameLength] = '\0';
+    return true;
+}
+
+
+/** \brief Start reading the index at the root entry
+ *
+ *  @param cursor - IndexCursor structure that's initialized
+ *  @param index - FileIndex structure
+ *  @return true on success
+ *          false on memory allocation fail or if the names are damaged
+ */
+bool initIndexCursor(IndexCursor *cursor, const FileIndex *index)
+{
+    cursor->index = index;
+    cursor->name = malloc(index->header->maxNameLength + 1);
+    cursor->nameLength = 0;
+    cursor->current = 0;
+    cursor->namePosition = 0;
+
+    if (cursor->name == NULL) {
+        return false;
+    }
+
+    // name of the root
+    if (!decodeNextName(cursor)) {
+        freeIndexCursor(cursor);
+        return false;
+    }
+    return true;
+}
+
+
+/** \brief Move the cursor to an entry
+ *
+ *  @param cursor - IndexCursor structure
+ *  @param entry - index of the entry (entryCount moves the cursor to the end)
+ *  @return true if the cursor points at an entry
+ *          false at the end of the index or if the names are damaged
+ */
+bool seekIndexCursor(IndexCursor *cursor, size_t entry)
+{
+    const IndexHeader *header = cursor->index->header;
+
+    if (entry >= header->entryCount) {
+        cursor->current = header->entryCount;
+        return false;
+    }
+
+    // names shortly behind the current one are decoded on, anything else from its bucket
+    size_t decoded = cursor->current;
+    if (entry <= decoded || entry - decoded > FILE_INDEX_BUCKET_SIZE) {
+        decoded = entry - entry % FILE_INDEX_BUCKET_SIZE;
+        cursor->namePosition = cursor->index->buckets[decoded / FILE_INDEX_BUCKET_SIZE];
+        cursor->nameLength = 0;
+        if (!decodeNextName(cursor)) {
+            return false;
+        }
+    }
+
+    while (decoded < entry) {
+        if (!decodeNextName(cursor)) {
+            return false;
+        }
+        decoded++;
+    }
+
+    cursor->current = entry;
+    return true;
+}
+
+
+/** \brief Free memory used by the cursor
+ *
+ *  @param cursor - IndexCursor structure
+ */
+void freeIndexCursor(IndexCursor *cursor)
+{
+    free(cursor->name);
+    cursor->name = NULL;
+}
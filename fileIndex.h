@@ -0,0 +1,208 @@
+#include "directoryReader.h"
+#include "userStructures.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef FILE_INDEX_DEFINED
+#define FILE_INDEX_DEFINED
+
+// version of the file format, files of other versions are refused
+#define FILE_INDEX_VERSION 2
+// names are front coded in buckets of this many entries, the first name
+// of a bucket is stored whole, so that any entry can be decoded quickly
+#define FILE_INDEX_BUCKET_SIZE 16
+// parent of the root entry (and no entry at all)
+#define FILE_INDEX_NO_PARENT UINT32_MAX
+// the directory couldn't be read, it's stored without its content
+#define INDEX_ENTRY_UNREAD 0x1
+
+
+// header at the start of an index file, all offsets are in bytes from the start
+// of the file, numbers are stored in the byte order of the machine that built it
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t bucketSize;
+
+    // number of entries, entry 0 is the root directory
+    uint64_t entryCount;
+    // deepest entry and the longest name (decoding buffers are sized by them)
+    uint64_t maxDepth;
+    uint64_t maxNameLength;
+
+    // absolute path of the root directory, symbolic links resolved (not terminated)
+    uint64_t rootOffset;
+    uint64_t rootLength;
+
+    // array of IndexEntry structures
+    uint64_t entriesOffset;
+    // offset of every bucket within the name table (uint64_t each)
+    uint64_t bucketsOffset;
+    // front coded names: varint shared prefix, varint suffix length, suffix
+    uint64_t namesOffset;
+    uint64_t namesSize;
+
+    // time the index was built (seconds since the epoch)
+    int64_t buildTime;
+} IndexHeader;
+
+
+// one directory or regular file of the tree, entries are stored in the order
+// of the ordered walk (every directory is followed by its subtree, siblings are
+// sorted so that the files come in the order of their paths)
+typedef struct
+{
+    uint64_t size;
+    // times of the last modification and status change, a directory
+    // whose times didn't change is not read again by an update
+    int64_t mtime;
+    int64_t ctime;
+    uint32_t mtimeNsec;
+    uint32_t ctimeNsec;
+
+    // index of the parent directory (FILE_INDEX_NO_PARENT for the root)
+    uint32_t parent;
+    // index of the first entry after the subtree (index + 1 for files)
+    uint32_t next;
+
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+
+    // depth of the entry (0 = root directory)
+    uint32_t depth;
+    // INDEX_ENTRY_* flags
+    uint32_t flags;
+    uint32_t reserved;
+} IndexEntry;
+
+
+// index file mapped into memory, nothing is copied out of it
+typedef struct
+{
+    // the whole file
+    const uint8_t *data;
+    size_t size;
+
+    const IndexHeader *header;
+    const IndexEntry *entries;
+    const uint64_t *buckets;
+    const uint8_t *names;
+} FileIndex;
+
+
+// sequential reader of the index, names are decoded incrementally
+typedef struct
+{
+    const FileIndex *index;
+    // entry the cursor points at (entryCount at the end)
+    size_t current;
+    // position of the next front coded name
+    size_t namePosition;
+    // name of the current entry (maxNameLength + 1 bytes)
+    char *name;
+    size_t nameLength;
+} IndexCursor;
+
+
+/** \brief Walk the directory tree and write it into an index file. Directories
+ *  and regular files are stored, symbolic links are not followed (except for the
+ *  root). The file is written under a temporary name and renamed at the end,
+ *  so a reader never sees an unfinished index. The root is stored as an absolute
+ *  path, results of the index are printed under it.
+ *
+ *  @param root - path of the root directory
+ *  @param indexPath - path of the index file
+ *  @param useGetdents - directories are read by getdents64 instead of readdir
+ *  @param stats - counters of the walk are added here
+ *  @return true if successful
+ *          false if the root couldn't be read, the file couldn't be written
+ *          or an allocation error occurred (a message is printed)
+ */
+bool buildFileIndex(char *root, char *indexPath, bool useGetdents, RunStatistics *stats);
+
+
+/** \brief Refresh an index file. Every directory is stat-ed, only directories
+ *  whose mtime or ctime changed are read again, the listings of the others are
+ *  taken from the old index. Elements are always stat-ed (the times of a directory
+ *  don't change when its files do), so the new index is the same as one built
+ *  by buildFileIndex.
+ *
+ *  @param indexPath - path of the index file (it's replaced)
+ *  @param startDirectory - directory given on the command line (NULL if none),
+ *                          it has to be the root of the index
+ *  @param useGetdents - directories are read by getdents64 instead of readdir
+ *  @param stats - counters of the walk are added here (with re-scanned and reused directories)
+ *  @return true if successful
+ *          false if the index or the root couldn't be read, the file couldn't
+ *          be written or an allocation error occurred (a message is printed)
+ */
+bool updateFileIndex(char *indexPath, char *startDirectory, bool useGetdents, RunStatistics *stats);
+
+
+/** \brief Map an index file into memory and check its header
+ *
+ *  @param index - FileIndex structure that's initialized
+ *  @param indexPath - path of the index file
+ *  @return true if successful
+ *          false if the file can't be mapped or it's not a valid index
+ *          (a message is printed)
+ */
+bool openFileIndex(FileIndex *index, char *indexPath);
+
+
+/** \brief Unmap the index file
+ *
+ *  @param index - FileIndex structure
+ */
+void closeFileIndex(FileIndex *index);
+
+
+/** \brief Get the root path of the index as a new string
+ *
+ *  @param index - FileIndex structure
+ *  @return terminated copy of the root path (NULL on allocation fail)
+ */
+char *fileIndexRoot(const FileIndex *index);
+
+
+/** \brief Determine if the index was built for the directory, prints a message if not
+ *
+ *  @param index - FileIndex structure
+ *  @param indexPath - path of the index file (for the message)
+ *  @param directory - directory given on the command line (NULL matches any root)
+ *  @return true if the directory resolves to the root of the index
+ */
+bool fileIndexMatchesRoot(const FileIndex *index, char *indexPath, char *directory);
+
+
+/** \brief Start reading the index at the root entry
+ *
+ *  @param cursor - IndexCursor structure that's initialized
+ *  @param index - FileIndex structure
+ *  @return true on success
+ *          false on memory allocation fail or if the names are damaged
+ */
+bool initIndexCursor(IndexCursor *cursor, const FileIndex *index);
+
+
+/** \brief Move the cursor to an entry, skipping the subtree is done by moving to
+ *  its next entry. The name is decoded from the start of the bucket if needed.
+ *
+ *  @param cursor - IndexCursor structure
+ *  @param entry - index of the entry (entryCount moves the cursor to the end)
+ *  @return true if the cursor points at an entry
+ *          false at the end of the index or if the names are damaged
+ */
+bool seekIndexCursor(IndexCursor *cursor, size_t entry);
+
+
+/** \brief Free memory used by the cursor
+ *
+ *  @param cursor - IndexCursor structure
+ */
+void freeIndexCursor(IndexCursor *cursor);
+
+#endif
@@ -0,0 +1,163 @@
+#include "filterPipeline.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// number of files checked by a stage before its steps are reordered (adaptive mode)
+const size_t FILTER_REORDER_INTERVAL = 4096;
+
+
+/** \brief Return an empty FilterPipeline structure
+ *
+ *  @param adaptive - reorder the steps at runtime by their rejection rates
+ *  @return new FilterPipeline structure
+ */
+FilterPipeline initFilterPipeline(bool adaptive)
+{
+    FilterPipeline pipeline;
+    memset(&pipeline, 0, sizeof(FilterPipeline));
+    pipeline.adaptive = adaptive;
+    return pipeline;
+}
+
+
+/** \brief Insert a predicate into a stage, the steps are kept sorted by cost
+ *  (steps with the same cost keep the order they were added in)
+ *
+ *  @param pipeline - FilterPipeline structure
+ *  @param stage - stage the predicate belongs to
+ *  @param check - the predicate
+ *  @param label - name of the predicate shown in statistics
+ *  @param cost - estimated cost of one evaluation
+ *  @param data - compiled argument of the predicate (pointer)
+ *  @param value - compiled argument of the predicate (number)
+ *  @return true on success
+ *          false if the stage is full
+ */
+bool addFilterStep(FilterPipeline *pipeline,
+        FilterStage stage,
+        FilterCheck check,
+        const char *label,
+        unsigned int cost,
+        const void *data,
+        unsigned long value)
+{
+    FilterStep *steps = pipeline->steps[stage];
+    size_t count = pipeline->count[stage];
+
+    if (count == FILTER_MAX_STEPS) {
+        return false;
+    }
+
+    // find the place of the step and move the more expensive ones
+    size_t position = count;
+    while (position > 0 && steps[position - 1].cost > cost) {
+        steps[position] = steps[position - 1];
+        position--;
+    }
+
+    FilterStep step = { check, label, cost, data, value, 0, 0 };
+    steps[position] = step;
+    pipeline->count[stage]++;
+    return true;
+}
+
+
+/** \brief Determine if step a should be evaluated before step b, the step
+ *  with higher rejection rate per unit of cost goes first
+ *
+ *  @param a - FilterStep structure
+ *  @param b - FilterStep structure
+ *  @return true if a should go first
+ */
+static bool goesFirst(const FilterStep *a, const FilterStep *b)
+{
+    // rejectedA / (checkedA * costA) > rejectedB / (checkedB * costB)
+    double checkedA = (double) (a->passed + a->rejected) * a->cost;
+    double checkedB = (double) (b->passed + b->rejected) * b->cost;
+
+    if (checkedA == 0 || checkedB == 0) {
+        return false;
+    }
+
+    return (a->rejected * checkedB > b->rejected * checkedA);
+}
+
+
+/** \brief Reorder steps of a stage by their observed rejection rates,
+ *  all predicates are independent so the result doesn't change
+ *
+ *  @param pipeline - FilterPipeline structure
+ *  @param stage - stage that's reordered
+ */
+static void reorderStage(FilterPipeline *pipeline, FilterStage stage)
+{
+    FilterStep *steps = pipeline->steps[stage];
+
+    // insertion sort, there's only a few steps
+    for (size_t i = 1; i < pipeline->count[stage]; i++) {
+        FilterStep step = steps[i];
+        size_t position = i;
+        while (position > 0 && goesFirst(&step, steps + position - 1)) {
+            steps[position] = steps[position - 1];
+            position--;
+        }
+        steps[position] = step;
+    }
+
+    pipeline->sinceReorder[stage] = 0;
+}
+
+
+/** \brief Evaluate predicates of a stage in their current order
+ *
+ *  @param pipeline - FilterPipeline structure
+ *  @param stage - stage that's evaluated
+ *  @param candidate - file that's checked
+ *  @return true if the file passed every predicate of the stage
+ *          false as soon as one predicate rejects it
+ */
+bool runFilterStage(FilterPipeline *pipeline, FilterStage stage, const FilterCandidate *candidate)
+{
+    size_t count = pipeline->count[stage];
+    FilterStep *steps = pipeline->steps[stage];
+
+    if (pipeline->adaptive && ++pipeline->sinceReorder[stage] >= FILTER_REORDER_INTERVAL) {
+        reorderStage(pipeline, stage);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!steps[i].check(steps + i, candidate)) {
+            steps[i].rejected++;
+            return false;
+        }
+        steps[i].passed++;
+    }
+
+    return true;
+}
+
+
+/** \brief Add counters of src to dest, steps are matched by their labels
+ *  because the adaptive mode may have reordered them differently
+ *
+ *  @param dest - FilterPipeline structure
+ *  @param src - FilterPipeline structure compiled from the same arguments
+ */
+void mergeFilterPipeline(FilterPipeline *dest, FilterPipeline *src)
+{
+    for (int stage = 0; stage < FILTER_STAGE_COUNT; stage++) {
+        for (size_t i = 0; i < src->count[stage]; i++) {
+            FilterStep *srcStep = src->steps[stage] + i;
+
+            for (size_t j = 0; j < dest->count[stage]; j++) {
+                FilterStep *destStep = dest->steps[stage] + j;
+                if (strcmp(destStep->label, srcStep->label) == 0) {
+                    destStep->passed += srcStep->passed;
+                    destStep->rejected += srcStep->rejected;
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#ifndef FILTER_PIPELINE_DEFINED
+#define FILTER_PIPELINE_DEFINED
+
+// maximum number of predicates within one stage
+#define FILTER_MAX_STEPS 8
+
+
+// stages of the pipeline, the name stage runs before the file is stat-ed
+typedef enum
+{
+    FILTER_STAGE_NAME,
+    FILTER_STAGE_STAT,
+    FILTER_STAGE_COUNT
+} FilterStage;
+
+
+// file that's being checked by the pipeline
+typedef struct
+{
+    // name of the file (without path)
+    char *name;
+    // recursive depth of the file
+    size_t depth;
+    // stats of the file, only valid in the stat stage
+    struct stat *stats;
+} FilterCandidate;
+
+
+typedef struct FilterStep FilterStep;
+
+
+// predicate of one step, returns true if the file passes
+typedef bool (*FilterCheck)(const FilterStep *step, const FilterCandidate *candidate);
+
+
+// one enabled predicate with its compiled argument and counters
+struct FilterStep
+{
+    FilterCheck check;
+    // name of the predicate shown in statistics
+    const char *label;
+    // estimated cost of one evaluation, cheaper steps go first
+    unsigned int cost;
+
+    // compiled argument of the predicate
+    const void *data;
+    unsigned long value;
+
+    // number of files that passed / were rejected by this step
+    size_t passed;
+    size_t rejected;
+};
+
+
+// enabled predicates of all stages, every thread works with its own copy
+typedef struct
+{
+    FilterStep steps[FILTER_STAGE_COUNT][FILTER_MAX_STEPS];
+    size_t count[FILTER_STAGE_COUNT];
+
+    // reorder steps by observed rejection rates
+    bool adaptive;
+    // files checked since the stage was reordered last time
+    size_t sinceReorder[FILTER_STAGE_COUNT];
+} FilterPipeline;
+
+
+/** \brief Create an empty pipeline (every file passes)
+ *
+ *  @param adaptive - reorder the steps at runtime by their rejection rates
+ *  @return new FilterPipeline structure
+ */
+FilterPipeline initFilterPipeline(bool adaptive);
+
+
+/** \brief Add a predicate into a stage, steps of the stage stay ordered by cost
+ *
+ *  @param pipeline - FilterPipeline structure
+ *  @param stage - stage the predicate belongs to
+ *  @param check - the predicate
+ *  @param label - name of the predicate shown in statistics
+ *  @param cost - estimated cost of one evaluation
+ *  @param data - compiled argument of the predicate (pointer)
+ *  @param value - compiled argument of the predicate (number)
+ *  @return true on success
+ *          false if the stage is full
+ */
+bool addFilterStep(FilterPipeline *pipeline,
+        FilterStage stage,
+        FilterCheck check,
+        const char *label,
+        unsigned int cost,
+        const void *data,
+        unsigned long value);
+
+
+/** \brief Run all predicates of a stage, stop at the first one that rejects the file
+ *
+ *  @param pipeline - FilterPipeline structure (its counters are updated)
+ *  @param stage - stage that's evaluated
+ *  @param candidate - file that's checked
+ *  @return true if the file passed every predicate of the stage
+ */
+bool runFilterStage(FilterPipeline *pipeline, FilterStage stage, const FilterCandidate *candidate);
+
+
+/** \brief Add counters of src to the matching steps of dest
+ *
+ *  @param dest - FilterPipeline structure
+ *  @param src - FilterPipeline structure compiled from the same arguments
+ */
+void mergeFilterPipeline(FilterPipeline *dest, FilterPipeline *src);
+
+#endif
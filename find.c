@@ -1,13 +1,25 @@
 #include "find.h"
-#include <ctype.h>
+#include "fileIndex.h"
+#include "resultSort.h"
+#include "threadPool.h"
 #include <dirent.h>
 #include <errno.h>
-#include <pwd.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+// function called for every subdirectory found in scanDirectory,
+// path contains the path to the subdirectory when it's called
+typedef bool (*DirectoryHandler)(TraversalState *state,
+        int parentFd,
+        char *name,
+        size_t depth,
+        void *handlerData);
+
 
 /** \brief Print a problem that could have occurred within a directory
  * 
@@ -35,6 +47,9 @@ static void printDirectoryProblem(char *baseDirectory)
     case ENOTDIR:
         fprintf(stderr, "\'%s\' is not a valid directory. Terminating program.\n", baseDirectory);
         break;
+    case ENAMETOOLONG:
+        fprintf(stderr, "Path of the directory \'%s\' is too long.\n", baseDirectory);
+        break;
     }
 }
 
@@ -74,6 +89,139 @@ static void printFileProblem()
 }
 
 
+/** \brief Determine which of two slow directories goes first (the slower one)
+ *
+ *  @param slowOne - pointer to the first SlowDirectory
+ *  @param slowTwo - pointer to the second SlowDirectory
+ *  @return negative num if slowOne goes first, positive num if it goes second
+ */
+static int compareSlowDirectories(const void *slowOne, const void *slowTwo)
+{
+    uint64_t one = ((const SlowDirectory *) slowOne)->time;
+    uint64_t two = ((const SlowDirectory *) slowTwo)->time;
+    return (one < two) - (one > two);
+}
+
+
+/** \brief Print statistics of the run on stderr as one JSON object
+ *
+ *  @param state - TraversalState structure of the run
+ *  @param slowest - the slowest directories (sorted)
+ */
+static void printStatisticsJson(TraversalState *state, SlowDirectory *slowest)
+{
+    RunStatistics *stats = &state->stats;
+    FilterPipeline *pipeline = &state->filters;
+
+    fprintf(stderr, "{\"directories\": %zu, \"directories_pruned\": %zu, \"directories_rescanned\": %zu, "
+            "\"directories_reused\": %zu, \"entries\": %zu, \"stat_calls\": %zu, \"stats_avoided\": %zu, "
+            "\"stat_batches\": %zu, \"matches\": %zu, \"result_capacity\": %zu, \"result_path_bytes\": %zu, "
+            "\"result_path_allocated_bytes\": %zu, \"time_to_first_result\": %.6f,\n",
+            stats->directories, stats->directoriesPruned, stats->directoriesRescanned, stats->directoriesReused,
+            stats->entries, stats->statCalls, stats->statsAvoided, stats->statBatches, stats->matches,
+            state->results.arrayAllocatedSize, state->results.pathBytes, resultPathAllocatedBytes(&state->results),
+            stats->firstResultTime / 1e9);
+    fprintf(stderr, " \"phases\": {\"search\": %.6f, \"directories\": %.6f, \"stat\": %.6f, "
+            "\"sort\": %.6f, \"output\": %.6f},\n",
+            stats->searchTime / 1e9, stats->directoryTime / 1e9, stats->statTime / 1e9,
+            stats->sortTime / 1e9, stats->outputTime / 1e9);
+
+    // bucket i counts times under 2^i microseconds
+    fprintf(stderr, " \"directory_histogram_us\": [");
+    for (size_t i = 0; i < DIRECTORY_HISTOGRAM_BUCKETS; i++) {
+        fprintf(stderr, (i > 0) ? ", %zu" : "%zu", stats->directoryHistogram[i]);
+    }
+    fprintf(stderr, "],\n \"slowest_directories\": [");
+    for (size_t i = 0; i < stats->slowestCount; i++) {
+        fprintf(stderr, (i > 0) ? ", {\"path\": " : "{\"path\": ");
+        writeJsonString(stderr, slowest[i].path);
+        fprintf(stderr, ", \"time\": %.6f}", slowest[i].time / 1e9);
+    }
+
+    fprintf(stderr, "],\n \"filters\": [");
+    bool first = true;
+    for (int stage = 0; stage < FILTER_STAGE_COUNT; stage++) {
+        for (size_t i = 0; i < pipeline->count[stage]; i++) {
+            FilterStep *step = pipeline->steps[stage] + i;
+            fprintf(stderr, first ? "{\"name\": " : ", {\"name\": ");
+            writeJsonString(stderr, step->label);
+            fprintf(stderr, ", \"passed\": %zu, \"rejected\": %zu}", step->passed, step->rejected);
+            first = false;
+        }
+    }
+    fprintf(stderr, "]}\n");
+}
+
+
+/** \brief Print statistics of the run on stderr: counters, times of the phases,
+ *  histogram of directory times, the slowest directories and counters
+ *  of the enabled filters (in their final order)
+ *
+ *  @param pArgs - ParsedArguments structure
+ *  @param state - TraversalState structure of the run
+ */
+static void printStatistics(ParsedArguments *pArgs, TraversalState *state)
+{
+    RunStatistics *stats = &state->stats;
+    FilterPipeline *pipeline = &state->filters;
+
+    SlowDirectory slowest[SLOWEST_DIRECTORIES];
+    memcpy(slowest, stats->slowestDirectories, stats->slowestCount * sizeof(SlowDirectory));
+    qsort(slowest, stats->slowestCount, sizeof(SlowDirectory), compareSlowDirectories);
+
+    if (pArgs->statisticsJson) {
+        printStatisticsJson(state, slowest);
+        return;
+    }
+
+    fprintf(stderr, "directories: %zu\n", stats->directories);
+    fprintf(stderr, "directories pruned: %zu\n", stats->directoriesPruned);
+    if (stats->directoriesRescanned + stats->directoriesReused > 0) {
+        fprintf(stderr, "directories re-scanned: %zu\n", stats->directoriesRescanned);
+        fprintf(stderr, "directories reused: %zu\n", stats->directoriesReused);
+    }
+    fprintf(stderr, "entries: %zu\n", stats->entries);
+    fprintf(stderr, "stat calls: %zu\n", stats->statCalls);
+    fprintf(stderr, "stats avoided: %zu\n", stats->statsAvoided);
+    fprintf(stderr, "stat batches: %zu\n", stats->statBatches);
+    fprintf(stderr, "matches: %zu\n", stats->matches);
+    fprintf(stderr, "result capacity: %zu\n", state->results.arrayAllocatedSize);
+    fprintf(stderr, "result path storage: %zu bytes (%zu allocated)\n", state->results.pathBytes,
+            resultPathAllocatedBytes(&state->results));
+    fprintf(stderr, "time to first result: %.6f s\n", stats->firstResultTime / 1e9);
+
+    // directory and stat times are sums over all threads
+    fprintf(stderr, "time of the search: %.6f s\n", stats->searchTime / 1e9);
+    fprintf(stderr, "time in directories: %.6f s\n", stats->directoryTime / 1e9);
+    fprintf(stderr, "time in stat calls: %.6f s\n", stats->statTime / 1e9);
+    fprintf(stderr, "time of sorting: %.6f s\n", stats->sortTime / 1e9);
+    fprintf(stderr, "time of output: %.6f s\n", stats->outputTime / 1e9);
+
+    for (size_t i = 0; i < DIRECTORY_HISTOGRAM_BUCKETS; i++) {
+        if (stats->directoryHistogram[i] == 0) {
+            continue;
+        }
+        if (i < DIRECTORY_HISTOGRAM_BUCKETS - 1) {
+            fprintf(stderr, "directories under %lu us: %zu\n", 1ul << i, stats->directoryHistogram[i]);
+        } else {
+            fprintf(stderr, "directories over %lu us: %zu\n", 1ul << (i - 1), stats->directoryHistogram[i]);
+        }
+    }
+
+    for (size_t i = 0; i < stats->slowestCount; i++) {
+        fprintf(stderr, "slow directory: %.6f s %s\n", slowest[i].time / 1e9, slowest[i].path);
+    }
+
+    for (int stage = 0; stage < FILTER_STAGE_COUNT; stage++) {
+        for (size_t i = 0; i < pipeline->count[stage]; i++) {
+            FilterStep *step = pipeline->steps[stage] + i;
+            fprintf(stderr, "filter %s: %zu passed, %zu rejected\n",
+                    step->label, step->passed, step->rejected);
+        }
+    }
+}
+
+
 /** \brief Print help if "-h" opt occurs within arguments
  *
  */
@@ -81,40 +229,76 @@ static void printHelp()
 {
     fprintf(stderr, "This program is a utility that finds files within a "
                     "POSIX compliant operating system.\nThe utility accepts these arguments:\n"
-                    "    -n NAME -> Specify substring contained in the file name the utility will look for.\n"
-                    "    -s s|f -> Set sorting the results by filename (f),"
-                    " by file size (s). If the option is not set, files are sorted by their paths lexically.\n"
-                    "    -u USER -> Only show files that are owned by USER.\n"
+                    "    -n NAME -> Specify substring contained in the file name the utility will look for."
+                    " Can be repeated, files containing any of the substrings are shown.\n"
+                    "    -N FILE -> Read substrings for \"-n\" from FILE, one per line.\n"
+                    "    -G GLOB -> Only show files which whole name matches GLOB (*, ?, [...]).\n"
+                    "    -r REGEX -> Only show files which name matches extended regular expression REGEX"
+                    " (., [...], *, +, ?, {m,n}, |, (...), anchored by ^ and $).\n"
+                    "    -i -> Ignore case of letters in GLOB and REGEX.\n"
+                    "    -l -> Print the substring that matched after every path (separated by a tab).\n"
+                    "    -s s|f|none -> Set sorting the results by their paths (f, byte order) or"
+                    " by file size (s, largest first). If the option is not set, files are sorted by"
+                    " their names (case insensitive).\n"
+                    "        With 'none' the results are not sorted, they are printed as soon as they are found.\n"
+                    "    -o -> Print the results sorted by path (the order of '-s f', not the default order"
+                    " by name) while the directories are walked"
+                    " in that order, without holding them in memory. Can't be combined with -j or with"
+                    " several start directories.\n"
+                    "    -k NUM -> Only show the first NUM files of the order (e.g. the NUM largest files with"
+                    " '-s s'), at most NUM paths are held in memory.\n"
+                    "    -u USER -> Only show files that are owned by USER (name or uid)."
+                    " Can be repeated or given as a comma separated list.\n"
+                    "    -g GROUP -> Only show files that belong to GROUP (name or gid)."
+                    " Can be repeated or given as a comma separated list.\n"
                     "    -m MASK -> Show files with desired file permissions.\n"
                     "    -f NUM -> Show files that in at least NUM level of directory (path) depth.\n"
                     "    -t NUM -> Show files that in maximum NUM level of directory (path) depth.\n"
-                    "    -a -> Show all files, include hidden ones.\n"
-                    "    -0 -> Set terminating character to be 'nullchar' (binary 0) instead of 'newline'.\n"
+                    "    -p NAME -> Don't search directories called NAME. Can be repeated.\n"
+                    "    -x PATH -> Don't search the directory PATH (as it would be printed). Can be repeated.\n"
+                    "    -a -> Show all files, include hidden ones.\n");
+    // the text is split, C99 compilers only have to support strings up to 4095 bytes
+    fprintf(stderr, "    -b FILE -> Don't search, store the tree of the directory (names, sizes, permissions,"
+                    " owners, times) into index FILE, its absolute path is stored.\n"
+                    "    -q FILE -> Search index FILE built by '-b' instead of the filesystem,"
+                    " all options apply to it, paths are printed under the stored root.\n"
+                    "    -w -> Keep watching the directory after the search (inotify, Linux only), print"
+                    " '+ PATH' for every new result and '- PATH' for every removed one.\n"
+                    "    -U FILE -> Refresh index FILE, only directories whose times changed are read again,"
+                    " prints how many directories were re-scanned and reused (to stderr).\n"
+                    "    -j NUM -> Search the filesystem with NUM threads (1 = serial traversal, default),"
+                    " base directories are dealt to the threads.\n"
+                    "    -d readdir|getdents -> Read directories with readdir or with getdents64"
+                    " (Linux only, default when compiled in).\n"
+                    "    -I -> Request file stats in batches through io_uring (Linux only,"
+                    " falls back to stat calls when io_uring is not available).\n"
+                    "    -S -> Print statistics of the run on stderr (counters, times of the phases,"
+                    " histogram of directory times, the slowest directories).\n"
+                    "    -J -> Print the statistics of '-S' as JSON.\n"
+                    "    -T FILE -> Write a trace of the run (directories, stat batches, sorting, output"
+                    " of every thread) into FILE in the Chrome trace event format.\n"
+                    "    -A -> Reorder the file checks at runtime by how many files they reject.\n"
+                    "    -F lines|nul|netstring|json -> Format of the results: one per line (default),"
+                    " terminated by a nul char (like '-0'), as netstrings (LENGTH:PATH,) or as JSON lines"
+                    " with path, size, mode and uid (bytes of paths that aren't UTF-8 are written as \\u00XX).\n"
+                    "    -0 -> Set terminating character to be 'nullchar' (binary 0) instead of 'newline'"
+                    " (only with '-F lines').\n"
                     "    -h -> Print help on the screen and ends the program.\n"
-                    "If there's a non opt argument, it's treated as a path to base directory. Only the first occurrence counts.\n");
+                    "Non opt arguments are treated as paths to base directories, all of them are searched"
+                    " (concurrently with '-j') and their results are sorted together. A directory given twice"
+                    " is searched once, a directory under another one is searched with its own depth and"
+                    " rules and the other one's search skips it.\n");
 }
 
 
-/** \brief Parse file permissions from file stats
+/** \brief Convert (decimal) int representation of a mask into permission bits
  * 
- *  @param statPtr pointer to stat structure
- *  @return (decimal) int representation of a mask
+ *  @param mask - mask from the arguments, e.g. 755
+ *  @return permission bits, e.g. 0755
  */
-static int getMask(struct stat *statPtr)
+static unsigned long compileMask(int mask)
 {
-    int mask = 0;
-    // the idea for shortening the code borrowed from:
-    // http://codewiki.wikidot.com/c:system-calls:stat
-    (statPtr->st_mode & S_IRUSR) ? (mask += 400) : (mask += 0);
-    (statPtr->st_mode & S_IWUSR) ? (mask += 200) : (mask += 0);
-    (statPtr->st_mode & S_IXUSR) ? (mask += 100) : (mask += 0);
-    (statPtr->st_mode & S_IRGRP) ? (mask += 40) : (mask += 0);
-    (statPtr->st_mode & S_IWGRP) ? (mask += 20) : (mask += 0);
-    (statPtr->st_mode & S_IXGRP) ? (mask += 10) : (mask += 0);
-    (statPtr->st_mode & S_IROTH) ? (mask += 4) : (mask += 0);
-    (statPtr->st_mode & S_IWOTH) ? (mask += 2) : (mask += 0);
-    (statPtr->st_mode & S_IXOTH) ? (mask += 1) : (mask += 0);
-    return mask;
+    return (unsigned long) ((((mask / 100) % 10) << 6) | (((mask / 10) % 10) << 3) | (mask % 10));
 }
 
 
@@ -130,188 +314,593 @@ static inline bool isHidden(char *fileName)
 }
 
 
-/** \brief If "-n" opt occurs in arguments, check if the desired
- *  substring is present in the name of the file 
+/** \brief Filter of the "-n" opt, check if one of the desired
+ *  substrings is present in the name of the file 
  * 
- *  @param pArgs - ParsedArguments structure
- *  @param fileName - name of the file (correct string)
- *  @return -true if the "-n" opt occurred in the arguments and desired
- *           substring is present within fileName, OR true if "-n" is not present
- *          -false only when "-n" is present and desired substring is not 
+ *  @param step - FilterStep, data contains PatternSet of the substrings
+ *  @param candidate - checked file
+ *  @return true if any desired substring is present within the file name
  */
-static bool checkName(ParsedArguments *pArgs, char *fileName)
+static bool filterName(const FilterStep *step, const FilterCandidate *candidate)
 {
-    // if the name checking is desired it checks the name
-    if (pArgs->setName) {
-        if (strstr(fileName, pArgs->nameArg) == NULL) {
-            return false;
-        }
-    }
+    return (findPattern(step->data, candidate->name) != NO_PATTERN);
+}
 
-    // otherwise the file is suitable whatever its name is
-    return true;
+
+/** \brief Filter of the "-G" and "-r" opts, check if the name of the file
+ *  matches the glob / regular expression
+ * 
+ *  @param step - FilterStep, data contains the compiled NamePattern
+ *  @param candidate - checked file
+ *  @return true if the name matches
+ */
+static bool filterNamePattern(const FilterStep *step, const FilterCandidate *candidate)
+{
+    return matchNamePattern(step->data, candidate->name);
 }
 
 
-/** \brief If "-m" opt occurs in arguments, check if the file has
- *  desired permissions
+/** \brief Filter of the "-m" opt, check if the file has desired permissions
  * 
- *  @param pArgs - ParsedArguments structure
- *  @param permissions - file permissions (obtained by calling getMask() function)
- *  @return -true if the "-m" opt occurred in the arguments and file has 
- *           desired permission OR true if "-m" is not present
- *          -false only when permissions don't match 
+ *  @param step - FilterStep, value contains the permission bits
+ *  @param candidate - checked file (with stats)
+ *  @return true if the file has exactly the desired permissions
  */
-static bool checkPermissions(ParsedArguments *pArgs, int permissions)
+static bool filterMask(const FilterStep *step, const FilterCandidate *candidate)
 {
-    // if mask checking is set to true it checks the mask
-    if (pArgs->setMask) {
-        return (permissions == pArgs->mask);
-    }
+    return ((candidate->stats->st_mode & (S_IRWXU | S_IRWXG | S_IRWXO)) == step->value);
+}
 
-    // otherwise the file is suitable whatever its mask is
-    return true;
+
+/** \brief Filter of the "-u" opt, check if the file
+ *  is owned by one of our desired owners. 
+ * 
+ *  @param step - FilterStep, data contains IdSet of the users
+ *  @param candidate - checked file (with stats)
+ *  @return true if the file is owned by one of the users
+ */
+static bool filterUser(const FilterStep *step, const FilterCandidate *candidate)
+{
+    // ids were resolved while parsing arguments
+    return idSetContains((IdSet *) step->data, candidate->stats->st_uid);
+}
+
+
+/** \brief Filter of the "-g" opt, check if the file
+ *  is owned by one of our desired groups.
+ * 
+ *  @param step - FilterStep, data contains IdSet of the groups
+ *  @param candidate - checked file (with stats)
+ *  @return true if the file belongs to one of the groups
+ */
+static bool filterGroup(const FilterStep *step, const FilterCandidate *candidate)
+{
+    return idSetContains((IdSet *) step->data, candidate->stats->st_gid);
+}
+
+
+/** \brief Filter of the "-f" opt, check if the desired
+ *  recursive directory depth occurs
+ * 
+ *  @param step - FilterStep, value contains the minimal depth
+ *  @param candidate - checked file
+ *  @return true if minimal depth is reached
+ */
+static bool filterMinDepth(const FilterStep *step, const FilterCandidate *candidate)
+{
+    return (step->value <= candidate->depth);
 }
 
-/** \brief If "-u" opt occurs in arguments, check if the file
- *  is owned by our desired owner. 
+
+/** \brief Filter of the "-t" opt, check if the maximal
+ *  recursive directory depth is not surpassed
  * 
+ *  @param step - FilterStep, value contains the maximal depth
+ *  @param candidate - checked file
+ *  @return true if maximal depth is not surpassed
+ */
+static bool filterMaxDepth(const FilterStep *step, const FilterCandidate *candidate)
+{
+    return (candidate->depth <= step->value);
+}
+
+
+/** \brief Filter used without the "-a" opt, check if the current file
+ *  is not hidden
+ * 
+ *  @param step - FilterStep (unused)
+ *  @param candidate - checked file
+ *  @return true if the file is NOT hidden
+ */
+static bool filterHidden(const FilterStep *step, const FilterCandidate *candidate)
+{
+    (void) step;
+    return (!isHidden(candidate->name));
+}
+
+
+/** \brief Find out which fields of struct stat the enabled checks need
+ *
  *  @param pArgs - ParsedArguments structure
- *  @param statPtr - stat structure
- *  @return -true if the "-u" opt occurred in the arguments and file is owned
- *           by our desired owner, OR true if "-u" is not present
- *          -false only when "-u" is present and file's owner differs 
+ *  @return combination of STAT_FIELD_* flags (0 if no stat is needed)
  */
-static bool checkUser(ParsedArguments *pArgs, struct stat *statPtr)
+static uint8_t requiredStatFields(ParsedArguments *pArgs)
 {
-    struct passwd *pwd = NULL;
-    errno = 0;
+    uint8_t fields = 0;
 
-    // checking for user set.
+    // "-m" compares permissions
+    if (pArgs->setMask) {
+        fields |= STAT_FIELD_MODE;
+    }
+
+    // "-u" compares owners
     if (pArgs->setUser) {
-        pwd = getpwnam(pArgs->usernameArg);
-        // compare user id's
-        return (pwd->pw_uid == statPtr->st_uid);
+        fields |= STAT_FIELD_UID;
     }
 
-    // not searching for user, file suitable
-    return true;
+    // "-g" compares groups
+    if (pArgs->setGroup) {
+        fields |= STAT_FIELD_GID;
+    }
+
+    // "-s s" sorts by size
+    if (pArgs->sortType == 2) {
+        fields |= STAT_FIELD_SIZE;
+    }
+
+    // "-F json" writes the size, mode and owner of every result
+    if (pArgs->outputFormat == OUTPUT_FORMAT_JSON) {
+        fields |= STAT_FIELD_SIZE | STAT_FIELD_MODE | STAT_FIELD_UID;
+    }
+
+    return fields;
 }
 
 
-/** \brief If "-f" opt occurs in arguments, check if the desired
- *  recursive directory depth occurs
- * 
+/** \brief Determine if a subdirectory can be skipped without opening it,
+ *  either because none of its files could pass the maximal depth or
+ *  because a prune rule ("-p" name, "-x" path) matches it
+ *
  *  @param pArgs - ParsedArguments structure
- *  @param depth - obtained from findRecursive parameters
- *  @return -true if the "-f opt occurred in the arguments and desired
- *           depth is reached OR true if "-f" is not present
- *          -false only when "-f" is present and minimal depth is not reached
+ *  @param path - path of the subdirectory
+ *  @param name - name of the subdirectory
+ *  @param depth - depth of the subdirectory (its files are one level deeper)
+ *  @return true if the subdirectory is not searched
+ */
+static bool shouldPrune(ParsedArguments *pArgs, char *path, char *name, size_t depth)
+{
+    // files of the directory would be too deep
+    if (pArgs->setMaximalDepth && depth >= pArgs->maximalDepth) {
+        return true;
+    }
+
+    for (size_t i = 0; i < pArgs->pruneNames.count; i++) {
+        if (strcmp(name, pArgs->pruneNames.items[i]) == 0) {
+            return true;
+        }
+    }
+
+    // subdirectories of an excluded path are never reached, so the path has to match exactly
+    for (size_t i = 0; i < pArgs->excludedPaths.count; i++) {
+        if (strcmp(path, pArgs->excludedPaths.items[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** \brief Compile the enabled checks of regular files into a pipeline,
+ *  checks which only need the name and depth run before the file is stat-ed
+ *  and every stage is ordered from the cheapest check
+ *
+ *  @param pArgs - ParsedArguments structure (the pipeline is stored in it)
+ *  @return true if successful
+ *          false if the name patterns couldn't be compiled (allocation error)
  */
-static bool checkMinDepth(ParsedArguments *pArgs, size_t depth)
+static bool compileFilters(ParsedArguments *pArgs)
 {
-    // if checking for minimal depth is set, check it
+    FilterPipeline *pipeline = &pArgs->filters;
+    *pipeline = initFilterPipeline(pArgs->adaptiveFilters);
+
+    // at most 6 steps per stage, adding can't fail
+    if (!pArgs->setShowAll) {
+        addFilterStep(pipeline, FILTER_STAGE_NAME, filterHidden, "hidden", 1, NULL, 0);
+    }
     if (pArgs->setMinimalDepth) {
-        return (pArgs->minimalDepth <= depth);
+        addFilterStep(pipeline, FILTER_STAGE_NAME, filterMinDepth, "min depth", 1,
+                NULL, pArgs->minimalDepth);
+    }
+    if (pArgs->setMaximalDepth) {
+        // only files of the start directory can get here too deep,
+        // deeper directories are pruned
+        addFilterStep(pipeline, FILTER_STAGE_NAME, filterMaxDepth, "max depth", 1,
+                NULL, pArgs->maximalDepth);
+    }
+    if (pArgs->setName) {
+        // all of the names are searched at once
+        if (!initPatternSet(&pArgs->patterns, pArgs->namePatterns.items, pArgs->namePatterns.count)) {
+            fprintf(stderr, "Couldn't compile name patterns.\n");
+            return false;
+        }
+        addFilterStep(pipeline, FILTER_STAGE_NAME, filterName, "name", 8, &pArgs->patterns, 0);
+    }
+    if (pArgs->setGlob) {
+        if (!compileGlob(&pArgs->globPattern, pArgs->globArg, pArgs->ignoreCase)) {
+            return false;
+        }
+        // plain comparisons of simple globs are cheaper than the automaton
+        addFilterStep(pipeline, FILTER_STAGE_NAME, filterNamePattern, "glob",
+                (pArgs->globPattern.kind == NAME_PATTERN_DFA) ? 6 : 4, &pArgs->globPattern, 0);
+    }
+    if (pArgs->setRegex) {
+        if (!compileRegex(&pArgs->regexPattern, pArgs->regexArg, pArgs->ignoreCase)) {
+            return false;
+        }
+        addFilterStep(pipeline, FILTER_STAGE_NAME, filterNamePattern, "regex", 6, &pArgs->regexPattern, 0);
+    }
+
+    if (pArgs->setMask) {
+        addFilterStep(pipeline, FILTER_STAGE_STAT, filterMask, "mask", 1,
+                NULL, compileMask(pArgs->mask));
+    }
+    if (pArgs->setUser) {
+        addFilterStep(pipeline, FILTER_STAGE_STAT, filterUser, "user", 3, &pArgs->userIds, 0);
+    }
+    if (pArgs->setGroup) {
+        addFilterStep(pipeline, FILTER_STAGE_STAT, filterGroup, "group", 3, &pArgs->groupIds, 0);
     }
 
-    // otherwise the file is suitable whatever its depth is
     return true;
 }
 
 
-/** \brief If "-t" opt occurs in arguments, check if the desired
- *  recursive directory depth occurs
- * 
+/** \brief Get the type of a directory element without calling stat if possible
+ *
+ *  @param directoryElement - element returned by the directory reader
+ *  @return S_IFDIR, S_IFREG or any other S_IF* type the element has,
+ *          0 if the type is unknown (filesystem doesn't fill d_type)
+ */
+static mode_t getElementType(DirectoryEntry *directoryElement)
+{
+#ifdef DT_UNKNOWN
+    switch (directoryElement->type) {
+    case DT_DIR:
+        return S_IFDIR;
+    case DT_REG:
+        return S_IFREG;
+    case DT_LNK:
+        return S_IFLNK;
+    case DT_UNKNOWN:
+        return 0;
+    default:
+        // sockets, pipes, devices are all skipped the same way
+        return S_IFIFO;
+    }
+#else
+    (void) directoryElement;
+    return 0;
+#endif
+}
+
+
+/** \brief Determine if results are written as they are found, either
+ *  unsorted ("-s none") or by the ordered walk ("-o")
+ *
  *  @param pArgs - ParsedArguments structure
- *  @param depth - obtained from findRecursive parameters
- *  @return -true if the "-f opt occurred in the arguments and desired
- *           depth has not been reached OR true if "-t" is not present
- *          -false only when "-t" is present and maximal depth has been surpassed
+ *  @return true if results are not stored
  */
-static bool checkMaxDepth(ParsedArguments *pArgs, size_t depth)
+static inline bool streamsResults(ParsedArguments *pArgs)
 {
-    // if checking for maximal depth is set, it checks it
-    if (pArgs->setMaximalDepth) {
-        return (pArgs->maximalDepth >= depth);
+    return (pArgs->sortType == 3 || pArgs->orderedOutput);
+}
+
+
+/** \brief Write a change of the results in the watch mode,
+ *  the line is the sign followed by the path
+ *
+ *  @param state - TraversalState structure
+ *  @param sign - "+ " for a new match, "- " for a removed one
+ *  @param path - path of the file
+ *  @param length - length of the path
+ *  @return true if successful
+ *          false if the event couldn't be written
+ */
+static bool writeWatchEvent(TraversalState *state, char *sign, char *path, size_t length)
+{
+    // the output buffer reports its own errors
+    return appendOutputWithPrefix(&state->output, sign, strlen(sign), path, length, state->pArgs->lineBreak);
+}
+
+
+/** \brief Store a file as a result, in the streaming mode it's written
+ *  into the output buffer instead
+ *
+ *  @param state - TraversalState, path contains path to the file
+ *  @param stats - stats of the file (only the fields the arguments need are set)
+ *  @return true if successful
+ *          false if an allocation (or write) error occurred
+ */
+static bool storeResult(TraversalState *state, const struct stat *stats)
+{
+    ParsedArguments *pArgs = state->pArgs;
+    int32_t pattern = NO_PATTERN;
+    state->stats.matches++;
+
+    // watched matches are remembered (their removal is reported later),
+    // after the first walk only new matches are written, as events
+    if (state->watcher != NULL) {
+        bool added = false;
+        if (!addWatchedMatch(state->watcher, state->path.path, state->path.length, &added)) {
+            fprintf(stderr, "Couldn't allocate file path.\n");
+            return false;
+        }
+        if (state->watcher->live) {
+            return !added || writeWatchEvent(state, "+ ", state->path.path, state->path.length);
+        }
+    }
+
+    // the name is matched once more only for results, to find out which pattern it was
+    if (pArgs->annotatePattern && pArgs->setName) {
+        pattern = findPattern(&pArgs->patterns, strrchr(state->path.path, '/') + 1);
+    }
+
+    if (streamsResults(pArgs)) {
+        if (state->stats.firstResultTime == 0) {
+            state->stats.firstResultTime = getMonotonicTime() - state->startTime;
+        }
+
+        OutputRecord record = { state->path.path, state->path.length,
+                (pattern != NO_PATTERN) ? pArgs->patterns.patterns[pattern] : NULL,
+                (uint64_t) stats->st_size, stats->st_mode, stats->st_uid };
+        return appendRecord(&state->output, &record, pArgs->outputFormat, pArgs->lineBreak);
+    }
+
+    // only now the path is copied (into the chunks of results)
+    if (!createResult(&state->results, state->path.path, state->path.length, stats, pattern)) {
+        fprintf(stderr, "Couldn't allocate file path.\n");
+        return false;
     }
 
-    // otherwise the file is suitable whatever its depth is
     return true;
 }
 
 
-/** \brief If "-a" opt doesn't occur in arguments, check if the current file
- *  is not hidden
- * 
- *  @param pArgs - ParsedArguments structure
- *  @param fileName - name of the file
- *  @return -true if the "-a" opt occurred in the arguments 
- *           OR true if "-a" is not present and file is NOT hidden
- *          -false when "-a" is not present and file is hidden
+/** \brief Check conditions that need stats of a file, store it as a result
+ *  if they are met
+ *
+ *  @param state - TraversalState, path contains path to the file
+ *  @param name - name of the file
+ *  @param depth - depth of the file
+ *  @param buf - stats of the file
+ *  @return true if successful
+ *          false if an allocation error occurred
  */
-static bool checkHidden(ParsedArguments *pArgs, char *fileName)
+static bool storeIfSuitable(TraversalState *state, char *name, size_t depth, struct stat *buf)
 {
-    // if checking for all files is set, it checks hidden files as well
-    if (pArgs->setShowAll) {
+    FilterCandidate candidate = { name, depth, buf };
+
+    // if a condition fails the file is skipped
+    if (!runFilterStage(&state->filters, FILTER_STAGE_STAT, &candidate)) {
         return true;
     }
 
-    // it only allows non hidden files
-    return (!isHidden(fileName));
+    return storeResult(state, buf);
 }
 
 
-/** \brief Search through filesystem and recursively try to find
- *  desired files
+/** \brief Stat an element of a directory (symbolic links are not followed),
+ *  the call is counted and timed
+ *
+ *  @param state - TraversalState structure
+ *  @param directoryFd - directory the name is relative to (AT_FDCWD for a path)
+ *  @param name - name of the element
+ *  @param buf - the stats are stored here
+ *  @return 0 on success, -1 with errno set otherwise
+ */
+static int statElement(TraversalState *state, int directoryFd, char *name, struct stat *buf)
+{
+    state->stats.statCalls++;
+    if (!state->timed) {
+        return fstatat(directoryFd, name, buf, AT_SYMLINK_NOFOLLOW);
+    }
+
+    uint64_t start = getMonotonicTime();
+    int result = fstatat(directoryFd, name, buf, AT_SYMLINK_NOFOLLOW);
+    state->stats.statTime += getMonotonicTime() - start;
+    return result;
+}
+
+
+/** \brief Wait for the next completed stat request of the batch, the wait is timed
+ *
+ *  @param state - TraversalState structure
+ *  @param request - the completed request is stored here
+ *  @return true if a request was completed
+ *          false if all requests of the batch were handed out
+ */
+static bool nextTimedCompletion(TraversalState *state, StatRequest **request)
+{
+    if (!state->timed) {
+        return nextStatCompletion(&state->statBatch, request);
+    }
+
+    uint64_t start = getMonotonicTime();
+    bool completed = nextStatCompletion(&state->statBatch, request);
+    state->stats.statTime += getMonotonicTime() - start;
+    return completed;
+}
+
+
+/** \brief Submit pending stat requests of a directory to io_uring and
+ *  check the files as their stats arrive
+ *
+ *  @param state - TraversalState (its batch is emptied)
+ *  @param directoryFd - directory the files are in
+ *  @param baseLength - length of the path to the directory
+ *  @param depth - depth of the files
+ *  @return true if successful
+ *          false if an allocation error occurred
+ */
+static bool flushStatBatch(TraversalState *state, int directoryFd, size_t baseLength, size_t depth)
+{
+    StatBatch *batch = &state->statBatch;
+    StatRequest *request = NULL;
+    bool success = true;
+
+    if (batch->count == 0) {
+        return true;
+    }
+
+    state->stats.statBatches++;
+    uint64_t start = state->timed ? getMonotonicTime() : 0;
+    submitStatBatch(batch, directoryFd);
+    if (state->timed) {
+        state->stats.statTime += getMonotonicTime() - start;
+    }
+
+    // all completions have to be collected, even after a fail
+    while (nextTimedCompletion(state, &request)) {
+        if (!success) {
+            continue;
+        }
+
+        if (request->error != 0) {
+            errno = request->error;
+            printFileProblem();
+            continue;
+        }
+
+        // the element could have been replaced since it was read
+        if (!S_ISREG(request->buf.st_mode)) {
+            continue;
+        }
+
+        char *name = statRequestName(batch, request);
+        truncatePath(&state->path, baseLength);
+        if (!appendToPath(&state->path, name)) {
+            fprintf(stderr, "Couldn't allocate file path.\n");
+            success = false;
+            continue;
+        }
+        success = storeIfSuitable(state, name, depth, &request->buf);
+    }
+
+    truncatePath(&state->path, baseLength);
+    clearStatBatch(batch);
+    if (state->trace != NULL) {
+        recordTraceEvent(state->trace, "stat batch", state->path.path,
+                start - state->startTime, getMonotonicTime() - state->startTime);
+    }
+    return success;
+}
+
+
+/** \brief Find out if an opened subdirectory is one of the start directories
+ *  (only searches with several start directories have them)
+ *
+ *  @param state - TraversalState structure
+ *  @param directoryFd - descriptor of the subdirectory
+ *  @return true if the directory is a start directory
+ *          false otherwise (or if it can't be stat-ed)
+ */
+static bool isOtherRoot(TraversalState *state, int directoryFd)
+{
+    struct stat buf;
+    if (state->rootCount == 0 || fstat(directoryFd, &buf) != 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < state->rootCount; i++) {
+        if (state->roots[i].device == buf.st_dev && state->roots[i].inode == buf.st_ino) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/** \brief Search through one directory, store desired files and pass
+ *  every subdirectory to a handler (which recurses or queues it).
+ *  The directory is opened relative to its parent, so that the kernel
+ *  doesn't have to resolve the whole path for every element. Elements
+ *  are only stat-ed when their type is unknown or some check needs it.
  * 
- *  @param pArgs - ParsedArguments structure
- *  @param baseDirectory - directory that's opened in function call
- *  @param res - Results structure containing Result array
- *               used to store filenames and file sizes
+ *  @param state - TraversalState of the current thread, elements are appended
+ *                 to its path while scanning (it's restored before the function returns)
+ *  @param parentFd - descriptor of the parent directory (AT_FDCWD for base directory)
+ *  @param name - name of the directory within its parent (or path to base directory)
  *  @param depth - recursive depth (length from the first directory)
- *  @return -true if recursion is successful
+ *  @param onDirectory - function called for every subdirectory
+ *  @param handlerData - argument passed into onDirectory
+ *  @return -true if the scan is successful
  *          -false if first directory cannot be opened OR any malloc (/calloc)
  *           fail occurs. In that case any recursion stops immediately.
  */
-static bool findRecursive(ParsedArguments *pArgs,
-        char *baseDirectory,
-        Results *res,
-        size_t depth)
+static bool scanDirectoryEntries(TraversalState *state,
+        int parentFd,
+        char *name,
+        size_t depth,
+        DirectoryHandler onDirectory,
+        void *handlerData)
 {
     // Combine values from multiple recursion depths, the first one will be true implicitly
     // if we encounter an error, crash the whole program
+    ParsedArguments *pArgs = state->pArgs;
+    PathBuffer *path = &state->path;
 
     // used for directory access.
     errno = 0;
 
-    DIR *currentDirectory = opendir(baseDirectory);
+    // symbolic links are only followed for the base directory
+    int openFlags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | ((depth == 0) ? 0 : O_NOFOLLOW);
+    int directoryFd = openat(parentFd, name, openFlags);
+    DirectoryReader currentDirectory;
     bool resultRec = true;
 
+    // another start directory is searched by its own walk (with its own depth and rules)
+    if (directoryFd >= 0 && depth > 0 && isOtherRoot(state, directoryFd)) {
+        close(directoryFd);
+        return true;
+    }
+
+    // either getdents buffers of this thread or readdir are used
+    ReadBufferStack *readBuffers = pArgs->useGetdents ? &state->readBuffers : NULL;
+
     // if directory fails at level 0 (base directory) the recursion ends
     // and false is returned. otherwise true is returned (error message is shown
     // both times)
-    if (currentDirectory == NULL) {
-        printDirectoryProblem(baseDirectory);
+    if (directoryFd < 0 || !openDirectoryReader(&currentDirectory, directoryFd, readBuffers)) {
+        printDirectoryProblem(path->path);
         if (depth == 0)
             return false;
         return true;
     }
 
+    // the ordered walk reads the whole directory first and visits it sorted
+    if (pArgs->orderedOutput && !sortDirectoryEntries(&currentDirectory)) {
+        fprintf(stderr, "Couldn't allocate directory entries.\n");
+        closeDirectoryReader(&currentDirectory);
+        return false;
+    }
+
+    state->stats.directories++;
+
     // depth 0 = basedirectory, everthing has an increased depth
     depth++;
     
     // used to access files in directory
-    struct dirent *directoryElement = NULL;
+    DirectoryEntry directoryElement;
 
     // used file statistics
     struct stat buf;
 
-    // path to file is stored here
-    char *currentPath = NULL;
+    // length of the directory path, elements are appended after it
+    size_t baseLength = path->length;
 
     // loop through content of a directory
-    while ((directoryElement = readdir(currentDirectory)) != NULL) {
+    while (readDirectoryEntry(&currentDirectory, &directoryElement)) {
         // reset errno just in case
         errno = 0;
         // error occurred somewhere, breaks the rest of the cycle
@@ -320,198 +909,752 @@ static bool findRecursive(ParsedArguments *pArgs,
         }
     
         // skip current and parent folder
-        if ((strcmp(directoryElement->d_name, ".") == 0)
-                    || (strcmp(directoryElement->d_name, "..") == 0)) {
+        if ((strcmp(directoryElement.name, ".") == 0)
+                    || (strcmp(directoryElement.name, "..") == 0)) {
             continue;
         }
 
-        // create a filePath for our file. after we don't need it anymore
-        // we free it (if we do we keep it in result, free it at the end of the code run)
-        if (!createFilePath(baseDirectory, 
-                    directoryElement->d_name,
-                    &currentPath)) {
+        state->stats.entries++;
+
+        // append the name to the shared path, the previous element is cut off first
+        truncatePath(path, baseLength);
+        if (!appendToPath(path, directoryElement.name)) {
             fprintf(stderr, "Couldn't allocate file path.\n");
-            closedir(currentDirectory);
+            closeDirectoryReader(&currentDirectory);
             return false;
         }
 
-        // get stats for the file, if unsuccessful it proceeds
-        if (lstat(currentPath, &buf) != 0) {
-            printFileProblem();
-            free(currentPath);
-            continue;
+        // the type is taken from the directory entry, stat is only called when
+        // the filesystem doesn't provide it or a regular file needs its stats checked
+        mode_t elementType = getElementType(&directoryElement);
+        bool statDone = false;
+        buf.st_size = 0;
+
+        if (elementType == 0) {
+            // get stats for the file (relative to the directory), if unsuccessful it proceeds
+            if (statElement(state, directoryFd, directoryElement.name, &buf) != 0) {
+                printFileProblem();
+                continue;
+            }
+            elementType = buf.st_mode & S_IFMT;
+            statDone = true;
         }
 
-        // check for directory = recursion with "currentPath" as base directory.
-        if (S_ISDIR(buf.st_mode)) {
+        // check for directory = handler is called with the directory as base directory.
+        if (elementType == S_IFDIR) {
             // if the directory is not hidden or we want to search through all files
-            // we enter the directory, else only free the path and continue
-            if (!isHidden(directoryElement->d_name) || pArgs->setShowAll) {
-                resultRec = findRecursive(pArgs, currentPath, res, depth);
+            // we enter the directory, directory is not put into results
+            // pending stat requests are finished first, the batch is shared with subdirectories
+            // (the flush uses the path, so the directory name is appended again)
+            if (!isHidden(directoryElement.name) || pArgs->setShowAll) {
+                // pruned directories are not even opened
+                if (shouldPrune(pArgs, path->path, directoryElement.name, depth)) {
+                    state->stats.directoriesPruned++;
+                } else {
+                    if (state->statBatch.count > 0
+                            && !(flushStatBatch(state, directoryFd, baseLength, depth)
+                                && appendToPath(path, directoryElement.name))) {
+                        closeDirectoryReader(&currentDirectory);
+                        return false;
+                    }
+                    resultRec = onDirectory(state, directoryFd, directoryElement.name,
+                            depth, handlerData);
+                }
+            }
+        } else if (elementType == S_IFREG) {
+            // is regular file. if one of the conditions fail, continue with the cycle
+
+            // checks that only need the name and depth go first, so that
+            // rejected files are never stat-ed
+            FilterCandidate candidate = { directoryElement.name, depth, NULL };
+            if (!runFilterStage(&state->filters, FILTER_STAGE_NAME, &candidate)) {
+                state->stats.statsAvoided += !statDone;
+                continue;
             }
 
-            // do not put directory into results
-            free(currentPath);
-            continue;
-        } else if (S_ISREG(buf.st_mode)) {
-            // is regular file. if one of the conditions fail, free allocated string and
-            // continue with the cycle
-
-            // if a condition fails the file is skipped
-            if (!(checkName(pArgs, directoryElement->d_name) &&
-                        checkPermissions(pArgs, getMask(&buf)) &&
-                        checkUser(pArgs, &buf) &&
-                        checkMinDepth(pArgs, depth) &&
-                        checkHidden(pArgs, directoryElement->d_name))) {
-                free(currentPath);
+            // with io_uring the stats are requested in batches, the rest of
+            // the checks happens when they arrive
+            if (!statDone && state->batchStats) {
+                state->stats.statCalls++;
+                if (!addStatRequest(&state->statBatch, directoryElement.name)) {
+                    fprintf(stderr, "Couldn't allocate stat request.\n");
+                    clearStatBatch(&state->statBatch);
+                    closeDirectoryReader(&currentDirectory);
+                    return false;
+                }
+                if (statBatchFull(&state->statBatch)
+                        && !flushStatBatch(state, directoryFd, baseLength, depth)) {
+                    closeDirectoryReader(&currentDirectory);
+                    return false;
+                }
                 continue;
             }
 
-            // cutting the recursion branch
-            if (!checkMaxDepth(pArgs, depth)) {
-                free(currentPath);
-                closedir(currentDirectory);
-                return (true && resultRec);
+            // get stats only if some check (or sorting) needs them
+            if (!statDone && pArgs->statFields != 0) {
+                if (statElement(state, directoryFd, directoryElement.name, &buf) != 0) {
+                    printFileProblem();
+                    continue;
+                }
+                statDone = true;
             }
 
-            // ADD RESULT, all memory allocation problems return false
-            if (!createResult(res, currentPath, buf.st_size)) {
-                free(currentPath);
-                closedir(currentDirectory);
+            state->stats.statsAvoided += !statDone;
+
+            // ADD RESULT if the rest of the conditions is met,
+            // all memory allocation problems return false
+            if (!storeIfSuitable(state, directoryElement.name, depth, &buf)) {
+                closeDirectoryReader(&currentDirectory);
                 return false;
             }
-        } else {
-            // is not regular file -> skip
-            free(currentPath);
             continue;
         }
 
+        // directories and other elements (not regular files) were classified without stat
+        state->stats.statsAvoided += !statDone;
+    }
+
+    // stats of the last files are collected
+    if (!flushStatBatch(state, directoryFd, baseLength, depth)) {
+        resultRec = false;
+    }
+
+    // streamed results don't wait in the buffer for too long
+    if (!flushOutputIfStale(&state->output)) {
+        resultRec = false;
     }
 
-    // after readdir was done, the directory is closed and result value is returned
-    closedir(currentDirectory);
+    // after readdir was done, the path is restored, the directory is closed and result value is returned
+    truncatePath(path, baseLength);
+    closeDirectoryReader(&currentDirectory);
     return (true && resultRec);
 }
 
 
-/** \brief Retrieve fileName from any path
+/** \brief Search through one directory (see scanDirectoryEntries), with "-S" the time
+ *  spent in it is measured. Subdirectories scanned meanwhile (by the serial traversal)
+ *  record their own time, which is subtracted.
+ *
+ *  @param state - TraversalState of the current thread, path contains path to the directory
+ *  @param parentFd - descriptor of the parent directory (AT_FDCWD for base directory)
+ *  @param name - name of the directory within its parent (or path to base directory)
+ *  @param depth - recursive depth (length from the first directory)
+ *  @param onDirectory - function called for every subdirectory
+ *  @param handlerData - argument passed into onDirectory
+ *  @return result of scanDirectoryEntries
+ */
+static bool scanDirectory(TraversalState *state,
+        int parentFd,
+        char *name,
+        size_t depth,
+        DirectoryHandler onDirectory,
+        void *handlerData)
+{
+    if (!state->timed) {
+        return scanDirectoryEntries(state, parentFd, name, depth, onDirectory, handlerData);
+    }
+
+    uint64_t start = getMonotonicTime();
+    uint64_t nestedBefore = state->stats.directoryTime;
+    bool success = scanDirectoryEntries(state, parentFd, name, depth, onDirectory, handlerData);
+
+    // the path is restored to the directory's one by the scan
+    uint64_t end = getMonotonicTime();
+    uint64_t nested = state->stats.directoryTime - nestedBefore;
+    recordDirectoryTime(&state->stats, state->path.path, end - start - nested);
+    if (state->trace != NULL) {
+        recordTraceEvent(state->trace, "directory", state->path.path,
+                start - state->startTime, end - state->startTime);
+    }
+    return success;
+}
+
+
+// recursion of the serial traversal, defined below
+static bool findRecursive(TraversalState *state, int parentFd, char *name, size_t depth);
+
+
+/** \brief DirectoryHandler of the serial traversal, recurse into the directory
+ *
+ *  @param state - TraversalState, its path contains path to the subdirectory
+ *  @param parentFd - descriptor of the directory that's being scanned
+ *  @param name - name of the subdirectory
+ *  @param depth - depth of the directory
+ *  @param handlerData - unused
+ *  @return result of the recursion
+ */
+static bool recurseIntoDirectory(TraversalState *state,
+        int parentFd,
+        char *name,
+        size_t depth,
+        void *handlerData)
+{
+    (void) handlerData;
+    return findRecursive(state, parentFd, name, depth);
+}
+
+
+/** \brief Search through filesystem and recursively try to find
+ *  desired files
  * 
- *  @param filePath - the whole path to the file
- *  @return char pointer at part of the path that's the name of the file
+ *  @param state - TraversalState (path contains path to the directory,
+ *                 results are stored into it)
+ *  @param parentFd - descriptor of the parent directory (AT_FDCWD for base directory)
+ *  @param name - name of the directory within its parent (or path to base directory)
+ *  @param depth - recursive depth (length from the first directory)
+ *  @return -true if recursion is successful
+ *          -false if first directory cannot be opened OR any malloc (/calloc)
+ *           fail occurs. In that case any recursion stops immediately.
  */
-char *getFileName(char *filePath)
+static bool findRecursive(TraversalState *state, int parentFd, char *name, size_t depth)
 {
-    char *iter = filePath;
-    while (*iter != '\0') {
-        if (*iter++ == '/') {
-            filePath = iter;
+    return scanDirectory(state, parentFd, name, depth, recurseIntoDirectory, NULL);
+}
+
+
+/** \brief DirectoryHandler of the parallel traversal, queue the directory
+ *  into the deque of the current worker. The task opens the name relative to
+ *  the scanned directory, like the serial traversal does, so paths longer
+ *  than PATH_MAX are searched too.
+ *
+ *  @param state - TraversalState of the worker, its path is copied into the task
+ *  @param parentFd - descriptor of the directory that's being scanned
+ *  @param name - name of the subdirectory
+ *  @param depth - depth of the directory
+ *  @param handlerData - Worker structure
+ *  @return true on success
+ *          false if the directory couldn't be queued
+ */
+static bool queueDirectory(TraversalState *state,
+        int parentFd,
+        char *name,
+        size_t depth,
+        void *handlerData)
+{
+    Worker *worker = handlerData;
+
+    // the descriptor is duplicated with the first queued subdirectory, when it can't be
+    // (too many open descriptors) the whole path is opened instead
+    if (worker->scanned == NULL) {
+        worker->scanned = shareDirectory(parentFd);
+    }
+    SharedDirectory *parent = worker->scanned;
+    size_t nameOffset = (parent != NULL) ? state->path.length - strlen(name) : 0;
+
+    char *taskPath = strdup(state->path.path);
+    if (parent != NULL) {
+        acquireSharedDirectory(parent);
+    }
+    if (taskPath == NULL || !pushTask(worker, taskPath, depth, parent, nameOffset)) {
+        fprintf(stderr, "Couldn't queue directory \'%s\'.\n", state->path.path);
+        releaseSharedDirectory(parent);
+        free(taskPath);
+        return false;
+    }
+
+    return true;
+}
+
+
+/** \brief TaskProcessor of the parallel traversal, scan one queued directory
+ *
+ *  @param worker - worker processing the task
+ *  @param task - directory to be scanned
+ *  @param userData - unused
+ *  @return result of the scan
+ */
+static bool processDirectoryTask(Worker *worker, DirectoryTask *task, void *userData)
+{
+    (void) userData;
+    if (!setPath(&worker->state.path, task->path)) {
+        fprintf(stderr, "Couldn't allocate file path.\n");
+        return false;
+    }
+
+    // the reference of the scan is dropped afterwards, queued subdirectories keep their own
+    int parentFd = (task->parent != NULL) ? task->parent->fd : AT_FDCWD;
+    worker->scanned = NULL;
+    bool success = scanDirectory(&worker->state, parentFd, task->path + task->nameOffset, task->depth,
+            queueDirectory, worker);
+    releaseSharedDirectory(worker->scanned);
+    worker->scanned = NULL;
+    return success;
+}
+
+
+/** \brief Search through filesystem with a pool of threads, every thread
+ *  collects its own results which are merged at the end
+ *
+ *  @param state - TraversalState results are merged into
+ *  @param roots - directories the search starts in, each one is a task of its own
+ *  @return -true if the traversal is successful
+ *          -false if first directory cannot be opened OR any malloc (/calloc)
+ *           fail occurs.
+ */
+static bool findParallel(TraversalState *state, StringList *roots)
+{
+    DirectoryTask *firstTasks = malloc(roots->count * sizeof(DirectoryTask));
+    if (firstTasks == NULL) {
+        fprintf(stderr, "Couldn't allocate file path.\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < roots->count; i++) {
+        firstTasks[i].path = strdup(roots->items[i]);
+        firstTasks[i].depth = 0;
+        firstTasks[i].parent = NULL;
+        firstTasks[i].nameOffset = 0;
+        if (firstTasks[i].path == NULL) {
+            fprintf(stderr, "Couldn't allocate file path.\n");
+            while (i > 0) {
+                free(firstTasks[--i].path);
+            }
+            free(firstTasks);
+            return false;
         }
     }
 
-    return filePath;
+    bool success = runThreadPool(state->pArgs->threadCount, firstTasks, roots->count,
+            processDirectoryTask, NULL, state);
+    free(firstTasks);
+    return success;
 }
 
 
-/** \brief Compare strings case insensitive
- * 
- *  @param strOnePtr - pointer to the first string
- *  @param strTwoPtr - pointer to the second string
- *  @return positive num if first string is bigger
- *          negative num if first string is smaller
- *          0 if strings are equal
+/** \brief Search through the start directories one after another with the serial recursion
+ *
+ *  @param state - TraversalState results are stored into
+ *  @param roots - directories the search starts in
+ *  @return -true if the traversal is successful
+ *          -false if a start directory cannot be opened OR any malloc (/calloc)
+ *           fail occurs.
  */
-int strCmpCI(char *strOnePtr, char *strTwoPtr)
+static bool findSerial(TraversalState *state, StringList *roots)
 {
-    int chOne = 0;
-    int chTwo = 0;
+    for (size_t i = 0; i < roots->count; i++) {
+        if (!setPath(&state->path, roots->items[i])) {
+            fprintf(stderr, "Couldn't allocate file path.\n");
+            return false;
+        }
+
+        // the directory is opened before anything gets appended to the path
+        if (!findRecursive(state, AT_FDCWD, roots->items[i], 0)) {
+            return false;
+        }
+    }
+
+    return true;
+}
 
-    // until we get to the end of string
-    while (*strOnePtr != '\0' && *strTwoPtr != '\0') {
-        // makes all chars lowercase + pointer iteration
-        chOne = tolower(*(strOnePtr++));
-        chTwo = tolower(*(strTwoPtr++));
 
-        // if the result is not zero it returns the value
-        if (chOne - chTwo != 0) {
-            return chOne - chTwo;
+/** \brief Choose the start directories that are searched, a directory that's
+ *  the same as an earlier one is searched once. With several directories their
+ *  identities are kept, so that a search skips the ones nested in its tree
+ *  (they're searched by their own walks, with their own depth).
+ *
+ *  @param pArgs - ParsedArguments structure
+ *  @param roots - the chosen directories are added into it (they point into the arguments)
+ *  @param identities - identities of the chosen directories are allocated into it
+ *                      (NULL with a single directory)
+ *  @return true if successful
+ *          false if a start directory can't be searched or an allocation error
+ *          occurred (a message is printed)
+ */
+static bool selectStartDirectories(ParsedArguments *pArgs, StringList *roots, DirectoryIdentity **identities)
+{
+    StringList *given = &pArgs->startDirectories;
+    *identities = NULL;
+
+    // a single directory is searched as it is, problems are found when it's opened
+    if (given->count <= 1) {
+        if (!addToStringList(roots, (given->count == 0) ? "." : given->items[0])) {
+            fprintf(stderr, "Couldn't allocate memory for start directories.\n");
+            return false;
         }
+        return true;
     }
 
-    // if one string is shorter then it returns correct value for qsort
-    if (*strOnePtr == '\0' && *strTwoPtr != '\0') {
-        return -1;
-    } else if (*strOnePtr != '\0' && *strTwoPtr == '\0') {
-        return 1;
+    *identities = malloc(given->count * sizeof(DirectoryIdentity));
+    if (*identities == NULL) {
+        fprintf(stderr, "Couldn't allocate memory for start directories.\n");
+        return false;
     }
 
-    return 0;
+    // symbolic links to start directories are followed, like by the traversal
+    for (size_t i = 0; i < given->count; i++) {
+        struct stat buf;
+        bool isDirectory = (stat(given->items[i], &buf) == 0);
+        if (isDirectory && !S_ISDIR(buf.st_mode)) {
+            errno = ENOTDIR;
+            isDirectory = false;
+        }
+        if (!isDirectory) {
+            printDirectoryProblem(given->items[i]);
+            return false;
+        }
+
+        // the chosen directories and their identities share indexes
+        bool duplicate = false;
+        for (size_t j = 0; j < roots->count; j++) {
+            if ((*identities)[j].device == buf.st_dev && (*identities)[j].inode == buf.st_ino) {
+                fprintf(stderr, "\'%s\' is the same directory as \'%s\', it's searched once.\n",
+                        given->items[i], roots->items[j]);
+                duplicate = true;
+                break;
+            }
+        }
+        if (duplicate) {
+            continue;
+        }
+
+        (*identities)[roots->count].device = buf.st_dev;
+        (*identities)[roots->count].inode = buf.st_ino;
+        if (!addToStringList(roots, given->items[i])) {
+            fprintf(stderr, "Couldn't allocate memory for start directories.\n");
+            return false;
+        }
+    }
+
+    return true;
 }
 
 
-/** \brief Determine which file name is bigger 
- *  (case insensitive, unless fileNames are equal)
- * 
- *  @param resultOne - pointer to the first Result element in array
- *  @param resultTwo - pointer to the second Result element in array
- *  @return positive num if resultOne's filename is larger
- *          negative num if resultOne's filename is smaller
- *          0 if names are equal
+/** \brief Go through the entries of an index like the traversal goes through
+ *  the directories, the same rules and filters are applied (the stats come from
+ *  the index), so the results are the same as the traversal's at the time the
+ *  index was built. Pruned and hidden directories are skipped with their subtrees.
+ *
+ *  @param state - TraversalState results are stored into
+ *  @param index - mapped index
+ *  @return true if successful
+ *          false if the index is damaged or an allocation error occurred
  */
-int sortByFileName(const void *resultOne, const void *resultTwo)
+static bool scanIndex(TraversalState *state, const FileIndex *index)
 {
-    char *fileNameOne = getFileName(((Result *) resultOne)->filePath);
-    char *fileNameTwo = getFileName(((Result *) resultTwo)->filePath);
+    ParsedArguments *pArgs = state->pArgs;
+    PathBuffer *path = &state->path;
+    const IndexEntry *entries = index->entries;
+    size_t entryCount = index->header->entryCount;
+
+    // length of the path of the open directory at every depth
+    size_t *lengths = malloc((index->header->maxDepth + 1) * sizeof(size_t));
+    char *root = fileIndexRoot(index);
+    IndexCursor cursor;
+    bool success = (lengths != NULL && root != NULL && setPath(path, root));
+
+    if (!success) {
+        fprintf(stderr, "Couldn't allocate file path.\n");
+    } else if (!initIndexCursor(&cursor, index)) {
+        fprintf(stderr, "Couldn't read the index.\n");
+        success = false;
+    }
+
+    if (!success) {
+        free(lengths);
+        free(root);
+        return false;
+    }
 
-    int result = 0;
+    // stats that aren't in the index stay zero
+    struct stat buf;
+    memset(&buf, 0, sizeof(struct stat));
+
+    lengths[0] = path->length;
+    // deepest directory that's open (whose entries may follow)
+    size_t openDepth = 0;
+    state->stats.directories++;
+
+    size_t current = 1;
+    while (success && seekIndexCursor(&cursor, current)) {
+        const IndexEntry *entry = entries + current;
+        char *name = cursor.name;
+        size_t depth = entry->depth;
+
+        // entries have to follow their directory and skips have to go forward
+        if (depth == 0 || depth > openDepth + 1 || depth > index->header->maxDepth
+                || entry->next <= current || entry->next > entryCount) {
+            break;
+        }
 
-    // case insensitive difference
-    if ((result = strCmpCI(fileNameOne, fileNameTwo)) != 0) {
-        return result;
+        current++;
+        state->stats.entries++;
+        truncatePath(path, lengths[depth - 1]);
+        if (!appendToPath(path, name)) {
+            fprintf(stderr, "Couldn't allocate file path.\n");
+            success = false;
+            break;
+        }
+
+        if (S_ISDIR(entry->mode)) {
+            openDepth = depth - 1;
+            if (isHidden(name) && !pArgs->setShowAll) {
+                current = entry->next;
+            } else if (shouldPrune(pArgs, path->path, name, depth)) {
+                state->stats.directoriesPruned++;
+                current = entry->next;
+            } else {
+                lengths[depth] = path->length;
+                openDepth = depth;
+                state->stats.directories++;
+                if (!flushOutputIfStale(&state->output)) {
+                    success = false;
+                }
+            }
+            continue;
+        }
+
+        openDepth = depth - 1;
+        FilterCandidate candidate = { name, depth, NULL };
+        if (!runFilterStage(&state->filters, FILTER_STAGE_NAME, &candidate)) {
+            continue;
+        }
+
+        buf.st_mode = entry->mode;
+        buf.st_uid = entry->uid;
+        buf.st_gid = entry->gid;
+        buf.st_size = (off_t) entry->size;
+        buf.st_mtim.tv_sec = entry->mtime;
+        buf.st_mtim.tv_nsec = entry->mtimeNsec;
+        success = storeIfSuitable(state, name, depth, &buf);
+    }
+
+    // the cursor stops early only on damaged entries or names
+    if (success && cursor.current < entryCount) {
+        fprintf(stderr, "The index is damaged, rebuild it.\n");
+        success = false;
     }
 
-    // case sensitive difference
-    return (strcmp(((Result *) resultOne)->filePath, ((Result *) resultTwo)->filePath));
+    freeIndexCursor(&cursor);
+    free(lengths);
+    free(root);
+    return success;
 }
 
 
-/** \brief Determine which file size is larger 
- *  (reversed, because we want to display the files from largest
- *   to smallest)
- * 
- *  @param resultOne - pointer to the first Result element in array
- *  @param resultTwo - pointer to the second Result element in array
- *  @return -1 if resultOne's filesize is larger
- *          1 if resultOne's filesize is smaller
- *          if sizes are equal, sorting by fileName happens
+/** \brief Answer the search from the index file given by "-q"
+ *
+ *  @param state - TraversalState results are stored into
+ *  @return true if successful
+ *          false if the index can't be read, it's not the index of the
+ *          start directory or an allocation error occurred
  */
-int sortByFileSize(const void *resultOne, const void *resultTwo)
+static bool findInIndex(TraversalState *state)
 {
-    size_t sizeOne = ((Result *) resultOne)->fileSize;
-    size_t sizeTwo = ((Result *) resultTwo)->fileSize;
-    
-    // this inverts how the qsort sorts the files
-    if (sizeOne > sizeTwo) {
-        return -1;
-    } else if (sizeOne < sizeTwo) {
-        return 1;
+    ParsedArguments *pArgs = state->pArgs;
+    FileIndex index;
+
+    if (!openFileIndex(&index, pArgs->indexPath)) {
+        return false;
     }
 
-    return sortByFileName(resultOne, resultTwo);
+    if (!fileIndexMatchesRoot(&index, pArgs->indexPath, pArgs->startDirectory)) {
+        closeFileIndex(&index);
+        return false;
+    }
+
+    bool success = scanIndex(state, &index);
+    closeFileIndex(&index);
+    return success;
 }
 
 
-/** \brief Determine which file path is larger (case sensitive)
- * 
- *  @param resultOne - pointer to the first Result element in array
- *  @param resultTwo - pointer to the second Result element in array
- *  @return positive num if resultOne's filepath is larger
- *          negative num if resultOne's filepath is smaller
- *          0 if names are equal
+/** \brief DirectoryHandler of the watch mode, start watching the directory
+ *  before it's scanned (so that no change after the scan is missed) and recurse
+ *
+ *  @param state - TraversalState, its path contains path to the subdirectory
+ *  @param parentFd - descriptor of the directory that's being scanned
+ *  @param name - name of the subdirectory
+ *  @param depth - depth of the directory
+ *  @param handlerData - unused
+ *  @return result of the recursion
+ */
+static bool watchAndRecurse(TraversalState *state,
+        int parentFd,
+        char *name,
+        size_t depth,
+        void *handlerData)
+{
+    (void) handlerData;
+    if (!watchDirectory(state->watcher, state->path.path, depth)) {
+        fprintf(stderr, "Couldn't allocate the watcher.\n");
+        return false;
+    }
+
+    return scanDirectory(state, parentFd, name, depth, watchAndRecurse, NULL);
+}
+
+
+/** \brief MatchHandler of the watch mode, report a removed match
+ *
+ *  @param path - path of the file
+ *  @param length - length of the path
+ *  @param handlerData - TraversalState structure
+ *  @return true if the event was written
+ */
+static bool writeRemovedMatch(char *path, size_t length, void *handlerData)
+{
+    return writeWatchEvent(handlerData, "- ", path, length);
+}
+
+
+/** \brief Scan a directory of the watched tree again, new matches are reported
+ *  by storeResult, matches (and watches) that weren't seen again are removed
+ *
+ *  @param state - TraversalState, its path contains path to the directory
+ *  @param depth - depth of the directory
+ *  @return true if successful
+ *          false if the base directory can't be read or an allocation error occurred
+ */
+static bool rescanWatchedDirectory(TraversalState *state, size_t depth)
+{
+    TreeWatcher *watcher = state->watcher;
+
+    // the path buffer is appended to by the scan, the name for openat is a copy
+    char *path = strdup(state->path.path);
+    if (path == NULL) {
+        fprintf(stderr, "Couldn't allocate file path.\n");
+        return false;
+    }
+
+    watcher->generation++;
+    bool success = watchAndRecurse(state, AT_FDCWD, path, depth, NULL)
+            && removeSubtreeMatches(watcher, path, true, writeRemovedMatch, state);
+    unwatchSubtree(watcher, path, true);
+
+    free(path);
+    return success;
+}
+
+
+/** \brief Check a file of the watched tree again (it was created or its
+ *  attributes changed), it's reported if it started or stopped matching
+ *
+ *  @param state - TraversalState, its path contains path to the file
+ *  @param name - name of the file
+ *  @param depth - depth of the file
+ *  @return true if successful
+ *          false if an allocation or write error occurred
+ */
+static bool checkWatchedFile(TraversalState *state, char *name, size_t depth)
+{
+    struct stat buf;
+    FilterCandidate candidate = { name, depth, &buf };
+
+    // the file could be gone already, then it's handled like a removed one
+    bool suitable = statElement(state, AT_FDCWD, state->path.path, &buf) == 0
+            && S_ISREG(buf.st_mode)
+            && runFilterStage(&state->filters, FILTER_STAGE_NAME, &candidate)
+            && runFilterStage(&state->filters, FILTER_STAGE_STAT, &candidate);
+
+    if (suitable) {
+        return storeResult(state, &buf);
+    }
+
+    if (removeWatchedMatch(state->watcher, state->path.path, state->path.length)) {
+        return writeWatchEvent(state, "- ", state->path.path, state->path.length);
+    }
+    return true;
+}
+
+
+/** \brief Handle one event of a watched directory
+ *
+ *  @param state - TraversalState structure
+ *  @param event - the event
+ *  @return true if successful
+ *          false if an allocation or write error occurred
+ */
+static bool handleWatchEvent(TraversalState *state, WatchEvent *event)
+{
+    ParsedArguments *pArgs = state->pArgs;
+    TreeWatcher *watcher = state->watcher;
+
+    // the directory's entry can move when watches are added, its path is copied first
+    size_t depth = event->directory->depth + 1;
+    if (!setPath(&state->path, event->directory->path) || !appendToPath(&state->path, event->name)) {
+        fprintf(stderr, "Couldn't allocate file path.\n");
+        return false;
+    }
+
+    if (!event->isDirectory && event->type == WATCH_EVENT_REMOVED) {
+        if (removeWatchedMatch(watcher, state->path.path, state->path.length)) {
+            return writeWatchEvent(state, "- ", state->path.path, state->path.length);
+        }
+        return true;
+    }
+
+    if (!event->isDirectory) {
+        return checkWatchedFile(state, event->name, depth);
+    }
+
+    // a directory moved away takes its files with it
+    if (event->type == WATCH_EVENT_REMOVED) {
+        unwatchSubtree(watcher, state->path.path, false);
+        return removeSubtreeMatches(watcher, state->path.path, false, writeRemovedMatch, state);
+    }
+
+    // new directories are searched under the same rules as in the first walk
+    if (event->type != WATCH_EVENT_CREATED || (isHidden(event->name) && !pArgs->setShowAll)) {
+        return true;
+    }
+    if (shouldPrune(pArgs, state->path.path, event->name, depth)) {
+        state->stats.directoriesPruned++;
+        return true;
+    }
+
+    return rescanWatchedDirectory(state, depth);
+}
+
+
+/** \brief Keep the results of the search up to date, until the base directory
+ *  disappears or an error occurs. Every change is written as a line,
+ *  "+ path" for a new match, "- path" for a removed one.
+ *
+ *  @param state - TraversalState whose walk filled the watcher
+ *  @param baseDirectory - path of the base directory
+ *  @return false when watching ends (a message is printed)
  */
-int sortByFilePath(const void *resultOne, const void *resultTwo)
+static bool followWatchedTree(TraversalState *state, char *baseDirectory)
 {
-    // case sensitive
-    return (strcmp(((Result *) resultOne)->filePath, ((Result *) resultTwo)->filePath));
+    TreeWatcher *watcher = state->watcher;
+    WatchEvent event;
+    bool success = true;
+
+    watcher->live = true;
+    while (success) {
+        // events are written once all that were read are handled
+        if (!watchEventsPending(watcher) && !flushOutput(&state->output)) {
+            return false;
+        }
+
+        if (!readWatchEvent(watcher, &event)) {
+            return false;
+        }
+
+        switch (event.type) {
+        case WATCH_EVENT_OVERFLOW:
+            // it's unknown which events were lost, the whole tree is compared
+            fprintf(stderr, "Events of the watched directories were lost, rescanning \'%s\'.\n",
+                    baseDirectory);
+            if (!setPath(&state->path, baseDirectory)) {
+                fprintf(stderr, "Couldn't allocate file path.\n");
+                success = false;
+                break;
+            }
+            success = rescanWatchedDirectory(state, 0);
+            break;
+        case WATCH_EVENT_GONE:
+            fprintf(stderr, "The directory \'%s\' was removed or moved, watching ends.\n", baseDirectory);
+            success = false;
+            break;
+        default:
+            success = handleWatchEvent(state, &event);
+            break;
+        }
+    }
+
+    flushOutput(&state->output);
+    return false;
 }
 
 
@@ -520,29 +1663,43 @@ int sortByFilePath(const void *resultOne, const void *resultTwo)
  * 
  *  @param pArgs - ParsedArguments structure
  *  @param res - Results structure, containing Result array and additional info
+ *  @return true on success
+ *          false on fail with memory allocation
  */
-static void sortResults(ParsedArguments *pArgs, Results *res)
+static bool sortResults(ParsedArguments *pArgs, Results *res)
 {
-    int (*sortType[]) (const void *, const void *) =
-            { sortByFileName, sortByFilePath, sortByFileSize };
-    qsort(res->resultsArray, res->arrayIndex, sizeof(Result), sortType[pArgs->sortType]);
+    // streamed results are not sorted (or they are in order already)
+    if (streamsResults(pArgs)) {
+        return true;
+    }
+
+    return sortResultArray(res->resultsArray, res->arrayIndex, pArgs->sortType, pArgs->threadCount);
 }
 
 
-/** \brief Print results on stdout
- * 
- *  @param pArgs - ParsedArguments structure
- *  @param res - Results structure, containing Result array and additional info
+/** \brief Write the (sorted) results in the format of the arguments, through
+ *  the output buffer of the state
+ *
+ *  @param state - TraversalState with the results
+ *  @return true if successful
+ *          false if a write error occurred
  */
-static void printResults(ParsedArguments *pArgs, Results *res)
+static bool printResults(TraversalState *state)
 {
-    Result *current = NULL;
+    ParsedArguments *pArgs = state->pArgs;
+    Results *res = &state->results;
+
     for (size_t i = 0; i < res->arrayIndex; i++) {
-        // points at element of array
-        current = res->resultsArray + i;
-        printf("%s", current->filePath);
-        putchar(pArgs->lineBreak);
+        Result *current = res->resultsArray + i;
+        OutputRecord record = { current->filePath, strlen(current->filePath),
+                (current->pattern != NO_PATTERN) ? pArgs->patterns.patterns[current->pattern] : NULL,
+                current->fileSize, current->fileMode, current->fileOwner };
+        if (!appendRecord(&state->output, &record, pArgs->outputFormat, pArgs->lineBreak)) {
+            return false;
+        }
     }
+
+    return flushOutput(&state->output);
 }
 
 
@@ -563,25 +1720,142 @@ bool find(ParsedArguments *pArgs)
         return true;
     }
 
-    Results results = initResults();
+    // decide which stat fields are needed before the traversal starts
+    pArgs->statFields = requiredStatFields(pArgs);
+    if (!compileFilters(pArgs)) {
+        return false;
+    }
+
+    TraversalState state = initTraversalState(pArgs);
     bool resultOfRecursion = false;
 
     // base dir not set, using current working dir
-    if (pArgs->startDirectory == NULL) {
-        resultOfRecursion = findRecursive(pArgs, ".", &results, 0);
+    char *baseDirectory = (pArgs->startDirectory == NULL) ? "." : pArgs->startDirectory;
+
+    // the tree is only written into the index, nothing is searched
+    if (pArgs->buildIndexPath != NULL) {
+        bool built = buildFileIndex(baseDirectory, pArgs->buildIndexPath, pArgs->useGetdents, &state.stats);
+        state.stats.searchTime = getMonotonicTime() - state.startTime;
+        if (pArgs->showStatistics) {
+            printStatistics(pArgs, &state);
+        }
+        freeTraversalState(&state);
+        return built;
+    }
+
+    // the index is refreshed, nothing is searched
+    if (pArgs->updateIndexPath != NULL) {
+        bool updated = updateFileIndex(pArgs->updateIndexPath, pArgs->startDirectory,
+                pArgs->useGetdents, &state.stats);
+        state.stats.searchTime = getMonotonicTime() - state.startTime;
+        if (updated) {
+            fprintf(stderr, "directories re-scanned: %zu\ndirectories reused: %zu\n",
+                    state.stats.directoriesRescanned, state.stats.directoriesReused);
+        }
+        if (pArgs->showStatistics) {
+            printStatistics(pArgs, &state);
+        }
+        freeTraversalState(&state);
+        return updated;
+    }
+
+    // directories given twice are dropped before anything is searched
+    StringList roots = { NULL, 0, 0 };
+    DirectoryIdentity *rootIdentities = NULL;
+    if (!selectStartDirectories(pArgs, &roots, &rootIdentities)) {
+        free(roots.items);
+        free(rootIdentities);
+        freeTraversalState(&state);
+        return false;
+    }
+    state.roots = rootIdentities;
+    state.rootCount = (rootIdentities != NULL) ? roots.count : 0;
+
+    // the watch mode remembers the watched directories and every match
+    TreeWatcher watcher;
+    if (pArgs->watch) {
+        if (!initTreeWatcher(&watcher)) {
+            free(roots.items);
+            free(rootIdentities);
+            freeTraversalState(&state);
+            return false;
+        }
+        state.watcher = &watcher;
+    }
+
+    // serial recursion is kept for a single thread (and for comparison)
+    if (pArgs->indexPath != NULL) {
+        resultOfRecursion = findInIndex(&state);
+    } else if (pArgs->threadCount > 1) {
+        resultOfRecursion = findParallel(&state, &roots);
+    } else if (state.watcher == NULL) {
+        resultOfRecursion = findSerial(&state, &roots);
+    } else if (!setPath(&state.path, baseDirectory)) {
+        fprintf(stderr, "Couldn't allocate file path.\n");
     } else {
-        // base dir set
-        resultOfRecursion = findRecursive(pArgs, pArgs->startDirectory, &results, 0);
+        // baseDirectory is opened before anything gets appended to the path
+        resultOfRecursion = watchAndRecurse(&state, AT_FDCWD, baseDirectory, 0, NULL);
+    }
+    uint64_t phaseStart = getMonotonicTime();
+    state.stats.searchTime = phaseStart - state.startTime;
+    if (state.trace != NULL) {
+        recordTraceEvent(state.trace, "search", NULL, 0, state.stats.searchTime);
     }
 
-    // if recursion succeeds, print sorted results
-    if (resultOfRecursion) {
-        sortResults(pArgs, &results);
-        printResults(pArgs, &results);
+    // if recursion succeeds, print sorted results (streamed results were printed already,
+    // only the rest of the buffer is written)
+    if (resultOfRecursion && streamsResults(pArgs)) {
+        resultOfRecursion = flushOutput(&state.output);
+        state.stats.outputTime = getMonotonicTime() - phaseStart;
+        if (state.trace != NULL) {
+            recordTraceEvent(state.trace, "output", NULL, state.stats.searchTime,
+                    state.stats.searchTime + state.stats.outputTime);
+        }
+    } else if (resultOfRecursion) {
+        resultOfRecursion = sortResults(pArgs, &state.results);
+        state.stats.sortTime = getMonotonicTime() - phaseStart;
+        if (state.trace != NULL) {
+            recordTraceEvent(state.trace, "sort", NULL, state.stats.searchTime,
+                    state.stats.searchTime + state.stats.sortTime);
+        }
+        if (!resultOfRecursion) {
+            fprintf(stderr, "Couldn't allocate memory for sorting.\n");
+        } else {
+            phaseStart = getMonotonicTime();
+            if (state.results.arrayIndex > 0) {
+                state.stats.firstResultTime = phaseStart - state.startTime;
+            }
+            resultOfRecursion = printResults(&state);
+            state.stats.outputTime = getMonotonicTime() - phaseStart;
+            if (state.trace != NULL) {
+                recordTraceEvent(state.trace, "output", NULL, phaseStart - state.startTime,
+                        phaseStart - state.startTime + state.stats.outputTime);
+            }
+        }
+    }
+
+    // the events of all threads were merged into the main one
+    if (pArgs->tracePath != NULL && !writeTraceFile(pArgs->tracePath, state.trace)) {
+        resultOfRecursion = false;
+    }
+
+    if (pArgs->showStatistics) {
+        printStatistics(pArgs, &state);
+    }
+
+    // the results are kept up to date until watching ends
+    if (resultOfRecursion && state.watcher != NULL) {
+        fflush(stdout);
+        resultOfRecursion = followWatchedTree(&state, baseDirectory);
     }
 
     // release memory
-    freeResults(&results);
+    if (state.watcher != NULL) {
+        freeTreeWatcher(state.watcher);
+    }
+    free(roots.items);
+    free(rootIdentities);
+    freeTraversalState(&state);
     // return result
     return resultOfRecursion;
 }
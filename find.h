@@ -1,7 +1,6 @@
 #include "userStructures.h"
 #include <dirent.h>
 #include <errno.h>
-#include <pwd.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
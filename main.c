@@ -10,15 +10,15 @@ int main(int argc, char *argv[])
 
     // check if the arguments can be parsed
     if (!parseArguments(&pArgs, argc, argv)) {
+        freeParsedArguments(&pArgs);
         return EXIT_FAILURE;
     }
 
     // check if the find algorithm no errors (dynamic allocation)
     // also prints results / error messages.
-    if (!find(&pArgs)) {
-        return EXIT_FAILURE;
-    }
+    bool success = find(&pArgs);
+    freeParsedArguments(&pArgs);
 
-    // no error occurred
-    return EXIT_SUCCESS;
+    // no error occurred if successful
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,313 @@
+#include "nameMatcher.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef NAME_MATCHER_X86
+#include <immintrin.h>
+
+// loads within one page never fault (4 KiB is the smallest page on x86)
+#define NAME_MATCHER_PAGE_SIZE 4096
+#endif
+
+
+/** \brief Empty pattern is present in every name
+ *
+ *  @return true
+ */
+static bool matchEmpty(const NameMatcher *matcher, const char *name, size_t length)
+{
+    (void) matcher;
+    (void) name;
+    (void) length;
+    return true;
+}
+
+
+/** \brief Search by strstr, the pattern isn't preprocessed at all
+ *
+ *  @param matcher - NameMatcher structure
+ *  @param name - name of the file
+ *  @param length - length of the name (unused)
+ *  @return true if the pattern is present within the name
+ */
+static bool matchStrstr(const NameMatcher *matcher, const char *name, size_t length)
+{
+    (void) length;
+    return (strstr(name, matcher->needle) != NULL);
+}
+
+
+/** \brief Check candidate positions one by one, the middle of the pattern is
+ *  only compared when both its first and last byte match
+ *
+ *  @param matcher - NameMatcher structure
+ *  @param name - name of the file
+ *  @param position - first candidate position
+ *  @param lastPosition - last position the pattern can start at
+ *  @return true if the pattern starts at one of the positions
+ */
+static bool matchScalarFrom(const NameMatcher *matcher, const char *name,
+        size_t position, size_t lastPosition)
+{
+    const unsigned char *bytes = (const unsigned char *) name;
+    size_t lastOffset = matcher->length - 1;
+
+    for (; position <= lastPosition; position++) {
+        if (bytes[position] == matcher->first && bytes[position + lastOffset] == matcher->last
+                && memcmp(name + position + 1, matcher->needle + 1, lastOffset) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** \brief Scalar search over the whole name
+ *
+ *  @param matcher - NameMatcher structure
+ *  @param name - name of the file
+ *  @param length - length of the name
+ *  @return true if the pattern is present within the name
+ */
+static bool matchScalar(const NameMatcher *matcher, const char *name, size_t length)
+{
+    if (length < matcher->length) {
+        return false;
+    }
+
+    return matchScalarFrom(matcher, name, 0, length - matcher->length);
+}
+
+
+#ifdef NAME_MATCHER_X86
+
+/** \brief Verify candidate positions of one block, bit i of the mask
+ *  means that the first and last byte match at position + i
+ *
+ *  @param matcher - NameMatcher structure
+ *  @param name - name of the file
+ *  @param position - position of the block
+ *  @param mask - candidate positions within the block
+ *  @return true if the pattern starts at one of the candidates
+ */
+static inline bool verifyCandidates(const NameMatcher *matcher, const char *name,
+        size_t position, uint32_t mask)
+{
+    // the first byte is already known to match, the last one is compared again (cheap)
+    while (mask != 0) {
+        size_t candidate = position + (size_t) __builtin_ctz(mask);
+        if (memcmp(name + candidate + 1, matcher->needle + 1, matcher->length - 1) == 0) {
+            return true;
+        }
+        mask &= mask - 1;
+    }
+
+    return false;
+}
+
+
+/** \brief Determine if an unaligned load of a block can't fault, i.e. it
+ *  doesn't cross into the next page. Such a load may read bytes behind the end
+ *  of the name, candidates found there are masked out (the same way the
+ *  vectorized string functions of C libraries work).
+ *
+ *  @param address - start of the load
+ *  @param size - size of the block
+ *  @return true if the whole block lies within one page
+ */
+static inline bool withinPage(const char *address, size_t size)
+{
+    return ((uintptr_t) address % NAME_MATCHER_PAGE_SIZE) <= NAME_MATCHER_PAGE_SIZE - size;
+}
+
+
+/** \brief SSE2 search, 16 candidate positions are filtered by the first
+ *  and last byte of the pattern at once. The last (partial) block is only
+ *  loaded when it stays within a page, otherwise the scalar loop finishes the search.
+ *
+ *  @param matcher - NameMatcher structure
+ *  @param name - name of the file
+ *  @param length - length of the name
+ *  @return true if the pattern is present within the name
+ */
+__attribute__((target("sse2")))
+static bool matchSse2(const NameMatcher *matcher, const char *name, size_t length)
+{
+    if (length < matcher->length) {
+        return false;
+    }
+
+    size_t lastPosition = length - matcher->length;
+    size_t lastOffset = matcher->length - 1;
+    const __m128i first = _mm_set1_epi8((char) matcher->first);
+    const __m128i last = _mm_set1_epi8((char) matcher->last);
+
+    for (size_t position = 0; position <= lastPosition; position += 16) {
+        uint32_t valid = 0xFFFF;
+
+        // partial block, positions past lastPosition are masked out
+        if (lastPosition - position < 15) {
+            if (!withinPage(name + position, 16) || !withinPage(name + position + lastOffset, 16)) {
+                return matchScalarFrom(matcher, name, position, lastPosition);
+            }
+            valid = (1u << (lastPosition - position + 1)) - 1;
+        }
+
+        __m128i blockFirst = _mm_loadu_si128((const __m128i *) (name + position));
+        __m128i blockLast = _mm_loadu_si128((const __m128i *) (name + position + lastOffset));
+        __m128i matches = _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+                _mm_cmpeq_epi8(last, blockLast));
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(matches) & valid;
+
+        if (mask != 0 && verifyCandidates(matcher, name, position, mask)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** \brief AVX2 search, same as the SSE2 one with 32 positions at once
+ *
+ *  @param matcher - NameMatcher structure
+ *  @param name - name of the file
+ *  @param length - length of the name
+ *  @return true if the pattern is present within the name
+ */
+__attribute__((target("avx2")))
+static bool matchAvx2(const NameMatcher *matcher, const char *name, size_t length)
+{
+    if (length < matcher->length) {
+        return false;
+    }
+
+    size_t lastPosition = length - matcher->length;
+    size_t lastOffset = matcher->length - 1;
+    const __m256i first = _mm256_set1_epi8((char) matcher->first);
+    const __m256i last = _mm256_set1_epi8((char) matcher->last);
+
+    for (size_t position = 0; position <= lastPosition; position += 32) {
+        uint32_t valid = 0xFFFFFFFF;
+
+        // partial block, positions past lastPosition are masked out
+        if (lastPosition - position < 31) {
+            if (!withinPage(name + position, 32) || !withinPage(name + position + lastOffset, 32)) {
+                return matchScalarFrom(matcher, name, position, lastPosition);
+            }
+            valid = (1u << (lastPosition - position + 1)) - 1;
+        }
+
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i *) (name + position));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i *) (name + position + lastOffset));
+        __m256i matches = _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst),
+                _mm256_cmpeq_epi8(last, blockLast));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(matches) & valid;
+
+        if (mask != 0 && verifyCandidates(matcher, name, position, mask)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif
+
+
+/** \brief Determine if the CPU can run an implementation (checked at runtime)
+ *
+ *  @param method - implementation
+ *  @return true if the method can be used
+ */
+bool nameMatchMethodSupported(NameMatchMethod method)
+{
+    switch (method) {
+    case NAME_MATCH_AUTO:
+    case NAME_MATCH_STRSTR:
+    case NAME_MATCH_SCALAR:
+        return true;
+#ifdef NAME_MATCHER_X86
+    case NAME_MATCH_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case NAME_MATCH_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+
+/** \brief Get a printable name of an implementation
+ *
+ *  @param method - implementation
+ *  @return name of the method
+ */
+const char *nameMatchMethodName(NameMatchMethod method)
+{
+    const char *names[] = { "auto", "strstr", "scalar", "sse2", "avx2" };
+    return (method < NAME_MATCH_COUNT) ? names[method] : "unknown";
+}
+
+
+/** \brief Pick the fastest implementation the CPU supports. AVX2 beats strstr
+ *  on file names (see bench/nameMatcherBench.c), SSE2 is only on par with it
+ *  and the scalar one is slower, so strstr is used without AVX2.
+ *
+ *  @return the method
+ */
+static NameMatchMethod fastestMethod()
+{
+    if (nameMatchMethodSupported(NAME_MATCH_AVX2)) {
+        return NAME_MATCH_AVX2;
+    }
+    return NAME_MATCH_STRSTR;
+}
+
+
+/** \brief Preprocess a pattern and pick the implementation
+ *
+ *  @param matcher - NameMatcher structure that's initialized
+ *  @param needle - the pattern (it has to outlive the matcher)
+ *  @param method - implementation used, NAME_MATCH_AUTO or an unsupported
+ *                 method picks the fastest supported one
+ */
+void initNameMatcher(NameMatcher *matcher, const char *needle, NameMatchMethod method)
+{
+    matcher->needle = needle;
+    matcher->length = strlen(needle);
+    matcher->first = (unsigned char) needle[0];
+    matcher->last = (matcher->length > 0) ? (unsigned char) needle[matcher->length - 1] : 0;
+
+    if (method == NAME_MATCH_AUTO || !nameMatchMethodSupported(method)) {
+        method = fastestMethod();
+    }
+    matcher->method = method;
+
+    // all of the byte filtering implementations need at least one byte
+    if (matcher->length == 0) {
+        matcher->match = matchEmpty;
+        return;
+    }
+
+    switch (method) {
+    case NAME_MATCH_STRSTR:
+        matcher->match = matchStrstr;
+        break;
+#ifdef NAME_MATCHER_X86
+    case NAME_MATCH_SSE2:
+        matcher->match = matchSse2;
+        break;
+    case NAME_MATCH_AVX2:
+        matcher->match = matchAvx2;
+        break;
+#endif
+    default:
+        matcher->match = matchScalar;
+        break;
+    }
+}
@@ -0,0 +1,92 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef NAME_MATCHER_DEFINED
+#define NAME_MATCHER_DEFINED
+
+// SSE2 / AVX2 matchers are only compiled for x86 with gcc compatible compilers
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define NAME_MATCHER_X86
+#endif
+
+
+// implementations of the substring search
+typedef enum
+{
+    // the fastest one the CPU supports
+    NAME_MATCH_AUTO,
+    // plain strstr from the C library
+    NAME_MATCH_STRSTR,
+    // first and last byte filtering, byte by byte
+    NAME_MATCH_SCALAR,
+    // first and last byte filtering, 16 positions at once
+    NAME_MATCH_SSE2,
+    // first and last byte filtering, 32 positions at once
+    NAME_MATCH_AVX2,
+    NAME_MATCH_COUNT
+} NameMatchMethod;
+
+
+typedef struct NameMatcher NameMatcher;
+
+
+// search function of one implementation, length is the length of the name
+typedef bool (*NameMatchFunction)(const NameMatcher *matcher, const char *name, size_t length);
+
+
+// substring pattern preprocessed for repeated searching
+struct NameMatcher
+{
+    // the pattern and its length
+    const char *needle;
+    size_t length;
+
+    // first and last byte of the pattern, candidates are filtered by them
+    unsigned char first;
+    unsigned char last;
+
+    // implementation picked while initializing
+    NameMatchMethod method;
+    NameMatchFunction match;
+};
+
+
+/** \brief Preprocess a pattern, the pattern is not copied
+ *
+ *  @param matcher - NameMatcher structure that's initialized
+ *  @param needle - the pattern
+ *  @param method - implementation used, NAME_MATCH_AUTO picks the fastest
+ *                 supported one (unsupported methods fall back to it as well)
+ */
+void initNameMatcher(NameMatcher *matcher, const char *needle, NameMatchMethod method);
+
+
+/** \brief Determine if the pattern is a substring of the name
+ *
+ *  @param matcher - NameMatcher structure
+ *  @param name - name of the file (correct string)
+ *  @param length - length of the name
+ *  @return true if the pattern is present within the name
+ */
+static inline bool matchName(const NameMatcher *matcher, const char *name, size_t length)
+{
+    return matcher->match(matcher, name, length);
+}
+
+
+/** \brief Determine if the CPU can run an implementation
+ *
+ *  @param method - implementation
+ *  @return true if the method can be used
+ */
+bool nameMatchMethodSupported(NameMatchMethod method);
+
+
+/** \brief Get a printable name of an implementation
+ *
+ *  @param method - implementation
+ *  @return name of the method
+ */
+const char *nameMatchMethodName(NameMatchMethod method);
+
+#endif
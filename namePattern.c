@@ -0,0 +1,1145 @@
+#include "namePattern.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// missing NFA state (after a failed allocation)
+#define NO_NFA_STATE (-1)
+
+// patterns that would need more DFA states are refused
+const size_t MAX_DFA_STATES = 4096;
+// size of the table used to find already known DFA states (power of 2, > 2 * MAX_DFA_STATES)
+const size_t DFA_HASH_SIZE = 16384;
+// initial number of NFA states / byte sets, they're doubled when needed
+const size_t NFA_INITIAL_SIZE = 64;
+// largest count of an interval "{m,n}" (RE_DUP_MAX of POSIX)
+const size_t MAX_INTERVAL_COUNT = 255;
+
+
+// set of bytes, one bit per byte
+typedef struct
+{
+    uint64_t bits[4];
+} ByteSet;
+
+
+// state of the NFA, it has either a byte transition, an anchor or up to two epsilon transitions
+typedef struct
+{
+    // index of the ByteSet of the byte transition, -1 = only epsilon transitions
+    int byteSet;
+    // '^' or '$' for an epsilon transition (to next) that's only taken at the start
+    // or at the end of the name, 0 otherwise
+    char anchor;
+    // target of the byte transition (or of the anchor)
+    int next;
+    // targets of the epsilon transitions
+    int epsilon[2];
+    int epsilonCount;
+} NfaState;
+
+
+// part of the NFA built from a part of the pattern, it has one entry and one exit
+typedef struct
+{
+    int start;
+    int end;
+} Fragment;
+
+
+// everything needed while the pattern is parsed into an NFA
+typedef struct
+{
+    NfaState *states;
+    size_t count;
+    size_t allocatedSize;
+
+    ByteSet *sets;
+    size_t setCount;
+    size_t setAllocatedSize;
+
+    // the pattern that's parsed and its length
+    const char *text;
+    size_t length;
+    size_t position;
+
+    bool ignoreCase;
+    // description of the first error, NULL if there's none
+    const char *error;
+} NfaBuilder;
+
+
+/** \brief Add a byte into the set
+ *
+ *  @param set - ByteSet structure
+ *  @param byte - the byte
+ */
+static inline void addByte(ByteSet *set, unsigned char byte)
+{
+    set->bits[byte >> 6] |= (uint64_t) 1 << (byte & 63);
+}
+
+
+/** \brief Determine if the set contains a byte
+ *
+ *  @param set - ByteSet structure
+ *  @param byte - the byte
+ *  @return true if the byte is in the set
+ */
+static inline bool containsByte(const ByteSet *set, unsigned char byte)
+{
+    return (set->bits[byte >> 6] >> (byte & 63)) & 1;
+}
+
+
+/** \brief Add the other case of every (ASCII) letter of the set
+ *
+ *  @param set - ByteSet structure
+ */
+static void addCaseVariants(ByteSet *set)
+{
+    for (int letter = 'a'; letter <= 'z'; letter++) {
+        if (containsByte(set, letter) || containsByte(set, toupper(letter))) {
+            addByte(set, letter);
+            addByte(set, toupper(letter));
+        }
+    }
+}
+
+
+/** \brief Lowercase an ASCII letter, other bytes are returned as they are
+ *
+ *  @param byte - the byte
+ *  @return lowercase byte
+ */
+static inline unsigned char asciiLower(unsigned char byte)
+{
+    return (byte >= 'A' && byte <= 'Z') ? byte + ('a' - 'A') : byte;
+}
+
+
+/** \brief Add a new NFA state without transitions
+ *
+ *  @param builder - NfaBuilder structure
+ *  @return index of the state, NO_NFA_STATE if the allocation failed
+ */
+static int addNfaState(NfaBuilder *builder)
+{
+    if (builder->error != NULL) {
+        return NO_NFA_STATE;
+    }
+
+    if (builder->count == builder->allocatedSize) {
+        size_t newSize = (builder->allocatedSize == 0) ? NFA_INITIAL_SIZE : builder->allocatedSize * 2;
+        NfaState *reallocated = realloc(builder->states, newSize * sizeof(NfaState));
+        if (reallocated == NULL) {
+            builder->error = "out of memory";
+            return NO_NFA_STATE;
+        }
+        builder->states = reallocated;
+        builder->allocatedSize = newSize;
+    }
+
+    NfaState *state = builder->states + builder->count;
+    state->byteSet = -1;
+    state->anchor = 0;
+    state->next = NO_NFA_STATE;
+    state->epsilonCount = 0;
+    return (int) builder->count++;
+}
+
+
+/** \brief Add an epsilon transition (nothing happens after a previous fail)
+ *
+ *  @param builder - NfaBuilder structure
+ *  @param from - source state
+ *  @param to - target state
+ */
+static void addEpsilon(NfaBuilder *builder, int from, int to)
+{
+    if (builder->error != NULL || from == NO_NFA_STATE || to == NO_NFA_STATE) {
+        return;
+    }
+
+    NfaState *state = builder->states + from;
+    state->epsilon[state->epsilonCount++] = to;
+}
+
+
+/** \brief Fragment matching one byte of the set
+ *
+ *  @param builder - NfaBuilder structure
+ *  @param set - accepted bytes
+ *  @return the fragment
+ */
+static Fragment byteFragment(NfaBuilder *builder, const ByteSet *set)
+{
+    Fragment fragment = { NO_NFA_STATE, NO_NFA_STATE };
+
+    if (builder->error == NULL && builder->setCount == builder->setAllocatedSize) {
+        size_t newSize = (builder->setAllocatedSize == 0) ? NFA_INITIAL_SIZE : builder->setAllocatedSize * 2;
+        ByteSet *reallocated = realloc(builder->sets, newSize * sizeof(ByteSet));
+        if (reallocated == NULL) {
+            builder->error = "out of memory";
+            return fragment;
+        }
+        builder->sets = reallocated;
+        builder->setAllocatedSize = newSize;
+    }
+
+    fragment.start = addNfaState(builder);
+    fragment.end = addNfaState(builder);
+    if (builder->error != NULL) {
+        return fragment;
+    }
+
+    builder->sets[builder->setCount] = *set;
+    builder->states[fragment.start].byteSet = (int) builder->setCount++;
+    builder->states[fragment.start].next = fragment.end;
+    return fragment;
+}
+
+
+/** \brief Fragment matching one literal byte
+ *
+ *  @param builder - NfaBuilder structure (its ignoreCase is applied)
+ *  @param byte - the byte
+ *  @return the fragment
+ */
+static Fragment literalFragment(NfaBuilder *builder, unsigned char byte)
+{
+    ByteSet set;
+    memset(&set, 0, sizeof(ByteSet));
+    addByte(&set, byte);
+    if (builder->ignoreCase) {
+        addCaseVariants(&set);
+    }
+    return byteFragment(builder, &set);
+}
+
+
+/** \brief Fragment matching any byte
+ *
+ *  @param builder - NfaBuilder structure
+ *  @return the fragment
+ */
+static Fragment anyByteFragment(NfaBuilder *builder)
+{
+    ByteSet set;
+    memset(&set, 0xFF, sizeof(ByteSet));
+    return byteFragment(builder, &set);
+}
+
+
+/** \brief Fragment matching the empty string at the start or at the end of the name
+ *
+ *  @param builder - NfaBuilder structure
+ *  @param anchor - '^' (start) or '$' (end)
+ *  @return the fragment
+ */
+static Fragment anchorFragment(NfaBuilder *builder, char anchor)
+{
+    Fragment fragment = { addNfaState(builder), addNfaState(builder) };
+    if (builder->error == NULL) {
+        builder->states[fragment.start].anchor = anchor;
+        builder->states[fragment.start].next = fragment.end;
+    }
+    return fragment;
+}
+
+
+/** \brief Fragment matching the empty string
+ *
+ *  @param builder - NfaBuilder structure
+ *  @return the fragment
+ */
+static Fragment emptyFragment(NfaBuilder *builder)
+{
+    int state = addNfaState(builder);
+    Fragment fragment = { state, state };
+    return fragment;
+}
+
+
+/** \brief Fragment matching first followed by second
+ *
+ *  @param builder - NfaBuilder structure
+ *  @param first - Fragment structure
+ *  @param second - Fragment structure
+ *  @return the fragment
+ */
+static Fragment concatFragments(NfaBuilder *builder, Fragment first, Fragment second)
+{
+    addEpsilon(builder, first.end, second.start);
+    Fragment fragment = { first.start, second.end };
+    return fragment;
+}
+
+
+/** \brief Fragment matching either first or second
+ *
+ *  @param builder - NfaBuilder structure
+ *  @param first - Fragment structure
+ *  @param second - Fragment structure
+ *  @return the fragment
+ */
+static Fragment alternateFragments(NfaBuilder *builder, Fragment first, Fragment second)
+{
+    Fragment fragment = { addNfaState(builder), addNfaState(builder) };
+    addEpsilon(builder, fragment.start, first.start);
+    addEpsilon(builder, fragment.start, second.start);
+    addEpsilon(builder, first.end, fragment.end);
+    addEpsilon(builder, second.end, fragment.end);
+    return fragment;
+}
+
+
+/** \brief Fragment repeating another one
+ *
+ *  @param builder - NfaBuilder structure
+ *  @param repeated - Fragment structure
+ *  @param operator - '*' (any number of times), '+' (at least once), '?' (at most once)
+ *  @return the fragment
+ */
+static Fragment repeatFragment(NfaBuilder *builder, Fragment repeated, char operator)
+{
+    Fragment fragment = { repeated.start, addNfaState(builder) };
+
+    if (operator != '+') {
+        fragment.start = addNfaState(builder);
+        addEpsilon(builder, fragment.start, repeated.start);
+        addEpsilon(builder, fragment.start, fragment.end);
+    }
+
+    if (operator != '?') {
+        addEpsilon(builder, repeated.end, repeated.start);
+    }
+    addEpsilon(builder, repeated.end, fragment.end);
+    return fragment;
+}
+
+
+/** \brief Get the byte at the current position of the pattern
+ *
+ *  @param builder - NfaBuilder structure
+ *  @return the byte, '\0' at the end of the pattern
+ */
+static inline char peek(NfaBuilder *builder)
+{
+    return (builder->position < builder->length) ? builder->text[builder->position] : '\0';
+}
+
+
+/** \brief Add bytes of a named class ("[:alpha:]" etc.) into the set
+ *
+ *  @param set - ByteSet structure
+ *  @param name - name of the class
+ *  @param length - length of the name
+ *  @return true if the class is known
+ */
+static bool addNamedClass(ByteSet *set, const char *name, size_t length)
+{
+    const char *names[] = { "alpha", "digit", "alnum", "upper", "lower", "space", "punct", "xdigit" };
+    int (*tests[])(int) = { isalpha, isdigit, isalnum, isupper, islower, isspace, ispunct, isxdigit };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strlen(names[i]) == length && strncmp(names[i], name, length) == 0) {
+            for (int byte = 0; byte < 128; byte++) {
+                if (tests[i](byte)) {
+                    addByte(set, (unsigned char) byte);
+                }
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** \brief Parse a bracket expression, the position is just after '['
+ *
+ *  @param builder - NfaBuilder structure
+ *  @param glob - '!' negates the set as well (glob syntax)
+ *  @return fragment matching one byte of the bracket expression
+ */
+static Fragment parseBracket(NfaBuilder *builder, bool glob)
+{
+    ByteSet set;
+    memset(&set, 0, sizeof(ByteSet));
+    bool negated = false;
+
+    if (peek(builder) == '^' || (glob && peek(builder) == '!')) {
+        negated = true;
+        builder->position++;
+    }
+
+    // ']' right at the start is a literal
+    bool first = true;
+    while (first || peek(builder) != ']') {
+        char current = peek(builder);
+        first = false;
+
+        if (current == '\0') {
+            builder->error = "unterminated bracket expression";
+            return emptyFragment(builder);
+        }
+
+        // named class
+        if (current == '[' && builder->position + 1 < builder->length
+                && builder->text[builder->position + 1] == ':') {
+            const char *name = builder->text + builder->position + 2;
+            const char *end = strstr(name, ":]");
+            if (end == NULL || end >= builder->text + builder->length
+                    || !addNamedClass(&set, name, (size_t) (end - name))) {
+                builder->error = "unknown character class";
+                return emptyFragment(builder);
+            }
+            builder->position = (size_t) (end - builder->text) + 2;
+            continue;
+        }
+
+        // escaped byte
+        if (current == '\\' && builder->position + 1 < builder->length) {
+            builder->position++;
+            current = peek(builder);
+        }
+        builder->position++;
+
+        unsigned char low = (unsigned char) current;
+        unsigned char high = low;
+
+        // range
+        if (peek(builder) == '-' && builder->position + 1 < builder->length
+                && builder->text[builder->position + 1] != ']') {
+            builder->position++;
+            if (peek(builder) == '\\' && builder->position + 1 < builder->length) {
+                builder->position++;
+            }
+            high = (unsigned char) peek(builder);
+            builder->position++;
+
+            if (high < low) {
+                builder->error = "invalid range in bracket expression";
+                return emptyFragment(builder);
+            }
+        }
+
+        for (unsigned int byte = low; byte <= high; byte++) {
+            addByte(&set, (unsigned char) byte);
+        }
+    }
+
+    // skip ']'
+    builder->position++;
+
+    if (builder->ignoreCase) {
+        addCaseVariants(&set);
+    }
+
+    if (negated) {
+        for (int i = 0; i < 4; i++) {
+            set.bits[i] = ~set.bits[i];
+        }
+    }
+
+    return byteFragment(builder, &set);
+}
+
+
+static Fragment parseAlternation(NfaBuilder *builder);
+
+
+/** \brief Parse one atom of a regular expression
+ *
+ *  @param builder - NfaBuilder structure
+ *  @return the fragment
+ */
+static Fragment parseAtom(NfaBuilder *builder)
+{
+    char current = peek(builder);
+    builder->position++;
+
+    switch (current) {
+    case '(': {
+        Fragment fragment = parseAlternation(builder);
+        if (peek(builder) != ')') {
+            builder->error = "missing ')'";
+        }
+        builder->position++;
+        return fragment;
+    }
+    case '[':
+        return parseBracket(builder, false);
+    case '.':
+        return anyByteFragment(builder);
+    case '^':
+    case '$':
+        return anchorFragment(builder, current);
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+        builder->error = "nothing to repeat";
+        return emptyFragment(builder);
+    case '\\':
+        if (peek(builder) == '\0') {
+            builder->error = "trailing backslash";
+            return emptyFragment(builder);
+        }
+        return literalFragment(builder, (unsigned char) builder->text[builder->position++]);
+    default:
+        return literalFragment(builder, (unsigned char) current);
+    }
+}
+
+
+static Fragment parseRepeat(NfaBuilder *builder);
+
+
+/** \brief Parse a number of an interval
+ *
+ *  @param builder - NfaBuilder structure, the position is moved after the digits
+ *  @param number - the number is stored here
+ *  @return true if there was a number (not larger than MAX_INTERVAL_COUNT)
+ */
+static bool parseIntervalCount(NfaBuilder *builder, size_t *number)
+{
+    size_t start = builder->position;
+    *number = 0;
+
+    while (isdigit((unsigned char) peek(builder))) {
+        if (*number <= MAX_INTERVAL_COUNT) {
+            *number = *number * 10 + (size_t) (peek(builder) - '0');
+        }
+        builder->position++;
+    }
+
+    return builder->position > start && *number <= MAX_INTERVAL_COUNT;
+}
+
+
+/** \brief Parse an interval "{m}", "{m,}" or "{m,n}" and repeat the fragment.
+ *  Every copy is a new part of the NFA, so the repeated part of the pattern
+ *  is parsed once more for each of them.
+ *
+ *  @param builder - NfaBuilder structure, the position is at '{'
+ *  @param fragment - the repeated fragment (its first copy)
+ *  @param atomStart - position the repeated part of the pattern starts at
+ *  @return the fragment
+ */
+static Fragment parseInterval(NfaBuilder *builder, Fragment fragment, size_t atomStart)
+{
+    size_t atomEnd = builder->position;
+    size_t min = 0;
+    size_t max = 0;
+    bool unbounded = false;
+
+    builder->position++;
+    bool valid = parseIntervalCount(builder, &min);
+    if (valid && peek(builder) == ',') {
+        builder->position++;
+        unbounded = !isdigit((unsigned char) peek(builder));
+        valid = unbounded || (parseIntervalCount(builder, &max) && max >= min);
+    } else {
+        max = min;
+    }
+    if (!valid || peek(builder) != '}') {
+        builder->error = "invalid interval";
+        return fragment;
+    }
+    size_t intervalEnd = builder->position + 1;
+
+    // x{m,} is m - 1 copies and x+ (x* for m = 0), x{m,n} is m copies and n - m optional ones
+    size_t copies = unbounded ? ((min == 0) ? 1 : min) : max;
+    size_t length = builder->length;
+    Fragment repeated = emptyFragment(builder);
+
+    for (size_t i = 0; i < copies && builder->error == NULL; i++) {
+        Fragment copy = fragment;
+        if (i > 0) {
+            // the repeated part ends before the interval, its own operators are parsed again
+            builder->position = atomStart;
+            builder->length = atomEnd;
+            copy = parseRepeat(builder);
+            builder->length = length;
+        }
+
+        if (unbounded && i == copies - 1) {
+            copy = repeatFragment(builder, copy, (min == 0) ? '*' : '+');
+        } else if (i >= min) {
+            copy = repeatFragment(builder, copy, '?');
+        }
+        repeated = concatFragments(builder, repeated, copy);
+    }
+
+    builder->position = intervalEnd;
+    return repeated;
+}
+
+
+/** \brief Parse an atom followed by any number of repetition operators
+ *
+ *  @param builder - NfaBuilder structure
+ *  @return the fragment
+ */
+static Fragment parseRepeat(NfaBuilder *builder)
+{
+    size_t atomStart = builder->position;
+    Fragment fragment = parseAtom(builder);
+
+    while (builder->error == NULL) {
+        if (peek(builder) == '*' || peek(builder) == '+' || peek(builder) == '?') {
+            fragment = repeatFragment(builder, fragment, peek(builder));
+            builder->position++;
+        } else if (peek(builder) == '{') {
+            fragment = parseInterval(builder, fragment, atomStart);
+        } else {
+            break;
+        }
+    }
+
+    return fragment;
+}
+
+
+/** \brief Parse a sequence of atoms (until '|', ')' or the end)
+ *
+ *  @param builder - NfaBuilder structure
+ *  @return the fragment
+ */
+static Fragment parseConcat(NfaBuilder *builder)
+{
+    Fragment fragment = emptyFragment(builder);
+
+    while (builder->error == NULL && peek(builder) != '\0' && peek(builder) != '|' && peek(builder) != ')') {
+        fragment = concatFragments(builder, fragment, parseRepeat(builder));
+    }
+
+    return fragment;
+}
+
+
+/** \brief Parse alternatives separated by '|'
+ *
+ *  @param builder - NfaBuilder structure
+ *  @return the fragment
+ */
+static Fragment parseAlternation(NfaBuilder *builder)
+{
+    Fragment fragment = parseConcat(builder);
+
+    while (builder->error == NULL && peek(builder) == '|') {
+        builder->position++;
+        fragment = alternateFragments(builder, fragment, parseConcat(builder));
+    }
+
+    return fragment;
+}
+
+
+/** \brief Parse a glob, it's anchored at both ends
+ *
+ *  @param builder - NfaBuilder structure
+ *  @return the fragment
+ */
+static Fragment parseGlob(NfaBuilder *builder)
+{
+    Fragment fragment = emptyFragment(builder);
+
+    while (builder->error == NULL && peek(builder) != '\0') {
+        char current = peek(builder);
+        builder->position++;
+
+        if (current == '*') {
+            fragment = concatFragments(builder, fragment,
+                    repeatFragment(builder, anyByteFragment(builder), '*'));
+        } else if (current == '?') {
+            fragment = concatFragments(builder, fragment, anyByteFragment(builder));
+        } else if (current == '[') {
+            fragment = concatFragments(builder, fragment, parseBracket(builder, true));
+        } else {
+            // escaped byte (trailing backslash is a literal)
+            if (current == '\\' && peek(builder) != '\0') {
+                current = peek(builder);
+                builder->position++;
+            }
+            fragment = concatFragments(builder, fragment, literalFragment(builder, (unsigned char) current));
+        }
+    }
+
+    return fragment;
+}
+
+
+/** \brief Add states reachable by epsilon transitions into the set
+ *
+ *  @param builder - NfaBuilder structure
+ *  @param set - bitset of NFA states
+ *  @param stack - memory for at least builder->count states
+ *  @param atStart - '^' anchors are passed (nothing was read yet)
+ *  @param atEnd - '$' anchors are passed (the name ends here)
+ */
+static void epsilonClosure(NfaBuilder *builder, uint64_t *set, int *stack, bool atStart, bool atEnd)
+{
+    size_t top = 0;
+
+    for (size_t state = 0; state < builder->count; state++) {
+        if ((set[state >> 6] >> (state & 63)) & 1) {
+            stack[top++] = (int) state;
+        }
+    }
+
+    while (top > 0) {
+        NfaState *state = builder->states + stack[--top];
+        int targets[3];
+        int targetCount = 0;
+        for (int i = 0; i < state->epsilonCount; i++) {
+            targets[targetCount++] = state->epsilon[i];
+        }
+        if ((state->anchor == '^' && atStart) || (state->anchor == '$' && atEnd)) {
+            targets[targetCount++] = state->next;
+        }
+
+        for (int i = 0; i < targetCount; i++) {
+            int target = targets[i];
+            if (!((set[target >> 6] >> (target & 63)) & 1)) {
+                set[target >> 6] |= (uint64_t) 1 << (target & 63);
+                stack[top++] = target;
+            }
+        }
+    }
+}
+
+
+/** \brief Split bytes into classes, bytes of one class belong to exactly the
+ *  same byte sets, so the DFA doesn't have to tell them apart
+ *
+ *  @param pattern - NamePattern structure (its classes are filled)
+ *  @param builder - NfaBuilder structure
+ *  @param representatives - first byte of every class is stored here
+ */
+static void buildByteClasses(NamePattern *pattern, NfaBuilder *builder, unsigned char *representatives)
+{
+    memset(pattern->byteClass, 0, sizeof(pattern->byteClass));
+    size_t classCount = 1;
+
+    // every set splits the classes into bytes inside and outside of it
+    for (size_t i = 0; i < builder->setCount; i++) {
+        int16_t remap[2][256];
+        memset(remap, 0xFF, sizeof(remap));
+        size_t newCount = 0;
+
+        for (int byte = 0; byte < 256; byte++) {
+            int inside = containsByte(builder->sets + i, (unsigned char) byte);
+            uint8_t oldClass = pattern->byteClass[byte];
+            if (remap[inside][oldClass] < 0) {
+                remap[inside][oldClass] = (int16_t) newCount++;
+            }
+            pattern->byteClass[byte] = (uint8_t) remap[inside][oldClass];
+        }
+
+        classCount = newCount;
+    }
+
+    pattern->classCount = classCount;
+    for (int byte = 255; byte >= 0; byte--) {
+        representatives[pattern->byteClass[byte]] = (unsigned char) byte;
+    }
+}
+
+
+/** \brief Hash of a bitset of NFA states (FNV-1a)
+ *
+ *  @param set - the bitset
+ *  @param words - number of 64 bit words of the bitset
+ *  @return the hash
+ */
+static size_t hashStates(const uint64_t *set, size_t words)
+{
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < words; i++) {
+        hash = (hash ^ set[i]) * 1099511628211u;
+    }
+    return (size_t) (hash ^ (hash >> 32));
+}
+
+
+/** \brief Mark states which can't reach an accepting state anymore and
+ *  states from which every continuation is accepted
+ *
+ *  @param pattern - NamePattern structure with a finished transition table
+ */
+static void markStates(NamePattern *pattern)
+{
+    bool changed = true;
+
+    // dead states: start with all non-accepting ones, remove those that reach a live state
+    for (size_t state = 0; state < pattern->stateCount; state++) {
+        if (!(pattern->stateFlags[state] & NAME_STATE_ACCEPTING)) {
+            pattern->stateFlags[state] |= NAME_STATE_DEAD;
+        } else {
+            pattern->stateFlags[state] |= NAME_STATE_ACCEPT_ALL;
+        }
+    }
+
+    while (changed) {
+        changed = false;
+        for (size_t state = 0; state < pattern->stateCount; state++) {
+            uint32_t *row = pattern->transitions + state * pattern->classCount;
+            uint8_t *flags = pattern->stateFlags + state;
+
+            for (size_t c = 0; c < pattern->classCount; c++) {
+                uint8_t targetFlags = pattern->stateFlags[row[c]];
+                if ((*flags & NAME_STATE_DEAD) && !(targetFlags & NAME_STATE_DEAD)) {
+                    *flags &= ~NAME_STATE_DEAD;
+                    changed = true;
+                }
+                if ((*flags & NAME_STATE_ACCEPT_ALL) && !(targetFlags & NAME_STATE_ACCEPT_ALL)) {
+                    *flags &= ~NAME_STATE_ACCEPT_ALL;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+
+/** \brief Turn the NFA into a DFA by the subset construction
+ *
+ *  @param pattern - NamePattern structure (the DFA is stored in it)
+ *  @param builder - NfaBuilder structure with a finished NFA
+ *  @param nfa - fragment of the whole pattern
+ *  @return true if successful
+ *          false if the DFA is too big or an allocation error occurred
+ */
+static bool buildDfa(NamePattern *pattern, NfaBuilder *builder, Fragment nfa)
+{
+    unsigned char representatives[256];
+    buildByteClasses(pattern, builder, representatives);
+
+    size_t words = (builder->count + 63) / 64;
+    size_t classCount = pattern->classCount;
+    uint64_t *sets = malloc(MAX_DFA_STATES * words * sizeof(uint64_t));
+    int32_t *table = malloc(DFA_HASH_SIZE * sizeof(int32_t));
+    int *stack = malloc(builder->count * sizeof(int));
+    pattern->transitions = malloc(MAX_DFA_STATES * classCount * sizeof(uint32_t));
+    pattern->stateFlags = malloc(MAX_DFA_STATES * sizeof(uint8_t));
+    bool success = true;
+
+    if (sets == NULL || table == NULL || stack == NULL
+            || pattern->transitions == NULL || pattern->stateFlags == NULL) {
+        builder->error = "out of memory";
+        success = false;
+    } else {
+        memset(table, 0xFF, DFA_HASH_SIZE * sizeof(int32_t));
+
+        // start state
+        memset(sets, 0, words * sizeof(uint64_t));
+        sets[nfa.start >> 6] |= (uint64_t) 1 << (nfa.start & 63);
+        epsilonClosure(builder, sets, stack, true, false);
+        table[hashStates(sets, words) & (DFA_HASH_SIZE - 1)] = 0;
+        pattern->stateCount = 1;
+    }
+
+    // states are processed in the order they were found
+    for (size_t current = 0; success && current < pattern->stateCount; current++) {
+        for (size_t c = 0; success && c < classCount; c++) {
+            uint64_t *next = sets + pattern->stateCount * words;
+            const uint64_t *from = sets + current * words;
+            memset(next, 0, words * sizeof(uint64_t));
+
+            for (size_t state = 0; state < builder->count; state++) {
+                NfaState *nfaState = builder->states + state;
+                if (((from[state >> 6] >> (state & 63)) & 1) && nfaState->byteSet >= 0
+                        && containsByte(builder->sets + nfaState->byteSet, representatives[c])) {
+                    next[nfaState->next >> 6] |= (uint64_t) 1 << (nfaState->next & 63);
+                }
+            }
+            epsilonClosure(builder, next, stack, false, false);
+
+            // look the set up, add it as a new state when it's not known
+            size_t slot = hashStates(next, words) & (DFA_HASH_SIZE - 1);
+            while (table[slot] >= 0 && memcmp(sets + table[slot] * words, next, words * sizeof(uint64_t)) != 0) {
+                slot = (slot + 1) & (DFA_HASH_SIZE - 1);
+            }
+
+            if (table[slot] < 0) {
+                if (pattern->stateCount + 1 >= MAX_DFA_STATES) {
+                    builder->error = "pattern is too complex";
+                    success = false;
+                    break;
+                }
+                table[slot] = (int32_t) pattern->stateCount++;
+            }
+
+            pattern->transitions[current * classCount + c] = (uint32_t) table[slot];
+        }
+    }
+
+    // a state accepts when the end is reached once the name ends ('$' anchors are passed),
+    // the set after the last state is free for the closure
+    for (size_t state = 0; success && state < pattern->stateCount; state++) {
+        uint64_t *set = sets + pattern->stateCount * words;
+        memcpy(set, sets + state * words, words * sizeof(uint64_t));
+        epsilonClosure(builder, set, stack, state == 0, true);
+        pattern->stateFlags[state] = ((set[nfa.end >> 6] >> (nfa.end & 63)) & 1) ? NAME_STATE_ACCEPTING : 0;
+    }
+
+    if (success) {
+        markStates(pattern);
+    }
+
+    free(sets);
+    free(table);
+    free(stack);
+    return success;
+}
+
+
+/** \brief Reset all fields of the pattern
+ *
+ *  @param pattern - NamePattern structure
+ *  @param kind - way the pattern is evaluated
+ *  @param ignoreCase - letters match regardless of their case
+ */
+static void initNamePattern(NamePattern *pattern, NamePatternKind kind, bool ignoreCase)
+{
+    pattern->kind = kind;
+    pattern->ignoreCase = ignoreCase;
+    pattern->literal = NULL;
+    pattern->literalLength = 0;
+    pattern->transitions = NULL;
+    pattern->stateFlags = NULL;
+    pattern->stateCount = 0;
+    pattern->classCount = 0;
+}
+
+
+/** \brief Parse the pattern and build its DFA
+ *
+ *  @param pattern - NamePattern structure
+ *  @param text - the pattern
+ *  @param glob - glob syntax, otherwise regular expression
+ *  @return true if successful
+ *          false on error (a message is printed)
+ */
+static bool compileDfa(NamePattern *pattern, const char *text, bool glob)
+{
+    NfaBuilder builder;
+    memset(&builder, 0, sizeof(NfaBuilder));
+    builder.text = text;
+    builder.length = strlen(text);
+    builder.ignoreCase = pattern->ignoreCase;
+
+    Fragment nfa;
+    if (glob) {
+        nfa = parseGlob(&builder);
+    } else {
+        // the expression is searched anywhere in the name, "^" and "$" (anywhere in it)
+        // only match at the start and at the end of the name
+        nfa = parseAlternation(&builder);
+        if (builder.error == NULL && peek(&builder) == ')') {
+            builder.error = "unmatched ')'";
+        }
+
+        nfa = concatFragments(&builder, repeatFragment(&builder, anyByteFragment(&builder), '*'), nfa);
+        nfa = concatFragments(&builder, nfa, repeatFragment(&builder, anyByteFragment(&builder), '*'));
+    }
+
+    bool success = (builder.error == NULL) && buildDfa(pattern, &builder, nfa);
+    if (!success) {
+        fprintf(stderr, "Couldn't compile %s \'%s\': %s.\n", glob ? "glob" : "regular expression",
+                text, builder.error);
+    }
+
+    free(builder.states);
+    free(builder.sets);
+    return success;
+}
+
+
+/** \brief Store the literal of a fast path
+ *
+ *  @param pattern - NamePattern structure
+ *  @param literal - start of the literal
+ *  @param length - length of the literal
+ *  @return true if successful
+ *          false if an allocation error occurred
+ */
+static bool setLiteral(NamePattern *pattern, const char *literal, size_t length)
+{
+    pattern->literal = malloc(length + 1);
+    if (pattern->literal == NULL) {
+        fprintf(stderr, "Couldn't allocate pattern.\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        pattern->literal[i] = pattern->ignoreCase ? (char) asciiLower((unsigned char) literal[i]) : literal[i];
+    }
+    pattern->literal[length] = '\0';
+    pattern->literalLength = length;
+    return true;
+}
+
+
+/** \brief Compile a glob, simple ones are turned into a plain comparison
+ *
+ *  @param pattern - NamePattern structure that's initialized
+ *  @param glob - the glob
+ *  @param ignoreCase - letters match regardless of their case
+ *  @return true on success
+ *          false on error (a message is printed)
+ */
+bool compileGlob(NamePattern *pattern, const char *glob, bool ignoreCase)
+{
+    size_t length = strlen(glob);
+    size_t stars = 0;
+    for (size_t i = 0; i < length; i++) {
+        stars += (glob[i] == '*');
+    }
+
+    initNamePattern(pattern, NAME_PATTERN_DFA, ignoreCase);
+
+    // only globs without "?", "[" and escapes can take a fast path
+    if (strpbrk(glob, "?[\\") == NULL) {
+        bool leading = (length > 0 && glob[0] == '*');
+        bool trailing = (length > 1 && glob[length - 1] == '*');
+
+        if (stars == 0) {
+            pattern->kind = NAME_PATTERN_EXACT;
+            return setLiteral(pattern, glob, length);
+        } else if (stars == length && stars <= 2) {
+            pattern->kind = NAME_PATTERN_ANY;
+            return true;
+        } else if (stars == 1 && leading) {
+            pattern->kind = NAME_PATTERN_SUFFIX;
+            return setLiteral(pattern, glob + 1, length - 1);
+        } else if (stars == 1 && trailing) {
+            pattern->kind = NAME_PATTERN_PREFIX;
+            return setLiteral(pattern, glob, length - 1);
+        } else if (stars == 2 && leading && trailing && !ignoreCase) {
+            pattern->kind = NAME_PATTERN_CONTAINS;
+            if (!setLiteral(pattern, glob + 1, length - 2)) {
+                return false;
+            }
+            initNameMatcher(&pattern->contains, pattern->literal, NAME_MATCH_AUTO);
+            return true;
+        }
+    }
+
+    return compileDfa(pattern, glob, true);
+}
+
+
+/** \brief Compile a regular expression into a DFA
+ *
+ *  @param pattern - NamePattern structure that's initialized
+ *  @param regex - the regular expression
+ *  @param ignoreCase - letters match regardless of their case
+ *  @return true on success
+ *          false on error (a message is printed)
+ */
+bool compileRegex(NamePattern *pattern, const char *regex, bool ignoreCase)
+{
+    initNamePattern(pattern, NAME_PATTERN_DFA, ignoreCase);
+    return compileDfa(pattern, regex, false);
+}
+
+
+/** \brief Compare bytes of a name with the literal
+ *
+ *  @param pattern - NamePattern structure
+ *  @param name - compared part of the name (at least literalLength bytes)
+ *  @return true if the bytes are equal
+ */
+static bool equalsLiteral(const NamePattern *pattern, const char *name)
+{
+    if (!pattern->ignoreCase) {
+        return (memcmp(name, pattern->literal, pattern->literalLength) == 0);
+    }
+
+    for (size_t i = 0; i < pattern->literalLength; i++) {
+        if (asciiLower((unsigned char) name[i]) != (unsigned char) pattern->literal[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** \brief Walk the DFA over the name, stop early in dead or accept-all states
+ *
+ *  @param pattern - NamePattern structure
+ *  @param name - name of the file
+ *  @return true if the name matches
+ */
+static bool runDfa(const NamePattern *pattern, const char *name)
+{
+    const uint32_t *transitions = pattern->transitions;
+    const uint8_t *flags = pattern->stateFlags;
+    size_t classCount = pattern->classCount;
+    uint32_t state = 0;
+
+    for (const unsigned char *byte = (const unsigned char *) name; *byte != '\0'; byte++) {
+        if (flags[state] & (NAME_STATE_DEAD | NAME_STATE_ACCEPT_ALL)) {
+            break;
+        }
+        state = transitions[state * classCount + pattern->byteClass[*byte]];
+    }
+
+    return (flags[state] & NAME_STATE_ACCEPTING);
+}
+
+
+/** \brief Determine if a name matches the pattern
+ *
+ *  @param pattern - NamePattern structure
+ *  @param name - name of the file (correct string)
+ *  @return true if the name matches
+ */
+bool matchNamePattern(const NamePattern *pattern, const char *name)
+{
+    size_t length = 0;
+
+    switch (pattern->kind) {
+    case NAME_PATTERN_ANY:
+        return true;
+    case NAME_PATTERN_EXACT:
+        return (strlen(name) == pattern->literalLength && equalsLiteral(pattern, name));
+    case NAME_PATTERN_PREFIX:
+        return (strnlen(name, pattern->literalLength) == pattern->literalLength
+                && equalsLiteral(pattern, name));
+    case NAME_PATTERN_SUFFIX:
+        length = strlen(name);
+        return (length >= pattern->literalLength
+                && equalsLiteral(pattern, name + length - pattern->literalLength));
+    case NAME_PATTERN_CONTAINS:
+        return matchName(&pattern->contains, name, strlen(name));
+    default:
+        return runDfa(pattern, name);
+    }
+}
+
+
+/** \brief Free all of the resources used in NamePattern structure
+ *
+ *  @param pattern - NamePattern structure
+ */
+void freeNamePattern(NamePattern *pattern)
+{
+    if (pattern->literal != NULL)
+        free(pattern->literal);
+    if (pattern->transitions != NULL)
+        free(pattern->transitions);
+    if (pattern->stateFlags != NULL)
+        free(pattern->stateFlags);
+
+    pattern->literal = NULL;
+    pattern->transitions = NULL;
+    pattern->stateFlags = NULL;
+}
@@ -0,0 +1,98 @@
+#include "nameMatcher.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef NAME_PATTERN_DEFINED
+#define NAME_PATTERN_DEFINED
+
+// flags of DFA states
+#define NAME_STATE_ACCEPTING 0x1
+// no name reaching the state can match anymore
+#define NAME_STATE_DEAD 0x2
+// every name reaching the state matches, whatever follows
+#define NAME_STATE_ACCEPT_ALL 0x4
+
+
+// way a pattern is evaluated, simple globs don't need the automaton
+typedef enum
+{
+    NAME_PATTERN_DFA,
+    // "*": every name
+    NAME_PATTERN_ANY,
+    // "literal"
+    NAME_PATTERN_EXACT,
+    // "literal*"
+    NAME_PATTERN_PREFIX,
+    // "*literal"
+    NAME_PATTERN_SUFFIX,
+    // "*literal*" (case sensitive only, searched by NameMatcher)
+    NAME_PATTERN_CONTAINS
+} NamePatternKind;
+
+
+// glob or regular expression compiled for matching file names
+typedef struct
+{
+    NamePatternKind kind;
+    bool ignoreCase;
+
+    // literal of the fast paths (lowercase when the case is ignored)
+    char *literal;
+    size_t literalLength;
+    NameMatcher contains;
+
+    // bytes are mapped into classes which the pattern can't tell apart
+    uint8_t byteClass[256];
+    size_t classCount;
+
+    // flat transition table of the DFA, row of state s starts at s * classCount,
+    // state 0 is the start state
+    uint32_t *transitions;
+    // NAME_STATE_* flags of every state
+    uint8_t *stateFlags;
+    size_t stateCount;
+} NamePattern;
+
+
+/** \brief Compile a shell glob ("*", "?", "[...]", "\" escapes), the whole name has to match
+ *
+ *  @param pattern - NamePattern structure that's initialized
+ *  @param glob - the glob
+ *  @param ignoreCase - letters match regardless of their case
+ *  @return true if successful
+ *          false if the glob is malformed or an allocation error occurred
+ *          (a message is printed)
+ */
+bool compileGlob(NamePattern *pattern, const char *glob, bool ignoreCase);
+
+
+/** \brief Compile an extended regular expression ("." "[...]" "*" "+" "?" "{m,n}"
+ *  "|" "(...)" "\" escapes), it's searched within the name unless anchored by "^" / "$"
+ *
+ *  @param pattern - NamePattern structure that's initialized
+ *  @param regex - the regular expression
+ *  @param ignoreCase - letters match regardless of their case
+ *  @return true if successful
+ *          false if the expression is malformed, too complex or an allocation
+ *          error occurred (a message is printed)
+ */
+bool compileRegex(NamePattern *pattern, const char *regex, bool ignoreCase);
+
+
+/** \brief Determine if a name matches the pattern, no memory is allocated
+ *
+ *  @param pattern - NamePattern structure
+ *  @param name - name of the file (correct string)
+ *  @return true if the name matches
+ */
+bool matchNamePattern(const NamePattern *pattern, const char *name);
+
+
+/** \brief Free heap memory used by the pattern
+ *
+ *  @param pattern - NamePattern structure
+ */
+void freeNamePattern(NamePattern *pattern);
+
+#endif
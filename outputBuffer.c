@@ -0,0 +1,490 @@
+#include "outputBuffer.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+// the buffer is written when it's full (a multiple of the page size)
+const size_t OUTPUT_BUFFER_SIZE = 256 * 1024;
+// buffered lines don't wait longer than this (nanoseconds)
+const uint64_t OUTPUT_FLUSH_INTERVAL = 50 * 1000 * 1000;
+// the longest record of OUTPUT_FORMAT_JSON apart from its path and pattern
+const size_t JSON_RECORD_OVERHEAD = 96;
+
+// writes of all threads go through this lock
+static pthread_mutex_t outputLock = PTHREAD_MUTEX_INITIALIZER;
+// set by the first failed write (guarded by outputLock)
+static bool outputFailed = false;
+
+
+/** \brief Return an empty OutputBuffer
+ *
+ *  @param fd - descriptor the output is written into
+ *  @return OutputBuffer structure
+ */
+OutputBuffer initOutputBuffer(int fd)
+{
+    OutputBuffer out;
+    out.data = NULL;
+    out.length = 0;
+    out.allocatedSize = 0;
+    out.pendingSince = 0;
+    out.fd = fd;
+    return out;
+}
+
+
+/** \brief Print a message about a failed write, once the output is gone
+ *  the buffers of all threads fail, so only the first failure is reported
+ *  (outputLock has to be held, errno is the one of the write)
+ */
+static void reportWriteError()
+{
+    if (!outputFailed) {
+        fprintf(stderr, "Couldn't write results (%s).\n", strerror(errno));
+        outputFailed = true;
+    }
+}
+
+
+/** \brief Map the page aligned buffer on its first use
+ *
+ *  @param out - OutputBuffer structure
+ *  @return true if successful
+ *          false if the buffer couldn't be mapped (a message is printed)
+ */
+static bool prepareOutputData(OutputBuffer *out)
+{
+    if (out->data != NULL) {
+        return true;
+    }
+
+    void *data = mmap(NULL, OUTPUT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Couldn't allocate output buffer.\n");
+        return false;
+    }
+    out->data = data;
+    out->allocatedSize = OUTPUT_BUFFER_SIZE;
+    return true;
+}
+
+
+/** \brief Write all bytes into a descriptor (write may write only a part)
+ *
+ *  @param fd - descriptor
+ *  @param data - bytes to write
+ *  @param length - number of bytes
+ *  @return true if successful
+ */
+static bool writeAll(int fd, char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+
+    return true;
+}
+
+
+/** \brief Write all parts into a descriptor with as few calls as possible
+ *
+ *  @param fd - descriptor
+ *  @param parts - the parts (they are changed while being written)
+ *  @param count - number of the parts
+ *  @return true if successful
+ */
+static bool writeAllParts(int fd, struct iovec *parts, int count)
+{
+    while (count > 0) {
+        ssize_t written = writev(fd, parts, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        // skip the parts that were written whole, the next one is written from its middle
+        while (count > 0 && (size_t) written >= parts->iov_len) {
+            written -= (ssize_t) parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = (char *) parts->iov_base + written;
+            parts->iov_len -= (size_t) written;
+        }
+    }
+
+    return true;
+}
+
+
+/** \brief Write everything buffered under the shared lock
+ *
+ *  @param out - OutputBuffer structure
+ *  @return true if successful
+ */
+bool flushOutput(OutputBuffer *out)
+{
+    if (out->length == 0) {
+        return true;
+    }
+
+    pthread_mutex_lock(&outputLock);
+    bool success = writeAll(out->fd, out->data, out->length);
+    if (!success) {
+        reportWriteError();
+    }
+    pthread_mutex_unlock(&outputLock);
+
+    out->length = 0;
+    out->pendingSince = 0;
+    return success;
+}
+
+
+/** \brief Write the buffer if its oldest line is older than OUTPUT_FLUSH_INTERVAL
+ *
+ *  @param out - OutputBuffer structure
+ *  @return true if successful
+ */
+bool flushOutputIfStale(OutputBuffer *out)
+{
+    if (out->length == 0 || getMonotonicTime() - out->pendingSince < OUTPUT_FLUSH_INTERVAL) {
+        return true;
+    }
+
+    return flushOutput(out);
+}
+
+
+/** \brief Add a line made of a prefix and a text into the buffer
+ *
+ *  @param out - OutputBuffer structure
+ *  @param prefix - start of the line
+ *  @param prefixLength - length of the prefix
+ *  @param text - rest of the line
+ *  @param length - length of the text
+ *  @param terminator - character terminating the line
+ *  @return true if successful
+ */
+bool appendOutputWithPrefix(OutputBuffer *out, char *prefix, size_t prefixLength,
+        char *text, size_t length, char terminator)
+{
+    if (!prepareOutputData(out)) {
+        return false;
+    }
+
+    // make room for the line (+1 for the terminator)
+    size_t lineLength = prefixLength + length + 1;
+    if (out->length + lineLength > out->allocatedSize && !flushOutput(out)) {
+        return false;
+    }
+
+    // line longer than the whole buffer is written directly
+    if (lineLength > out->allocatedSize) {
+        struct iovec parts[] = { { prefix, prefixLength }, { text, length }, { &terminator, 1 } };
+        pthread_mutex_lock(&outputLock);
+        bool success = writeAllParts(out->fd, parts, 3);
+        if (!success) {
+            reportWriteError();
+        }
+        pthread_mutex_unlock(&outputLock);
+        return success;
+    }
+
+    if (out->length == 0) {
+        out->pendingSince = getMonotonicTime();
+    }
+
+    if (prefixLength > 0) {
+        memcpy(out->data + out->length, prefix, prefixLength);
+    }
+    memcpy(out->data + out->length + prefixLength, text, length);
+    out->data[out->length + prefixLength + length] = terminator;
+    out->length += lineLength;
+    return true;
+}
+
+
+/** \brief Write a number in decimal
+ *
+ *  @param dest - where the digits are written
+ *  @param number - the number
+ *  @return end of the written digits
+ */
+static char *putDecimal(char *dest, uint64_t number)
+{
+    char digits[20];
+    size_t count = 0;
+    do {
+        digits[count++] = (char) ('0' + number % 10);
+        number /= 10;
+    } while (number > 0);
+
+    while (count > 0) {
+        *dest++ = digits[--count];
+    }
+    return dest;
+}
+
+
+/** \brief Find out how long the UTF-8 sequence at the start of the bytes is
+ *  (overlong forms, surrogates and code points over U+10FFFF are invalid)
+ *
+ *  @param text - bytes of the text
+ *  @param length - number of the bytes (at least 1)
+ *  @return number of bytes of the sequence (1 for ASCII)
+ *          0 if the bytes don't start with a valid sequence
+ */
+size_t utf8SequenceLength(const char *text, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char *) text;
+    size_t needed = 0;
+    // allowed range of the second byte, the others are 0x80 - 0xBF
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+
+    if (bytes[0] < 0x80) {
+        return 1;
+    } else if (bytes[0] >= 0xC2 && bytes[0] <= 0xDF) {
+        needed = 2;
+    } else if (bytes[0] >= 0xE0 && bytes[0] <= 0xEF) {
+        needed = 3;
+        low = (bytes[0] == 0xE0) ? 0xA0 : 0x80;
+        high = (bytes[0] == 0xED) ? 0x9F : 0xBF;
+    } else if (bytes[0] >= 0xF0 && bytes[0] <= 0xF4) {
+        needed = 4;
+        low = (bytes[0] == 0xF0) ? 0x90 : 0x80;
+        high = (bytes[0] == 0xF4) ? 0x8F : 0xBF;
+    } else {
+        return 0;
+    }
+
+    if (length < needed || bytes[1] < low || bytes[1] > high) {
+        return 0;
+    }
+    for (size_t i = 2; i < needed; i++) {
+        if (bytes[i] < 0x80 || bytes[i] > 0xBF) {
+            return 0;
+        }
+    }
+    return needed;
+}
+
+
+/** \brief Write bytes, quotes, backslashes and control characters escaped for JSON,
+ *  valid UTF-8 is copied, every other byte is written as \u00XX (the code point
+ *  equal to the byte, names that aren't UTF-8 stay distinguishable)
+ *
+ *  @param dest - where the escaped bytes are written (at most 6 per byte)
+ *  @param text - bytes of the text
+ *  @param length - number of the bytes
+ *  @return end of the written bytes
+ */
+static char *putJsonEscaped(char *dest, const char *text, size_t length)
+{
+    const char hexDigits[] = "0123456789abcdef";
+    size_t i = 0;
+    while (i < length) {
+        unsigned char c = (unsigned char) text[i];
+        size_t sequence = utf8SequenceLength(text + i, length - i);
+        if (c == '"' || c == '\\') {
+            *dest++ = '\\';
+            *dest++ = (char) c;
+        } else if (c < 0x20 || sequence == 0) {
+            memcpy(dest, "\\u00", 4);
+            dest[4] = hexDigits[c >> 4];
+            dest[5] = hexDigits[c & 0xF];
+            dest += 6;
+        } else {
+            memcpy(dest, text + i, sequence);
+            dest += sequence;
+            i += sequence;
+            continue;
+        }
+        i++;
+    }
+    return dest;
+}
+
+
+/** \brief Copy bytes
+ *
+ *  @param dest - where the bytes are copied
+ *  @param text - the bytes
+ *  @param length - number of the bytes
+ *  @return end of the copied bytes
+ */
+static inline char *putBytes(char *dest, const char *text, size_t length)
+{
+    memcpy(dest, text, length);
+    return dest + length;
+}
+
+
+/** \brief Find out how long a record can get in a format
+ *
+ *  @param length - length of the path
+ *  @param patternLength - length of the pattern (0 if there's none)
+ *  @param format - OUTPUT_FORMAT_* value
+ *  @return maximal number of bytes
+ */
+static size_t maximalRecordLength(size_t length, size_t patternLength, uint8_t format)
+{
+    switch (format) {
+    case OUTPUT_FORMAT_NETSTRING:
+        // 20 digits of the length, ':', tab and ','
+        return 20 + length + patternLength + 3;
+    case OUTPUT_FORMAT_JSON:
+        return 6 * (length + patternLength) + JSON_RECORD_OVERHEAD;
+    default:
+        // tab and terminator
+        return length + patternLength + 2;
+    }
+}
+
+
+/** \brief Write a record in one of the formats
+ *
+ *  @param dest - where the record is written (maximalRecordLength bytes)
+ *  @param record - the result
+ *  @param patternLength - length of its pattern
+ *  @param format - OUTPUT_FORMAT_* value
+ *  @param terminator - character terminating the line (OUTPUT_FORMAT_LINES only)
+ *  @return end of the record
+ */
+static char *formatRecord(char *dest, const OutputRecord *record, size_t patternLength,
+        uint8_t format, char terminator)
+{
+    switch (format) {
+    case OUTPUT_FORMAT_NETSTRING:
+        dest = putDecimal(dest, record->length + ((record->pattern != NULL) ? patternLength + 1 : 0));
+        *dest++ = ':';
+        dest = putBytes(dest, record->path, record->length);
+        if (record->pattern != NULL) {
+            *dest++ = '\t';
+            dest = putBytes(dest, record->pattern, patternLength);
+        }
+        *dest++ = ',';
+        return dest;
+
+    case OUTPUT_FORMAT_JSON:
+        dest = putBytes(dest, "{\"path\":\"", 9);
+        dest = putJsonEscaped(dest, record->path, record->length);
+        dest = putBytes(dest, "\",\"size\":", 9);
+        dest = putDecimal(dest, record->size);
+        // permissions in octal, as a string
+        dest = putBytes(dest, ",\"mode\":\"", 9);
+        for (int shift = 9; shift >= 0; shift -= 3) {
+            *dest++ = (char) ('0' + ((record->mode >> shift) & 07));
+        }
+        dest = putBytes(dest, "\",\"uid\":", 8);
+        dest = putDecimal(dest, record->uid);
+        if (record->pattern != NULL) {
+            dest = putBytes(dest, ",\"pattern\":\"", 12);
+            dest = putJsonEscaped(dest, record->pattern, patternLength);
+            *dest++ = '"';
+        }
+        return putBytes(dest, "}\n", 2);
+
+    default:
+        dest = putBytes(dest, record->path, record->length);
+        if (record->pattern != NULL) {
+            *dest++ = '\t';
+            dest = putBytes(dest, record->pattern, patternLength);
+        }
+        *dest++ = terminator;
+        return dest;
+    }
+}
+
+
+/** \brief Add a result in one of the formats into the buffer
+ *
+ *  @param out - OutputBuffer structure
+ *  @param record - the result
+ *  @param format - OUTPUT_FORMAT_* value
+ *  @param terminator - character terminating the line (OUTPUT_FORMAT_LINES only)
+ *  @return true if successful
+ */
+bool appendRecord(OutputBuffer *out, const OutputRecord *record, uint8_t format, char terminator)
+{
+    size_t patternLength = (record->pattern != NULL) ? strlen(record->pattern) : 0;
+    size_t maximalLength = maximalRecordLength(record->length, patternLength, format);
+
+    if (!prepareOutputData(out)) {
+        return false;
+    }
+
+    if (out->length + maximalLength > out->allocatedSize && !flushOutput(out)) {
+        return false;
+    }
+
+    // record longer than the whole buffer is formatted on its own and written directly
+    if (maximalLength > out->allocatedSize) {
+        char *line = malloc(maximalLength);
+        if (line == NULL) {
+            fprintf(stderr, "Couldn't allocate output line.\n");
+            return false;
+        }
+        size_t lineLength = (size_t) (formatRecord(line, record, patternLength, format, terminator) - line);
+        pthread_mutex_lock(&outputLock);
+        bool success = writeAll(out->fd, line, lineLength);
+        if (!success) {
+            reportWriteError();
+        }
+        pthread_mutex_unlock(&outputLock);
+        free(line);
+        return success;
+    }
+
+    if (out->length == 0) {
+        out->pendingSince = getMonotonicTime();
+    }
+
+    char *end = formatRecord(out->data + out->length, record, patternLength, format, terminator);
+    out->length = (size_t) (end - out->data);
+    return true;
+}
+
+
+/** \brief Free the buffer
+ *
+ *  @param out - OutputBuffer structure
+ */
+void freeOutputBuffer(OutputBuffer *out)
+{
+    if (out->data != NULL)
+        munmap(out->data, out->allocatedSize);
+    *out = initOutputBuffer(out->fd);
+}
+
+
+/** \brief Get time of the monotonic clock
+ *
+ *  @return nanoseconds
+ */
+uint64_t getMonotonicTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
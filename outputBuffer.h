@@ -0,0 +1,131 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef OUTPUT_BUFFER_DEFINED
+#define OUTPUT_BUFFER_DEFINED
+
+// formats of the results ("-F")
+// path and terminator ("-0" or "-F nul" makes it a nul char)
+#define OUTPUT_FORMAT_LINES 0
+// path as a netstring: length of the path, ':', the path and ','
+#define OUTPUT_FORMAT_NETSTRING 1
+// one JSON object per line with path, size, mode and uid
+#define OUTPUT_FORMAT_JSON 2
+
+
+// structure stores output that wasn't written yet, every thread has its own one
+typedef struct
+{
+    // buffered bytes (only whole lines), page aligned
+    char *data;
+    // number of buffered bytes
+    size_t length;
+    // allocated size of data
+    size_t allocatedSize;
+    // time the oldest buffered line was added (0 = nothing buffered)
+    uint64_t pendingSince;
+    // descriptor the output is written into
+    int fd;
+} OutputBuffer;
+
+
+// one result as it's written
+typedef struct
+{
+    char *path;
+    size_t length;
+    // pattern the name matched (NULL if the result isn't annotated)
+    char *pattern;
+    // stats of the file (only written by OUTPUT_FORMAT_JSON)
+    uint64_t size;
+    uint32_t mode;
+    uint32_t uid;
+} OutputRecord;
+
+
+/** \brief Create an empty OutputBuffer, memory is allocated on the first use
+ *
+ *  @param fd - descriptor the output is written into
+ *  @return new OutputBuffer structure
+ */
+OutputBuffer initOutputBuffer(int fd);
+
+
+/** \brief Add a result in one of the formats into the buffer, the buffer
+ *  is written when it's full
+ *
+ *  @param out - OutputBuffer structure
+ *  @param record - the result
+ *  @param format - OUTPUT_FORMAT_* value
+ *  @param terminator - character terminating the line (OUTPUT_FORMAT_LINES only)
+ *  @return true if successful
+ *          false if an allocation or write error occurred (a message is printed,
+ *          for write errors only by the first buffer that fails)
+ */
+bool appendRecord(OutputBuffer *out, const OutputRecord *record, uint8_t format, char terminator);
+
+
+/** \brief Add a line made of a prefix and a text into the buffer
+ *
+ *  @param out - OutputBuffer structure
+ *  @param prefix - start of the line
+ *  @param prefixLength - length of the prefix
+ *  @param text - rest of the line
+ *  @param length - length of the text
+ *  @param terminator - character terminating the line
+ *  @return true if successful
+ *          false if an allocation or write error occurred (a message is printed,
+ *          for write errors only by the first buffer that fails)
+ */
+bool appendOutputWithPrefix(OutputBuffer *out, char *prefix, size_t prefixLength,
+        char *text, size_t length, char terminator);
+
+
+/** \brief Write everything buffered, writes of all threads are serialized
+ *  so that lines never interleave
+ *
+ *  @param out - OutputBuffer structure
+ *  @return true if successful
+ *          false if a write error occurred (a message is printed, only by
+ *          the first buffer that fails)
+ */
+bool flushOutput(OutputBuffer *out);
+
+
+/** \brief Write the buffer if its oldest line waits for too long, so that
+ *  the consumers get results early even when they are found slowly
+ *
+ *  @param out - OutputBuffer structure
+ *  @return true if successful
+ *          false if a write error occurred (a message is printed, only by
+ *          the first buffer that fails)
+ */
+bool flushOutputIfStale(OutputBuffer *out);
+
+
+/** \brief Free heap memory used by the buffer (buffered output is discarded)
+ *
+ *  @param out - OutputBuffer structure
+ */
+void freeOutputBuffer(OutputBuffer *out);
+
+
+/** \brief Find out how long the UTF-8 sequence at the start of the bytes is
+ *  (overlong forms, surrogates and code points over U+10FFFF are invalid)
+ *
+ *  @param text - bytes of the text
+ *  @param length - number of the bytes (at least 1)
+ *  @return number of bytes of the sequence (1 for ASCII)
+ *          0 if the bytes don't start with a valid sequence
+ */
+size_t utf8SequenceLength(const char *text, size_t length);
+
+
+/** \brief Get time of a monotonic clock
+ *
+ *  @return nanoseconds since an unspecified point
+ */
+uint64_t getMonotonicTime();
+
+#endif
@@ -0,0 +1,233 @@
+#include "patternSet.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// transition that doesn't exist yet (only while building the trie)
+#define NO_STATE UINT32_MAX
+
+
+/** \brief Map every byte used in the patterns to its own class, the rest
+ *  shares class 0. The rows of the transition table get only as wide as needed.
+ *
+ *  @param set - PatternSet structure
+ */
+static void buildByteClasses(PatternSet *set)
+{
+    memset(set->byteClass, 0, sizeof(set->byteClass));
+    set->classCount = 1;
+
+    for (size_t i = 0; i < set->count; i++) {
+        for (const unsigned char *byte = (unsigned char *) set->patterns[i]; *byte != '\0'; byte++) {
+            if (set->byteClass[*byte] == 0) {
+                set->byteClass[*byte] = (uint8_t) set->classCount++;
+            }
+        }
+    }
+}
+
+
+/** \brief Add a new state without any transitions
+ *
+ *  @param set - PatternSet structure (enough states are allocated)
+ *  @return index of the state
+ */
+static uint32_t addState(PatternSet *set)
+{
+    uint32_t state = (uint32_t) set->stateCount++;
+    uint32_t *row = set->transitions + state * set->classCount;
+
+    for (size_t i = 0; i < set->classCount; i++) {
+        row[i] = NO_STATE;
+    }
+    set->matches[state] = NO_PATTERN;
+    return state;
+}
+
+
+/** \brief Insert all patterns into the trie (state 0 is the root)
+ *
+ *  @param set - PatternSet structure
+ */
+static void buildTrie(PatternSet *set)
+{
+    addState(set);
+
+    for (size_t i = 0; i < set->count; i++) {
+        uint32_t state = 0;
+
+        for (const unsigned char *byte = (unsigned char *) set->patterns[i]; *byte != '\0'; byte++) {
+            uint32_t *next = set->transitions + state * set->classCount + set->byteClass[*byte];
+            if (*next == NO_STATE) {
+                *next = addState(set);
+            }
+            state = *next;
+        }
+
+        // duplicates report the first occurrence
+        if (set->matches[state] == NO_PATTERN) {
+            set->matches[state] = (int32_t) i;
+        }
+    }
+}
+
+
+/** \brief Turn the trie into a complete automaton. States are visited in
+ *  breadth-first order, so the failure state of every state is finished
+ *  before the state itself. Missing transitions are copied from the failure
+ *  state and matches are inherited from it (a pattern that's a suffix ends there too).
+ *
+ *  @param set - PatternSet structure
+ *  @return true if successful
+ *          false if an allocation error occurred
+ */
+static bool buildAutomaton(PatternSet *set)
+{
+    uint32_t *queue = malloc(set->stateCount * sizeof(uint32_t));
+    uint32_t *failure = malloc(set->stateCount * sizeof(uint32_t));
+    size_t classCount = set->classCount;
+
+    if (queue == NULL || failure == NULL) {
+        free(queue);
+        free(failure);
+        return false;
+    }
+
+    size_t head = 0;
+    size_t tail = 0;
+
+    // children of the root fail into the root, missing transitions loop in it
+    failure[0] = 0;
+    for (size_t c = 0; c < classCount; c++) {
+        uint32_t *next = set->transitions + c;
+        if (*next == NO_STATE) {
+            *next = 0;
+        } else {
+            failure[*next] = 0;
+            queue[tail++] = *next;
+        }
+    }
+
+    while (head < tail) {
+        uint32_t state = queue[head++];
+        uint32_t *row = set->transitions + state * classCount;
+        uint32_t *failureRow = set->transitions + failure[state] * classCount;
+
+        if (set->matches[state] == NO_PATTERN) {
+            set->matches[state] = set->matches[failure[state]];
+        }
+
+        for (size_t c = 0; c < classCount; c++) {
+            if (row[c] == NO_STATE) {
+                row[c] = failureRow[c];
+            } else {
+                failure[row[c]] = failureRow[c];
+                queue[tail++] = row[c];
+            }
+        }
+    }
+
+    free(queue);
+    free(failure);
+    return true;
+}
+
+
+/** \brief Compile patterns into a PatternSet
+ *
+ *  @param set - PatternSet structure that's initialized
+ *  @param patterns - array of the patterns (at least one, not copied)
+ *  @param count - number of the patterns
+ *  @return true on success
+ *          false on fail with memory allocation
+ */
+bool initPatternSet(PatternSet *set, char **patterns, size_t count)
+{
+    set->patterns = patterns;
+    set->count = count;
+    set->transitions = NULL;
+    set->matches = NULL;
+    set->stateCount = 0;
+    set->classCount = 0;
+
+    // a single pattern is searched by the SIMD matcher
+    if (count == 1) {
+        initNameMatcher(&set->single, patterns[0], NAME_MATCH_AUTO);
+        return true;
+    }
+
+    buildByteClasses(set);
+
+    // every byte of the patterns adds at most one state
+    size_t maxStates = 1;
+    for (size_t i = 0; i < count; i++) {
+        maxStates += strlen(patterns[i]);
+    }
+
+    set->transitions = malloc(maxStates * set->classCount * sizeof(uint32_t));
+    set->matches = malloc(maxStates * sizeof(int32_t));
+    if (set->transitions == NULL || set->matches == NULL) {
+        freePatternSet(set);
+        return false;
+    }
+
+    buildTrie(set);
+
+    if (!buildAutomaton(set)) {
+        freePatternSet(set);
+        return false;
+    }
+
+    return true;
+}
+
+
+/** \brief Walk the automaton over the name, stop at the first state where a pattern ends
+ *
+ *  @param set - PatternSet structure
+ *  @param name - name of the file
+ *  @return index of the pattern found first
+ *          NO_PATTERN if no pattern is present
+ */
+int32_t findPattern(const PatternSet *set, const char *name)
+{
+    if (set->count == 1) {
+        return matchName(&set->single, name, strlen(name)) ? 0 : NO_PATTERN;
+    }
+
+    const uint32_t *transitions = set->transitions;
+    const int32_t *matches = set->matches;
+    size_t classCount = set->classCount;
+    uint32_t state = 0;
+
+    // an empty pattern matches at the root already
+    if (matches[0] != NO_PATTERN) {
+        return matches[0];
+    }
+
+    for (const unsigned char *byte = (const unsigned char *) name; *byte != '\0'; byte++) {
+        state = transitions[state * classCount + set->byteClass[*byte]];
+        if (matches[state] != NO_PATTERN) {
+            return matches[state];
+        }
+    }
+
+    return NO_PATTERN;
+}
+
+
+/** \brief Free all of the resources used in PatternSet structure
+ *
+ *  @param set - PatternSet structure
+ */
+void freePatternSet(PatternSet *set)
+{
+    if (set->transitions != NULL)
+        free(set->transitions);
+    if (set->matches != NULL)
+        free(set->matches);
+
+    set->transitions = NULL;
+    set->matches = NULL;
+}
@@ -0,0 +1,64 @@
+#include "nameMatcher.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef PATTERN_SET_DEFINED
+#define PATTERN_SET_DEFINED
+
+// no pattern matched
+#define NO_PATTERN (-1)
+
+
+// set of substrings the file names are searched for. A single pattern
+// uses NameMatcher, more patterns are compiled into an Aho-Corasick automaton.
+typedef struct
+{
+    // the patterns (not copied)
+    char **patterns;
+    size_t count;
+
+    // matcher of a single pattern
+    NameMatcher single;
+
+    // bytes used by the patterns are mapped into classes, class 0 = any other byte
+    uint8_t byteClass[256];
+    size_t classCount;
+
+    // flat transition table of the automaton, row of state s starts at s * classCount
+    // (every transition is filled, the search never follows failure links)
+    uint32_t *transitions;
+    // for every state the index of a pattern that ends there (NO_PATTERN if none)
+    int32_t *matches;
+    size_t stateCount;
+} PatternSet;
+
+
+/** \brief Compile patterns, the strings have to outlive the set
+ *
+ *  @param set - PatternSet structure that's initialized
+ *  @param patterns - array of the patterns (at least one)
+ *  @param count - number of the patterns
+ *  @return true if successful
+ *          false if an allocation error occurred
+ */
+bool initPatternSet(PatternSet *set, char **patterns, size_t count);
+
+
+/** \brief Find a pattern that's a substring of the name, in time linear in the name length
+ *
+ *  @param set - PatternSet structure
+ *  @param name - name of the file (correct string)
+ *  @return index of the pattern that's found first (the one ending first in the name)
+ *          NO_PATTERN if no pattern is present
+ */
+int32_t findPattern(const PatternSet *set, const char *name);
+
+
+/** \brief Free heap memory of the automaton
+ *
+ *  @param set - PatternSet structure
+ */
+void freePatternSet(PatternSet *set);
+
+#endif
@@ -0,0 +1,830 @@
+#include "resultSort.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// runs of this many results are sorted by insertion sort before merging
+const size_t INSERTION_SORT_RUN = 24;
+// number of bytes of the folded name prefix packed into the key
+const size_t NAME_KEY_BYTES = 8;
+// smaller arrays are sorted by one thread, starting threads would cost more
+const size_t PARALLEL_SORT_THRESHOLD = 1 << 16;
+// first allocated size of a bounded heap of results
+const size_t TOP_RESULTS_INITIAL_SIZE = 64;
+
+
+// comparator of two results, negative if the first one goes first
+typedef int (*ResultComparator)(const Result *, const Result *);
+
+
+/** \brief Retrieve fileName from any path
+ * 
+ *  @param filePath - the whole path to the file
+ *  @return char pointer at part of the path that's the name of the file
+ */
+static char *getFileName(char *filePath)
+{
+    char *iter = filePath;
+    while (*iter != '\0') {
+        if (*iter++ == '/') {
+            filePath = iter;
+        }
+    }
+
+    return filePath;
+}
+
+
+/** \brief Compute sort keys of a result. The name key holds the first bytes
+ *  of the file name folded the same way strCmpCI folds them, big endian,
+ *  so that comparing two keys gives the same order as strCmpCI does
+ *  (equal keys are resolved by comparing the whole strings).
+ *
+ *  @param result - Result structure with a stored path
+ */
+void setSortKeys(Result *result)
+{
+    char *name = getFileName(result->filePath);
+    result->nameOffset = (uint32_t) (name - result->filePath);
+
+    // shorter names are padded by zeros, they go first as in strCmpCI
+    uint64_t key = 0;
+    bool ended = false;
+    for (size_t i = 0; i < NAME_KEY_BYTES; i++) {
+        // strCmpCI folds plain chars, which may be signed, so a folded value
+        // may not fit into a byte (tolower of EOF is negative), the key ends there
+        int folded = ended ? 0 : tolower(name[i]);
+        if (folded <= 0 || folded > UINT8_MAX) {
+            ended = true;
+            folded = 0;
+        }
+        key = (key << 8) | (uint8_t) folded;
+    }
+
+    result->nameKey = key;
+}
+
+
+/** \brief Compare strings case insensitive
+ *
+ *  @param strOnePtr - pointer to the first string
+ *  @param strTwoPtr - pointer to the second string
+ *  @return positive num if first string is bigger
+ *          negative num if first string is smaller
+ *          0 if strings are equal
+ */
+static int strCmpCI(const char *strOnePtr, const char *strTwoPtr)
+{
+    int chOne = 0;
+    int chTwo = 0;
+
+    // until we get to the end of string
+    while (*strOnePtr != '\0' && *strTwoPtr != '\0') {
+        // makes all chars lowercase + pointer iteration
+        chOne = tolower(*(strOnePtr++));
+        chTwo = tolower(*(strTwoPtr++));
+
+        // if the result is not zero it returns the value
+        if (chOne - chTwo != 0) {
+            return chOne - chTwo;
+        }
+    }
+
+    // if one string is shorter then it returns correct value for qsort
+    if (*strOnePtr == '\0' && *strTwoPtr != '\0') {
+        return -1;
+    } else if (*strOnePtr != '\0' && *strTwoPtr == '\0') {
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/** \brief Determine which file name is bigger
+ *  (case insensitive, unless fileNames are equal). The precomputed keys
+ *  decide most of the comparisons, strings are compared only on ties.
+ *
+ *  @param resultOne - pointer to the first Result element in array
+ *  @param resultTwo - pointer to the second Result element in array
+ *  @return positive num if resultOne's filename is larger
+ *          negative num if resultOne's filename is smaller
+ *          0 if names are equal
+ */
+static inline int sortByFileName(const Result *resultOne, const Result *resultTwo)
+{
+    if (resultOne->nameKey != resultTwo->nameKey) {
+        return (resultOne->nameKey < resultTwo->nameKey) ? -1 : 1;
+    }
+
+    int result = 0;
+    const char *nameOne = resultOne->filePath + resultOne->nameOffset;
+    const char *nameTwo = resultTwo->filePath + resultTwo->nameOffset;
+
+    // a full key means both prefixes are equal after folding, only the rest is compared
+    if ((resultOne->nameKey & 0xFF) != 0) {
+        nameOne += NAME_KEY_BYTES;
+        nameTwo += NAME_KEY_BYTES;
+    }
+
+    // case insensitive difference
+    if ((result = strCmpCI(nameOne, nameTwo)) != 0) {
+        return result;
+    }
+
+    // case sensitive difference
+    return strcmp(resultOne->filePath, resultTwo->filePath);
+}
+
+
+/** \brief Determine which file path is larger (case sensitive)
+ *
+ *  @param resultOne - pointer to the first Result element in array
+ *  @param resultTwo - pointer to the second Result element in array
+ *  @return positive num if resultOne's filepath is larger
+ *          negative num if resultOne's filepath is smaller
+ *          0 if names are equal
+ */
+static inline int sortByFilePath(const Result *resultOne, const Result *resultTwo)
+{
+    // case sensitive
+    return strcmp(resultOne->filePath, resultTwo->filePath);
+}
+
+
+/** \brief Determine which file size is larger
+ *  (reversed, because we want to display the files from largest
+ *   to smallest)
+ *
+ *  @param resultOne - pointer to the first Result element in array
+ *  @param resultTwo - pointer to the second Result element in array
+ *  @return -1 if resultOne's filesize is larger
+ *          1 if resultOne's filesize is smaller
+ *          if sizes are equal, sorting by fileName happens
+ */
+static inline int sortByFileSize(const Result *resultOne, const Result *resultTwo)
+{
+    if (resultOne->fileSize > resultTwo->fileSize) {
+        return -1;
+    } else if (resultOne->fileSize < resultTwo->fileSize) {
+        return 1;
+    }
+
+    return sortByFileName(resultOne, resultTwo);
+}
+
+
+/** \brief Compare two results in the order of the sort type
+ *
+ *  @param resultOne - pointer to the first Result
+ *  @param resultTwo - pointer to the second Result
+ *  @param sortType - 0 = by file name, 1 = by path, 2 = by file size
+ *  @return negative num if resultOne goes first, positive num if it goes second
+ */
+static int compareResults(const Result *resultOne, const Result *resultTwo, uint8_t sortType)
+{
+    switch (sortType) {
+    case 1:
+        return sortByFilePath(resultOne, resultTwo);
+    case 2:
+        return sortByFileSize(resultOne, resultTwo);
+    default:
+        return sortByFileName(resultOne, resultTwo);
+    }
+}
+
+
+/** \brief Sort a short run of results by insertion sort (stable)
+ *
+ *  @param array - the run
+ *  @param count - length of the run
+ *  @param compare - comparator of the results
+ */
+static inline void insertionSortResults(Result *array, size_t count, ResultComparator compare)
+{
+    for (size_t i = 1; i < count; i++) {
+        Result current = array[i];
+        size_t position = i;
+
+        while (position > 0 && compare(&current, array + position - 1) < 0) {
+            array[position] = array[position - 1];
+            position--;
+        }
+        array[position] = current;
+    }
+}
+
+
+/** \brief Merge two sorted runs into out (stable, left wins on ties)
+ *
+ *  @param left - first run
+ *  @param leftCount - length of the first run
+ *  @param right - second run
+ *  @param rightCount - length of the second run
+ *  @param out - memory for leftCount + rightCount results
+ *  @param compare - comparator of the results
+ */
+static inline void mergeRuns(const Result *left, size_t leftCount,
+        const Result *right, size_t rightCount,
+        Result *out, ResultComparator compare)
+{
+    const Result *leftEnd = left + leftCount;
+    const Result *rightEnd = right + rightCount;
+
+    while (left < leftEnd && right < rightEnd) {
+        if (compare(right, left) < 0) {
+            *out++ = *right++;
+        } else {
+            *out++ = *left++;
+        }
+    }
+
+    memcpy(out, left, (size_t) (leftEnd - left) * sizeof(Result));
+    out += leftEnd - left;
+    memcpy(out, right, (size_t) (rightEnd - right) * sizeof(Result));
+}
+
+
+/** \brief Bottom-up merge sort (stable), the comparator is inlined into
+ *  every caller because it's a constant there
+ *
+ *  @param array - results that are sorted
+ *  @param buffer - memory for count results
+ *  @param count - number of results
+ *  @param compare - comparator of the results
+ */
+static inline void mergeSortResults(Result *array, Result *buffer, size_t count, ResultComparator compare)
+{
+    for (size_t i = 0; i < count; i += INSERTION_SORT_RUN) {
+        size_t runLength = (count - i < INSERTION_SORT_RUN) ? count - i : INSERTION_SORT_RUN;
+        insertionSortResults(array + i, runLength, compare);
+    }
+
+    Result *from = array;
+    Result *to = buffer;
+
+    for (size_t width = INSERTION_SORT_RUN; width < count; width *= 2) {
+        for (size_t i = 0; i < count; i += 2 * width) {
+            size_t leftCount = (count - i < width) ? count - i : width;
+            size_t rightCount = (count - i - leftCount < width) ? count - i - leftCount : width;
+            mergeRuns(from + i, leftCount, from + i + leftCount, rightCount, to + i, compare);
+        }
+
+        Result *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != array) {
+        memcpy(array, from, count * sizeof(Result));
+    }
+}
+
+
+/** \brief Sort results by file name
+ *
+ *  @param array - results that are sorted
+ *  @param buffer - memory for count results
+ *  @param count - number of results
+ */
+static void sortByName(Result *array, Result *buffer, size_t count)
+{
+    mergeSortResults(array, buffer, count, sortByFileName);
+}
+
+
+/** \brief Sort results by path
+ *
+ *  @param array - results that are sorted
+ *  @param buffer - memory for count results
+ *  @param count - number of results
+ */
+static void sortByPath(Result *array, Result *buffer, size_t count)
+{
+    mergeSortResults(array, buffer, count, sortByFilePath);
+}
+
+
+/** \brief Sort results from the largest file to the smallest one, files
+ *  of the same size by their names. LSD radix sort (stable) is used on
+ *  the sizes, byte positions where all sizes are equal are skipped.
+ *
+ *  @param array - results that are sorted
+ *  @param buffer - memory for count results
+ *  @param count - number of results
+ */
+static void sortBySize(Result *array, Result *buffer, size_t count)
+{
+    size_t histograms[sizeof(size_t)][256];
+    memset(histograms, 0, sizeof(histograms));
+
+    // the sizes are inverted, so that ascending order of keys puts the largest first
+    for (size_t i = 0; i < count; i++) {
+        size_t key = ~array[i].fileSize;
+        for (size_t digit = 0; digit < sizeof(size_t); digit++) {
+            histograms[digit][(key >> (digit * 8)) & 0xFF]++;
+        }
+    }
+
+    Result *from = array;
+    Result *to = buffer;
+
+    for (size_t digit = 0; digit < sizeof(size_t); digit++) {
+        size_t *histogram = histograms[digit];
+        size_t key = ~array[0].fileSize;
+
+        // every size has the same byte here, nothing to do
+        if (histogram[(key >> (digit * 8)) & 0xFF] == count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < 256; bucket++) {
+            size_t bucketSize = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketSize;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            size_t bucket = (~from[i].fileSize >> (digit * 8)) & 0xFF;
+            to[histogram[bucket]++] = from[i];
+        }
+
+        Result *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != array) {
+        memcpy(array, from, count * sizeof(Result));
+    }
+
+    // files of the same size are sorted by their names
+    size_t runStart = 0;
+    for (size_t i = 1; i <= count; i++) {
+        if (i == count || array[i].fileSize != array[runStart].fileSize) {
+            if (i - runStart > 1) {
+                sortByName(array + runStart, buffer, i - runStart);
+            }
+            runStart = i;
+        }
+    }
+}
+
+
+/** \brief Find how many results of the left run are among the first
+ *  outputCount results of their stable merge (the merge path), so that
+ *  a merge can be split into independent slices
+ *
+ *  @param left - first run
+ *  @param leftCount - length of the first run
+ *  @param right - second run
+ *  @param rightCount - length of the second run
+ *  @param outputCount - number of merged results
+ *  @param compare - comparator of the results
+ *  @return number of results taken from the left run
+ */
+static inline size_t mergeSplit(const Result *left, size_t leftCount,
+        const Result *right, size_t rightCount,
+        size_t outputCount, ResultComparator compare)
+{
+    size_t low = (outputCount > rightCount) ? outputCount - rightCount : 0;
+    size_t high = (outputCount < leftCount) ? outputCount : leftCount;
+
+    while (low < high) {
+        size_t taken = low + (high - low) / 2;
+        size_t rightTaken = outputCount - taken;
+
+        // left[taken] goes before right[rightTaken - 1], more of the left run is needed
+        if (rightTaken > 0 && compare(right + rightTaken - 1, left + taken) >= 0) {
+            low = taken + 1;
+        } else {
+            high = taken;
+        }
+    }
+
+    return low;
+}
+
+
+/** \brief Write results [start, end) of the stable merge of two runs into out
+ *
+ *  @param left - first run
+ *  @param leftCount - length of the first run
+ *  @param right - second run (follows the left one)
+ *  @param rightCount - length of the second run
+ *  @param start - first merged result written
+ *  @param end - end of the merged results written
+ *  @param out - memory of the whole merged run
+ *  @param compare - comparator of the results
+ */
+static inline void mergeSlice(const Result *left, size_t leftCount,
+        const Result *right, size_t rightCount,
+        size_t start, size_t end, Result *out, ResultComparator compare)
+{
+    size_t leftStart = mergeSplit(left, leftCount, right, rightCount, start, compare);
+    size_t leftEnd = mergeSplit(left, leftCount, right, rightCount, end, compare);
+
+    mergeRuns(left + leftStart, leftEnd - leftStart,
+            right + (start - leftStart), (end - leftEnd) - (start - leftStart),
+            out + start, compare);
+}
+
+
+// mergeSlice with the comparator of every sort type inlined
+static void mergeSliceByName(const Result *left, size_t leftCount, const Result *right,
+        size_t rightCount, size_t start, size_t end, Result *out)
+{
+    mergeSlice(left, leftCount, right, rightCount, start, end, out, sortByFileName);
+}
+
+static void mergeSliceByPath(const Result *left, size_t leftCount, const Result *right,
+        size_t rightCount, size_t start, size_t end, Result *out)
+{
+    mergeSlice(left, leftCount, right, rightCount, start, end, out, sortByFilePath);
+}
+
+static void mergeSliceBySize(const Result *left, size_t leftCount, const Result *right,
+        size_t rightCount, size_t start, size_t end, Result *out)
+{
+    mergeSlice(left, leftCount, right, rightCount, start, end, out, sortByFileSize);
+}
+
+
+// work of one sorting thread: either sorting its own run,
+// or writing its part of the output of one merge round
+typedef struct
+{
+    uint8_t sortType;
+
+    // results are read from one array and written into the other one
+    Result *from;
+    Result *to;
+
+    // boundaries of the sorted runs (runCount + 1 items)
+    const size_t *runs;
+    size_t runCount;
+
+    // part of the array the thread is responsible for
+    size_t start;
+    size_t end;
+
+    pthread_t thread;
+} SortTask;
+
+
+// sorters of the whole run, indexed by the sort type
+static void (*const sorters[])(Result *, Result *, size_t) = { sortByName, sortByPath, sortBySize };
+
+// merging slices of two runs, indexed by the sort type
+static void (*const slicers[])(const Result *, size_t, const Result *, size_t, size_t, size_t, Result *) =
+        { mergeSliceByName, mergeSliceByPath, mergeSliceBySize };
+
+
+/** \brief Sort one run of the array (the thread function)
+ *
+ *  @param data - SortTask structure
+ *  @return NULL
+ */
+static void *sortRunTask(void *data)
+{
+    SortTask *task = data;
+    sorters[task->sortType](task->from + task->start, task->to + task->start, task->end - task->start);
+    return NULL;
+}
+
+
+/** \brief Merge neighbouring pairs of runs, only output positions [start, end)
+ *  are written, so all tasks of a round work on disjoint memory (the thread function)
+ *
+ *  @param data - SortTask structure
+ *  @return NULL
+ */
+static void *mergeRunsTask(void *data)
+{
+    SortTask *task = data;
+
+    for (size_t pair = 0; pair < task->runCount; pair += 2) {
+        size_t first = task->runs[pair];
+        size_t middle = task->runs[pair + 1];
+        // the last run has no pair when the count is odd, it's only copied
+        size_t last = (pair + 1 < task->runCount) ? task->runs[pair + 2] : middle;
+
+        size_t start = (task->start > first) ? task->start : first;
+        size_t end = (task->end < last) ? task->end : last;
+        if (start >= end) {
+            continue;
+        }
+
+        slicers[task->sortType](task->from + first, middle - first, task->from + middle,
+                last - middle, start - first, end - first, task->to + first);
+    }
+
+    return NULL;
+}
+
+
+/** \brief Run all of the tasks concurrently, the calling thread runs the
+ *  first one, tasks whose thread can't be created run on the caller as well
+ *
+ *  @param tasks - array of tasks
+ *  @param taskCount - number of tasks
+ *  @param function - thread function
+ */
+static void runSortTasks(SortTask *tasks, size_t taskCount, void *(*function)(void *))
+{
+    bool *started = calloc(taskCount, sizeof(bool));
+
+    for (size_t i = 1; i < taskCount; i++) {
+        if (started != NULL) {
+            started[i] = (pthread_create(&tasks[i].thread, NULL, function, tasks + i) == 0);
+        }
+        if (started == NULL || !started[i]) {
+            function(tasks + i);
+        }
+    }
+
+    function(tasks);
+
+    for (size_t i = 1; i < taskCount && started != NULL; i++) {
+        if (started[i]) {
+            pthread_join(tasks[i].thread, NULL);
+        }
+    }
+
+    free(started);
+}
+
+
+/** \brief Sort the array by several threads. Every thread sorts one run,
+ *  then pairs of runs are merged in rounds, every round is split evenly
+ *  among all threads by the merge path. All sorts are total orders, so the
+ *  output is the same as the output of the serial sort.
+ *
+ *  @param array - results that are sorted
+ *  @param buffer - memory for count results
+ *  @param count - number of results
+ *  @param sortType - 0 = by file name, 1 = by path, 2 = by file size
+ *  @param threadCount - number of threads (at least 2)
+ *  @return true on success
+ *          false on fail with memory allocation
+ */
+static bool parallelSort(Result *array, Result *buffer, size_t count, uint8_t sortType, size_t threadCount)
+{
+    SortTask *tasks = malloc(threadCount * sizeof(SortTask));
+    size_t *runs = malloc((threadCount + 1) * sizeof(size_t));
+    if (tasks == NULL || runs == NULL) {
+        free(tasks);
+        free(runs);
+        return false;
+    }
+
+    for (size_t i = 0; i <= threadCount; i++) {
+        runs[i] = count / threadCount * i + ((i < count % threadCount) ? i : count % threadCount);
+    }
+
+    for (size_t i = 0; i < threadCount; i++) {
+        tasks[i].sortType = sortType;
+        tasks[i].from = array;
+        tasks[i].to = buffer;
+        tasks[i].start = runs[i];
+        tasks[i].end = runs[i + 1];
+    }
+    runSortTasks(tasks, threadCount, sortRunTask);
+
+    Result *from = array;
+    Result *to = buffer;
+    size_t runCount = threadCount;
+
+    while (runCount > 1) {
+        for (size_t i = 0; i < threadCount; i++) {
+            tasks[i].from = from;
+            tasks[i].to = to;
+            tasks[i].runs = runs;
+            tasks[i].runCount = runCount;
+        }
+        runSortTasks(tasks, threadCount, mergeRunsTask);
+
+        // every merged pair becomes one run
+        size_t merged = 0;
+        for (size_t i = 0; i < runCount; i += 2) {
+            runs[merged++] = runs[i];
+        }
+        runs[merged] = count;
+        runCount = merged;
+
+        Result *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != array) {
+        memcpy(array, from, count * sizeof(Result));
+    }
+
+    free(tasks);
+    free(runs);
+    return true;
+}
+
+
+/** \brief Sort results in situ with a sorter specialized for the sort type
+ *
+ *  @param array - array of results
+ *  @param count - number of results
+ *  @param sortType - 0 = by file name, 1 = by path, 2 = by file size (largest first)
+ *  @param threadCount - number of threads sorting large arrays
+ *  @return true on success
+ *          false if the sorting buffer couldn't be allocated
+ */
+bool sortResultArray(Result *array, size_t count, uint8_t sortType, size_t threadCount)
+{
+    if (count < 2) {
+        return true;
+    }
+
+    Result *buffer = malloc(count * sizeof(Result));
+    if (buffer == NULL) {
+        return false;
+    }
+
+    bool result = true;
+    if (threadCount > 1 && count >= PARALLEL_SORT_THRESHOLD) {
+        result = parallelSort(array, buffer, count, sortType, threadCount);
+    } else {
+        sorters[sortType](array, buffer, count);
+    }
+
+    free(buffer);
+    return result;
+}
+
+
+/** \brief Move the result at index up the heap (the result that sorts last is on top)
+ *
+ *  @param heap - array of results
+ *  @param index - index of the result
+ *  @param sortType - order of the heap
+ */
+static void siftUp(Result *heap, size_t index, uint8_t sortType)
+{
+    Result moved = heap[index];
+
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (compareResults(heap + parent, &moved, sortType) >= 0) {
+            break;
+        }
+        heap[index] = heap[parent];
+        index = parent;
+    }
+    heap[index] = moved;
+}
+
+
+/** \brief Move the top result down the heap
+ *
+ *  @param heap - array of results
+ *  @param count - number of results in the heap
+ *  @param sortType - order of the heap
+ */
+static void siftDown(Result *heap, size_t count, uint8_t sortType)
+{
+    Result moved = heap[0];
+    size_t index = 0;
+
+    while (2 * index + 1 < count) {
+        size_t child = 2 * index + 1;
+        if (child + 1 < count && compareResults(heap + child + 1, heap + child, sortType) > 0) {
+            child++;
+        }
+        if (compareResults(heap + child, &moved, sortType) <= 0) {
+            break;
+        }
+        heap[index] = heap[child];
+        index = child;
+    }
+    heap[index] = moved;
+}
+
+
+/** \brief Determine if a result would be kept by the heap
+ *
+ *  @param res - Results structure with a limit
+ *  @param result - the result
+ *  @return true if there's room or the result sorts before the top one
+ */
+static inline bool fitsIntoTop(const Results *res, const Result *result)
+{
+    return res->arrayIndex < res->limit
+            || compareResults(result, res->resultsArray, res->sortType) < 0;
+}
+
+
+/** \brief Put a result into the heap, the top result is dropped when the heap is full
+ *
+ *  @param res - Results structure with a limit
+ *  @param result - the result (its path is owned by the heap afterwards,
+ *                  it's freed if an error occurs)
+ *  @return true on success
+ *          false on fail with memory allocation
+ */
+static bool insertTopResult(Results *res, Result result)
+{
+    size_t pathBytes = strlen(result.filePath) + 1;
+
+    if (res->arrayIndex == res->limit) {
+        res->pathBytes -= strlen(res->resultsArray[0].filePath) + 1;
+        res->pathBytes += pathBytes;
+        free(res->resultsArray[0].filePath);
+        res->resultsArray[0] = result;
+        siftDown(res->resultsArray, res->arrayIndex, res->sortType);
+        return true;
+    }
+
+    // the array doubles, but it never gets larger than the limit
+    if (res->arrayAllocatedSize <= res->arrayIndex) {
+        size_t newSize = (res->arrayAllocatedSize == 0) ? TOP_RESULTS_INITIAL_SIZE : res->arrayAllocatedSize * 2;
+        newSize = (newSize > res->limit) ? res->limit : newSize;
+
+        Result *reallocated = realloc(res->resultsArray, newSize * sizeof(Result));
+        if (reallocated == NULL) {
+            free(result.filePath);
+            return false;
+        }
+
+        res->resultsArray = reallocated;
+        res->arrayAllocatedSize = newSize;
+    }
+
+    res->resultsArray[res->arrayIndex] = result;
+    siftUp(res->resultsArray, res->arrayIndex++, res->sortType);
+    res->pathBytes += pathBytes;
+    return true;
+}
+
+
+/** \brief Keep a file if it's among the first res->limit results of the sort
+ *  order. The path is copied only when the file is kept, the result that
+ *  drops out of the heap is freed immediately.
+ *
+ *  @param res - Results structure with a limit
+ *  @param filePath - path to the file (terminated at pathLength)
+ *  @param pathLength - length of the path
+ *  @param stats - stats of the file (its size, mode and owner are kept)
+ *  @param pattern - index of the pattern the file matched (NO_PATTERN if not annotated)
+ *  @return true if successful (whether the file was kept or not)
+ *          false if an allocation error occurred
+ */
+bool offerTopResult(Results *res, char *filePath, size_t pathLength, const struct stat *stats, int32_t pattern)
+{
+    // the candidate points into the caller's path until it's kept
+    Result candidate;
+    candidate.filePath = filePath;
+    candidate.fileSize = stats->st_size;
+    candidate.fileMode = stats->st_mode;
+    candidate.fileOwner = stats->st_uid;
+    candidate.pattern = pattern;
+    setSortKeys(&candidate);
+
+    if (!fitsIntoTop(res, &candidate)) {
+        return true;
+    }
+
+    candidate.filePath = malloc(pathLength + 1);
+    if (candidate.filePath == NULL) {
+        return false;
+    }
+    memcpy(candidate.filePath, filePath, pathLength);
+    candidate.filePath[pathLength] = '\0';
+
+    return insertTopResult(res, candidate);
+}
+
+
+/** \brief Offer all results of src to the heap of dest, src is emptied
+ *
+ *  @param dest - Results structure with a limit
+ *  @param src - Results structure with the same limit
+ *  @return true if successful
+ *          false if an allocation error occurred (src keeps the results not merged yet)
+ */
+bool mergeTopResults(Results *dest, Results *src)
+{
+    while (src->arrayIndex > 0) {
+        // the result is owned by dest from now on (or freed)
+        Result result = src->resultsArray[--src->arrayIndex];
+        src->pathBytes -= strlen(result.filePath) + 1;
+
+        if (!fitsIntoTop(dest, &result)) {
+            free(result.filePath);
+        } else if (!insertTopResult(dest, result)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,55 @@
+#include "userStructures.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef RESULT_SORT_DEFINED
+#define RESULT_SORT_DEFINED
+
+/** \brief Compute sort keys of a result (offset of the file name and its
+ *  folded prefix), the path has to be stored already
+ *
+ *  @param result - Result structure
+ */
+void setSortKeys(Result *result);
+
+
+/** \brief Sort results in situ, arrays above a threshold are sorted by
+ *  several threads with the same output
+ *
+ *  @param array - array of results
+ *  @param count - number of results
+ *  @param sortType - 0 = by file name, 1 = by path, 2 = by file size (largest first)
+ *  @param threadCount - number of threads that may be used
+ *  @return true if successful
+ *          false if the sorting buffer couldn't be allocated
+ */
+bool sortResultArray(Result *array, size_t count, uint8_t sortType, size_t threadCount);
+
+
+
+/** \brief Keep a file if it's among the first res->limit results of the sort
+ *  order. The path is copied only when the file is kept, the result that
+ *  drops out of the heap is freed immediately.
+ *
+ *  @param res - Results structure with a limit
+ *  @param filePath - path to the file (terminated at pathLength)
+ *  @param pathLength - length of the path
+ *  @param stats - stats of the file (its size, mode and owner are kept)
+ *  @param pattern - index of the pattern the file matched (NO_PATTERN if not annotated)
+ *  @return true if successful (whether the file was kept or not)
+ *          false if an allocation error occurred
+ */
+bool offerTopResult(Results *res, char *filePath, size_t pathLength, const struct stat *stats, int32_t pattern);
+
+
+/** \brief Offer all results of src to the heap of dest, src is emptied
+ *
+ *  @param dest - Results structure with a limit
+ *  @param src - Results structure with the same limit
+ *  @return true if successful
+ *          false if an allocation error occurred (src keeps the results not merged yet)
+ */
+bool mergeTopResults(Results *dest, Results *src);
+
+#endif
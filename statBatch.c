@@ -0,0 +1,427 @@
+#include "statBatch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(USE_IO_URING) && defined(__linux__)
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define IO_URING_BATCH 1
+#endif
+
+// number of requests submitted at once (size of the submission ring)
+const unsigned int STAT_BATCH_SIZE = 256;
+const size_t STAT_NAMES_INITIAL_SIZE = 4096;
+
+
+#ifdef IO_URING_BATCH
+/** \brief Unmap the rings and close the io_uring instance
+ *
+ *  @param batch - StatBatch structure
+ */
+static void closeRing(StatBatch *batch)
+{
+    if (batch->submissionEntries != NULL)
+        munmap(batch->submissionEntries, batch->submissionEntriesSize);
+    if (batch->completionRing != NULL && batch->completionRing != batch->submissionRing)
+        munmap(batch->completionRing, batch->completionRingSize);
+    if (batch->submissionRing != NULL)
+        munmap(batch->submissionRing, batch->submissionRingSize);
+    if (batch->ringFd >= 0)
+        close(batch->ringFd);
+
+    batch->submissionEntries = NULL;
+    batch->completionRing = NULL;
+    batch->submissionRing = NULL;
+    batch->ringFd = -1;
+}
+
+
+/** \brief Map a part of the io_uring instance into memory
+ *
+ *  @param ringFd - io_uring descriptor
+ *  @param size - size of the mapping
+ *  @param offset - IORING_OFF_* offset
+ *  @return the mapping, NULL on fail
+ */
+static void *mapRing(int ringFd, size_t size, off_t offset)
+{
+    void *mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ringFd, offset);
+    return (mapped == MAP_FAILED) ? NULL : mapped;
+}
+
+
+/** \brief Create the io_uring instance and map its rings
+ *
+ *  @param batch - StatBatch structure
+ *  @return true on success
+ *          false if io_uring is not available (batch is left without a ring)
+ */
+static bool openRing(StatBatch *batch)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    batch->ringFd = (int) syscall(__NR_io_uring_setup, STAT_BATCH_SIZE, &params);
+    if (batch->ringFd < 0) {
+        batch->ringFd = -1;
+        return false;
+    }
+
+    batch->ringEntries = params.sq_entries;
+    batch->submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    batch->completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    batch->submissionEntriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // newer kernels map both rings at once
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (batch->completionRingSize > batch->submissionRingSize) {
+            batch->submissionRingSize = batch->completionRingSize;
+        }
+        batch->completionRingSize = batch->submissionRingSize;
+    }
+
+    batch->submissionRing = mapRing(batch->ringFd, batch->submissionRingSize, IORING_OFF_SQ_RING);
+    if (batch->submissionRing != NULL && (params.features & IORING_FEAT_SINGLE_MMAP)) {
+        batch->completionRing = batch->submissionRing;
+    } else if (batch->submissionRing != NULL) {
+        batch->completionRing = mapRing(batch->ringFd, batch->completionRingSize, IORING_OFF_CQ_RING);
+    }
+    if (batch->completionRing != NULL) {
+        batch->submissionEntries = mapRing(batch->ringFd, batch->submissionEntriesSize, IORING_OFF_SQES);
+    }
+
+    batch->statxBuffers = calloc(batch->ringEntries, sizeof(struct statx));
+
+    if (batch->submissionEntries == NULL || batch->statxBuffers == NULL) {
+        closeRing(batch);
+        return false;
+    }
+
+    char *submissionRing = batch->submissionRing;
+    char *completionRing = batch->completionRing;
+    batch->submissionHead = (unsigned int *) (submissionRing + params.sq_off.head);
+    batch->submissionTail = (unsigned int *) (submissionRing + params.sq_off.tail);
+    batch->submissionMask = (unsigned int *) (submissionRing + params.sq_off.ring_mask);
+    batch->submissionArray = (unsigned int *) (submissionRing + params.sq_off.array);
+    batch->completionHead = (unsigned int *) (completionRing + params.cq_off.head);
+    batch->completionTail = (unsigned int *) (completionRing + params.cq_off.tail);
+    batch->completionMask = (unsigned int *) (completionRing + params.cq_off.ring_mask);
+    batch->completionEntries = completionRing + params.cq_off.cqes;
+    return true;
+}
+
+
+/** \brief Enter the kernel, retry when interrupted
+ *
+ *  @param batch - StatBatch structure
+ *  @param toSubmit - number of new submission entries
+ *  @param minComplete - number of completions to wait for
+ *  @return number of submitted entries, -1 on error
+ */
+static int enterRing(StatBatch *batch, unsigned int toSubmit, unsigned int minComplete)
+{
+    unsigned int flags = (minComplete > 0) ? IORING_ENTER_GETEVENTS : 0;
+    long result = 0;
+
+    do {
+        result = syscall(__NR_io_uring_enter, batch->ringFd, toSubmit, minComplete, flags, NULL, 0);
+    } while (result < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+
+    return (int) result;
+}
+
+
+/** \brief Get the statx mask for the requested STAT_FIELD_* flags
+ *
+ *  @param fields - STAT_FIELD_* flags
+ *  @return STATX_* mask
+ */
+static unsigned int getStatxMask(uint8_t fields)
+{
+    unsigned int mask = STATX_TYPE;
+    mask |= (fields & STAT_FIELD_MODE) ? STATX_MODE : 0;
+    mask |= (fields & STAT_FIELD_UID) ? STATX_UID : 0;
+    mask |= (fields & STAT_FIELD_SIZE) ? STATX_SIZE : 0;
+    mask |= (fields & STAT_FIELD_GID) ? STATX_GID : 0;
+    return mask;
+}
+#endif
+
+
+/** \brief Initialize an empty batch and try to create its io_uring instance
+ *
+ *  @param batch - StatBatch structure
+ *  @param fields - STAT_FIELD_* flags the requests need
+ *  @param useIoUring - if false, no io_uring instance is created
+ *  @return true if io_uring is used
+ */
+bool initStatBatch(StatBatch *batch, uint8_t fields, bool useIoUring)
+{
+    memset(batch, 0, sizeof(StatBatch));
+    batch->ringFd = -1;
+    batch->directoryFd = -1;
+    batch->fields = fields;
+
+#ifdef IO_URING_BATCH
+    return useIoUring && openRing(batch);
+#else
+    (void) useIoUring;
+    return false;
+#endif
+}
+
+
+/** \brief Determine if the batch can't take any more requests
+ *
+ *  @param batch - StatBatch structure
+ *  @return true if the batch is full
+ */
+bool statBatchFull(StatBatch *batch)
+{
+    return (batch->count >= STAT_BATCH_SIZE || (batch->ringFd >= 0 && batch->count >= batch->ringEntries));
+}
+
+
+/** \brief Add a request, the name is copied into the batch
+ *
+ *  @param batch - StatBatch structure
+ *  @param name - name of the element
+ *  @return true on success
+ *          false on memory allocation fail
+ */
+bool addStatRequest(StatBatch *batch, char *name)
+{
+    size_t nameLength = strlen(name) + 1;
+
+    if (batch->count == batch->allocatedSize) {
+        StatRequest *reallocated = realloc(batch->requests, STAT_BATCH_SIZE * sizeof(StatRequest));
+        if (reallocated == NULL) {
+            return false;
+        }
+        batch->requests = reallocated;
+        batch->allocatedSize = STAT_BATCH_SIZE;
+    }
+
+    if (batch->namesLength + nameLength > batch->namesAllocatedSize) {
+        size_t newSize = (batch->namesAllocatedSize == 0) ? STAT_NAMES_INITIAL_SIZE : batch->namesAllocatedSize;
+        while (newSize < batch->namesLength + nameLength) {
+            newSize *= 2;
+        }
+
+        char *reallocated = realloc(batch->names, newSize);
+        if (reallocated == NULL) {
+            return false;
+        }
+        batch->names = reallocated;
+        batch->namesAllocatedSize = newSize;
+    }
+
+    StatRequest *request = batch->requests + batch->count++;
+    request->nameOffset = batch->namesLength;
+    request->error = 0;
+    request->done = false;
+    memcpy(batch->names + batch->namesLength, name, nameLength);
+    batch->namesLength += nameLength;
+    return true;
+}
+
+
+/** \brief Get name of the element of a request
+ *
+ *  @param batch - StatBatch structure
+ *  @param request - StatRequest of the batch
+ *  @return name of the element
+ */
+char *statRequestName(StatBatch *batch, StatRequest *request)
+{
+    return batch->names + request->nameOffset;
+}
+
+
+/** \brief Stat an element synchronously (fallback without io_uring)
+ *
+ *  @param batch - StatBatch structure
+ *  @param request - StatRequest that's completed
+ */
+static void completeSynchronously(StatBatch *batch, StatRequest *request)
+{
+    errno = 0;
+    if (fstatat(batch->directoryFd, statRequestName(batch, request), &request->buf, AT_SYMLINK_NOFOLLOW) != 0) {
+        request->error = errno;
+    }
+    request->done = true;
+}
+
+
+/** \brief Submit all requests of the batch to io_uring (without waiting),
+ *  without io_uring the requests are completed one by one when asked for
+ *
+ *  @param batch - StatBatch structure
+ *  @param directoryFd - directory the names are relative to
+ */
+void submitStatBatch(StatBatch *batch, int directoryFd)
+{
+    batch->directoryFd = directoryFd;
+    batch->completed = 0;
+
+#ifdef IO_URING_BATCH
+    if (batch->ringFd < 0 || batch->count == 0) {
+        return;
+    }
+
+    struct io_uring_sqe *entries = batch->submissionEntries;
+    struct statx *statxBuffers = batch->statxBuffers;
+    unsigned int tail = *batch->submissionTail;
+    unsigned int mask = *batch->submissionMask;
+    unsigned int statxMask = getStatxMask(batch->fields);
+
+    for (size_t i = 0; i < batch->count; i++) {
+        unsigned int index = tail & mask;
+        struct io_uring_sqe *entry = entries + index;
+
+        memset(entry, 0, sizeof(struct io_uring_sqe));
+        entry->opcode = IORING_OP_STATX;
+        entry->fd = directoryFd;
+        entry->addr = (uint64_t) (uintptr_t) statRequestName(batch, batch->requests + i);
+        entry->len = statxMask;
+        entry->off = (uint64_t) (uintptr_t) (statxBuffers + i);
+        entry->statx_flags = AT_SYMLINK_NOFOLLOW;
+        entry->user_data = i;
+
+        batch->submissionArray[index] = index;
+        tail++;
+    }
+
+    // the kernel may read the entries only after they are written
+    __atomic_store_n(batch->submissionTail, tail, __ATOMIC_RELEASE);
+
+    // without a successful submission the requests are completed synchronously
+    if (enterRing(batch, (unsigned int) batch->count, 0) != (int) batch->count) {
+        closeRing(batch);
+    }
+#endif
+}
+
+
+#ifdef IO_URING_BATCH
+/** \brief Take one completion from the completion ring, wait for it if needed
+ *
+ *  @param batch - StatBatch structure
+ *  @return completed request, NULL if io_uring failed
+ */
+static StatRequest *reapCompletion(StatBatch *batch)
+{
+    struct io_uring_cqe *completionEntries = batch->completionEntries;
+    struct statx *statxBuffers = batch->statxBuffers;
+
+    while (true) {
+        unsigned int head = *batch->completionHead;
+        unsigned int tail = __atomic_load_n(batch->completionTail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (enterRing(batch, 0, 1) < 0) {
+                closeRing(batch);
+                return NULL;
+            }
+            continue;
+        }
+
+        struct io_uring_cqe *entry = completionEntries + (head & *batch->completionMask);
+        StatRequest *request = batch->requests + entry->user_data;
+        int result = entry->res;
+        __atomic_store_n(batch->completionHead, head + 1, __ATOMIC_RELEASE);
+
+        struct statx *statxBuffer = statxBuffers + entry->user_data;
+        if (result == -EINVAL || result == -EOPNOTSUPP) {
+            // kernel without IORING_OP_STATX
+            completeSynchronously(batch, request);
+        } else if (result < 0) {
+            request->error = -result;
+            request->done = true;
+        } else {
+            // only requested fields are copied
+            request->buf.st_mode = statxBuffer->stx_mode;
+            request->buf.st_uid = statxBuffer->stx_uid;
+            request->buf.st_gid = statxBuffer->stx_gid;
+            request->buf.st_size = (off_t) statxBuffer->stx_size;
+            request->done = true;
+        }
+
+        return request;
+    }
+}
+#endif
+
+
+/** \brief Hand out the next completed request
+ *
+ *  @param batch - StatBatch structure
+ *  @param request - the completed request is stored here
+ *  @return true if a request was completed
+ *          false if all requests were handed out
+ */
+bool nextStatCompletion(StatBatch *batch, StatRequest **request)
+{
+    if (batch->completed == batch->count) {
+        return false;
+    }
+
+#ifdef IO_URING_BATCH
+    if (batch->ringFd >= 0) {
+        *request = reapCompletion(batch);
+        if (*request != NULL) {
+            batch->completed++;
+            return true;
+        }
+    }
+#endif
+
+    // synchronous fallback, complete the first request not handed out yet
+    for (size_t i = 0; i < batch->count; i++) {
+        if (!batch->requests[i].done) {
+            completeSynchronously(batch, batch->requests + i);
+            *request = batch->requests + i;
+            batch->completed++;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** \brief Forget all requests of the batch
+ *
+ *  @param batch - StatBatch structure
+ */
+void clearStatBatch(StatBatch *batch)
+{
+    batch->count = 0;
+    batch->completed = 0;
+    batch->namesLength = 0;
+}
+
+
+/** \brief Free everything used by the batch
+ *
+ *  @param batch - StatBatch structure
+ */
+void freeStatBatch(StatBatch *batch)
+{
+#ifdef IO_URING_BATCH
+    closeRing(batch);
+#endif
+    free(batch->statxBuffers);
+    free(batch->requests);
+    free(batch->names);
+    memset(batch, 0, sizeof(StatBatch));
+    batch->ringFd = -1;
+}
@@ -0,0 +1,144 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#ifndef STAT_BATCH_DEFINED
+#define STAT_BATCH_DEFINED
+
+// flags of struct stat fields, that are needed by the enabled checks
+#define STAT_FIELD_MODE 0x1
+#define STAT_FIELD_UID 0x2
+#define STAT_FIELD_SIZE 0x4
+#define STAT_FIELD_GID 0x8
+
+// one stat request of a batch
+typedef struct
+{
+    // offset of the element's name within the batch's names
+    size_t nameOffset;
+    // 0 on success, errno value otherwise
+    int error;
+    // stats of the element (only fields requested by the mask are valid)
+    struct stat buf;
+    // set when the request is completed
+    bool done;
+} StatRequest;
+
+
+// batch of stat requests within one directory, submitted to io_uring at once
+typedef struct
+{
+    // requests of the current batch
+    StatRequest *requests;
+    size_t count;
+    // requests that were already handed out as completed
+    size_t completed;
+    size_t allocatedSize;
+
+    // names of the elements (copied, the reader reuses its memory)
+    char *names;
+    size_t namesLength;
+    size_t namesAllocatedSize;
+
+    // directory the names are relative to
+    int directoryFd;
+    // STAT_FIELD_* flags requested by the checks
+    uint8_t fields;
+
+    // io_uring instance, ringFd is -1 when io_uring is not used
+    int ringFd;
+    unsigned int ringEntries;
+    void *submissionRing;
+    size_t submissionRingSize;
+    void *completionRing;
+    size_t completionRingSize;
+    void *submissionEntries;
+    size_t submissionEntriesSize;
+
+    // pointers into the shared rings
+    unsigned int *submissionHead;
+    unsigned int *submissionTail;
+    unsigned int *submissionMask;
+    unsigned int *submissionArray;
+    unsigned int *completionHead;
+    unsigned int *completionTail;
+    unsigned int *completionMask;
+    void *completionEntries;
+
+    // kernel results of the requests (struct statx, kept opaque here)
+    void *statxBuffers;
+} StatBatch;
+
+
+/** \brief Create an empty StatBatch, try to set up io_uring for it if desired
+ *
+ *  @param batch - StatBatch structure that's initialized
+ *  @param fields - STAT_FIELD_* flags the requests need
+ *  @param useIoUring - if false, no io_uring instance is created
+ *  @return true if io_uring is used
+ *          false if the batch falls back to synchronous fstatat
+ *          (io_uring is not compiled in or not available in the kernel)
+ */
+bool initStatBatch(StatBatch *batch, uint8_t fields, bool useIoUring);
+
+
+/** \brief Determine if the batch can accept more requests before it has to be submitted
+ *
+ *  @param batch - StatBatch structure
+ *  @return true if the batch is full
+ */
+bool statBatchFull(StatBatch *batch);
+
+
+/** \brief Add a request for an element of a directory
+ *
+ *  @param batch - StatBatch structure
+ *  @param name - name of the element (copied)
+ *  @return true on success
+ *          false on memory allocation fail
+ */
+bool addStatRequest(StatBatch *batch, char *name);
+
+
+/** \brief Submit all requests of the batch
+ *
+ *  @param batch - StatBatch structure
+ *  @param directoryFd - directory the names are relative to
+ */
+void submitStatBatch(StatBatch *batch, int directoryFd);
+
+
+/** \brief Wait for the next completed request (in order of completion)
+ *
+ *  @param batch - StatBatch structure
+ *  @param request - the completed request is stored here
+ *  @return true if a request was completed
+ *          false if all requests of the batch were handed out
+ */
+bool nextStatCompletion(StatBatch *batch, StatRequest **request);
+
+
+/** \brief Get name of the element of a request
+ *
+ *  @param batch - StatBatch structure
+ *  @param request - StatRequest of the batch
+ *  @return name of the element
+ */
+char *statRequestName(StatBatch *batch, StatRequest *request);
+
+
+/** \brief Forget all requests, so that the batch can be filled again
+ *
+ *  @param batch - StatBatch structure
+ */
+void clearStatBatch(StatBatch *batch);
+
+
+/** \brief Free heap memory and io_uring instance used by the batch
+ *
+ *  @param batch - StatBatch structure
+ */
+void freeStatBatch(StatBatch *batch);
+
+#endif
@@ -0,0 +1,413 @@
+#include "threadPool.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+const int DEQUE_REALLOCATION = 64;
+
+
+/** \brief Initialize an empty deque
+ *
+ *  @param deque - TaskDeque structure
+ *  @return true on success
+ *          false if the mutex couldn't be created
+ */
+static bool initDeque(TaskDeque *deque)
+{
+    deque->tasks = NULL;
+    deque->head = 0;
+    deque->count = 0;
+    deque->allocatedSize = 0;
+    return (pthread_mutex_init(&deque->lock, NULL) == 0);
+}
+
+
+/** \brief Free all tasks left in the deque and the deque itself
+ *
+ *  @param deque - TaskDeque structure
+ */
+static void freeDeque(TaskDeque *deque)
+{
+    // tasks are left in the deque only when the traversal failed
+    for (size_t i = 0; i < deque->count; i++) {
+        DirectoryTask *task = deque->tasks + (deque->head + i) % deque->allocatedSize;
+        free(task->path);
+        releaseSharedDirectory(task->parent);
+    }
+
+    if (deque->tasks != NULL)
+        free(deque->tasks);
+
+    pthread_mutex_destroy(&deque->lock);
+}
+
+
+/** \brief Add a task at the tail of the deque, grow the deque when it's full
+ *
+ *  @param deque - TaskDeque structure (has to be locked)
+ *  @param task - task to be stored
+ *  @return true on success
+ *          false on memory allocation fail
+ */
+static bool dequePushTail(TaskDeque *deque, DirectoryTask task)
+{
+    if (deque->count == deque->allocatedSize) {
+        size_t newSize = deque->allocatedSize + DEQUE_REALLOCATION;
+        DirectoryTask *reallocated = malloc(newSize * sizeof(DirectoryTask));
+
+        if (reallocated == NULL) {
+            return false;
+        }
+
+        // unwrap the circular array into the new one
+        for (size_t i = 0; i < deque->count; i++) {
+            reallocated[i] = deque->tasks[(deque->head + i) % deque->allocatedSize];
+        }
+
+        free(deque->tasks);
+        deque->tasks = reallocated;
+        deque->allocatedSize = newSize;
+        deque->head = 0;
+    }
+
+    deque->tasks[(deque->head + deque->count) % deque->allocatedSize] = task;
+    deque->count++;
+    return true;
+}
+
+
+/** \brief Take a task from the tail of the worker's own deque (newest first)
+ *
+ *  @param deque - TaskDeque structure
+ *  @param task - the task is stored here
+ *  @return true if a task was taken
+ *          false if the deque is empty
+ */
+static bool dequePopTail(TaskDeque *deque, DirectoryTask *task)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        deque->count--;
+        *task = deque->tasks[(deque->head + deque->count) % deque->allocatedSize];
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+
+/** \brief Steal a task from the head of another worker's deque (oldest first,
+ *  these are usually the biggest subtrees)
+ *
+ *  @param deque - TaskDeque structure
+ *  @param task - the task is stored here
+ *  @return true if a task was stolen
+ *          false if the deque is empty
+ */
+static bool dequePopHead(TaskDeque *deque, DirectoryTask *task)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->allocatedSize;
+        deque->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+
+/** \brief Try to steal a task from any other worker, starting with a random victim
+ *
+ *  @param worker - worker which is looking for work
+ *  @param task - the task is stored here
+ *  @return true if a task was stolen
+ *          false if all of the deques are empty
+ */
+static bool stealTask(Worker *worker, DirectoryTask *task)
+{
+    ThreadPool *pool = worker->pool;
+
+    // simple linear congruential generator, good enough to spread the thieves
+    worker->seed = worker->seed * 1103515245u + 12345u;
+    size_t start = (worker->seed >> 16) % pool->workerCount;
+
+    for (size_t i = 0; i < pool->workerCount; i++) {
+        Worker *victim = pool->workers + ((start + i) % pool->workerCount);
+        if (victim != worker && dequePopHead(&victim->deque, task)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** \brief Keep a duplicate of a directory descriptor for the queued subdirectories
+ *
+ *  @param fd - descriptor of the directory
+ *  @return SharedDirectory with one reference
+ *          NULL if the descriptor couldn't be duplicated or on memory allocation fail
+ */
+SharedDirectory *shareDirectory(int fd)
+{
+    SharedDirectory *directory = malloc(sizeof(SharedDirectory));
+    if (directory == NULL) {
+        return NULL;
+    }
+
+    directory->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (directory->fd < 0 || pthread_mutex_init(&directory->lock, NULL) != 0) {
+        if (directory->fd >= 0) {
+            close(directory->fd);
+        }
+        free(directory);
+        return NULL;
+    }
+
+    directory->references = 1;
+    return directory;
+}
+
+
+/** \brief Add a reference to a shared directory
+ *
+ *  @param directory - SharedDirectory structure
+ */
+void acquireSharedDirectory(SharedDirectory *directory)
+{
+    pthread_mutex_lock(&directory->lock);
+    directory->references++;
+    pthread_mutex_unlock(&directory->lock);
+}
+
+
+/** \brief Drop a reference to a shared directory, the descriptor is closed
+ *  with the last one
+ *
+ *  @param directory - SharedDirectory structure (can be NULL)
+ */
+void releaseSharedDirectory(SharedDirectory *directory)
+{
+    if (directory == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&directory->lock);
+    bool last = (--directory->references == 0);
+    pthread_mutex_unlock(&directory->lock);
+
+    if (last) {
+        close(directory->fd);
+        pthread_mutex_destroy(&directory->lock);
+        free(directory);
+    }
+}
+
+
+/** \brief Push a new task into the worker's deque and wake up a sleeping worker
+ *
+ *  @param worker - worker that found the task
+ *  @param path - path of the directory (ownership is passed to the pool)
+ *  @param depth - depth of the directory
+ *  @param parent - directory the name is opened in, the caller's reference
+ *                  is passed to the task (NULL = the path is opened)
+ *  @param nameOffset - offset of the name within the path
+ *  @return true on success
+ *          false on memory allocation fail (the reference and the path stay with the caller)
+ */
+bool pushTask(Worker *worker, char *path, size_t depth, SharedDirectory *parent, size_t nameOffset)
+{
+    ThreadPool *pool = worker->pool;
+    DirectoryTask task = { path, depth, parent, nameOffset };
+
+    // the task is counted before it becomes visible, otherwise a thief could
+    // decrement the counters first (underflow or an early exit of the workers)
+    pthread_mutex_lock(&pool->lock);
+    pool->pendingTasks++;
+    pool->queuedTasks++;
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_lock(&worker->deque.lock);
+    bool pushed = dequePushTail(&worker->deque, task);
+    pthread_mutex_unlock(&worker->deque.lock);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pushed) {
+        pthread_cond_signal(&pool->wakeUp);
+    } else {
+        pool->pendingTasks--;
+        pool->queuedTasks--;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return pushed;
+}
+
+
+/** \brief Main loop of a worker thread. Take own tasks first, steal
+ *  when there's nothing left and sleep when nothing can be stolen.
+ *
+ *  @param arg - Worker structure
+ *  @return NULL
+ */
+static void *workerLoop(void *arg)
+{
+    Worker *worker = arg;
+    ThreadPool *pool = worker->pool;
+    DirectoryTask task;
+
+    while (true) {
+        if (dequePopTail(&worker->deque, &task) || stealTask(worker, &task)) {
+            pthread_mutex_lock(&pool->lock);
+            pool->queuedTasks--;
+            bool failed = pool->failed;
+            pthread_mutex_unlock(&pool->lock);
+
+            // after a fail the remaining tasks are only drained
+            bool success = failed || pool->processor(worker, &task, pool->userData);
+            free(task.path);
+            releaseSharedDirectory(task.parent);
+
+            pthread_mutex_lock(&pool->lock);
+            pool->pendingTasks--;
+            if (!success) {
+                pool->failed = true;
+            }
+            if (pool->pendingTasks == 0) {
+                pthread_cond_broadcast(&pool->wakeUp);
+            }
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        // nothing to do, wait until some task gets queued or everything is done
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queuedTasks == 0 && pool->pendingTasks > 0) {
+            pthread_cond_wait(&pool->wakeUp, &pool->lock);
+        }
+        bool done = (pool->pendingTasks == 0);
+        pthread_mutex_unlock(&pool->lock);
+
+        if (done) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+
+/** \brief Run the work stealing traversal, merge results of all workers
+ *
+ *  @param workerCount - number of threads used
+ *  @param firstTasks - tasks the traversal starts with, one per start directory
+ *                     (the pool takes ownership of their paths)
+ *  @param taskCount - number of the first tasks
+ *  @param processor - function called for every task
+ *  @param userData - argument passed into the processor
+ *  @param state - TraversalState structure, results and statistics of all
+ *                workers are merged into it
+ *  @return true if all tasks were processed successfully
+ *          false if any task failed or threads couldn't be created
+ */
+bool runThreadPool(size_t workerCount,
+        DirectoryTask *firstTasks,
+        size_t taskCount,
+        TaskProcessor processor,
+        void *userData,
+        TraversalState *state)
+{
+    ThreadPool pool;
+    pool.workerCount = workerCount;
+    pool.pendingTasks = 0;
+    pool.queuedTasks = 0;
+    pool.failed = false;
+    pool.processor = processor;
+    pool.userData = userData;
+
+    pool.workers = calloc(workerCount, sizeof(Worker));
+    if (pool.workers == NULL) {
+        fprintf(stderr, "Couldn't allocate worker threads.\n");
+        for (size_t i = 0; i < taskCount; i++) {
+            free(firstTasks[i].path);
+        }
+        return false;
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.wakeUp, NULL);
+
+    for (size_t i = 0; i < workerCount; i++) {
+        pool.workers[i].pool = &pool;
+        pool.workers[i].index = i;
+        pool.workers[i].state = initTraversalState(state->pArgs);
+        pool.workers[i].state.startTime = state->startTime;
+        pool.workers[i].state.roots = state->roots;
+        pool.workers[i].state.rootCount = state->rootCount;
+        // worker 0 runs on the calling thread, but its spans get a track of their own
+        if (pool.workers[i].state.trace != NULL) {
+            pool.workers[i].state.trace->thread = i + 1;
+        }
+        pool.workers[i].seed = (unsigned int) i + 1;
+        pool.workers[i].scanned = NULL;
+        initDeque(&pool.workers[i].deque);
+    }
+
+    // the start directories are dealt to the workers, each one is an independent
+    // unit of work (the rest of the workers steals from them)
+    bool success = true;
+    for (size_t i = 0; i < taskCount; i++) {
+        success = success && pushTask(pool.workers + i % workerCount, firstTasks[i].path, firstTasks[i].depth,
+                firstTasks[i].parent, firstTasks[i].nameOffset);
+        if (!success) {
+            free(firstTasks[i].path);
+        }
+    }
+
+    // the calling thread works as the first worker
+    size_t started = 1;
+    while (success && started < workerCount) {
+        if (pthread_create(&pool.workers[started].thread, NULL,
+                    workerLoop, pool.workers + started) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    if (success) {
+        workerLoop(pool.workers);
+    }
+
+    for (size_t i = 1; i < started; i++) {
+        pthread_join(pool.workers[i].thread, NULL);
+    }
+
+    success = success && !pool.failed;
+
+    // merge thread-local results, even on fail so that everything is freed
+    for (size_t i = 0; i < workerCount; i++) {
+        if (success && !mergeTraversalState(state, &pool.workers[i].state)) {
+            success = false;
+        }
+        freeTraversalState(&pool.workers[i].state);
+        freeDeque(&pool.workers[i].deque);
+    }
+
+    pthread_cond_destroy(&pool.wakeUp);
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.workers);
+
+    return success;
+}
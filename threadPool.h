@@ -0,0 +1,166 @@
+#include "userStructures.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef THREAD_POOL_DEFINED
+#define THREAD_POOL_DEFINED
+
+// descriptor of a scanned directory, kept open until all of its queued
+// subdirectories were opened relative to it
+typedef struct
+{
+    int fd;
+    // tasks (and the scan) using the descriptor
+    size_t references;
+    // protects the references
+    pthread_mutex_t lock;
+} SharedDirectory;
+
+
+// one pending directory that's waiting to be scanned
+typedef struct
+{
+    // path to the directory (owned by the task)
+    char *path;
+
+    // recursive depth of the directory (0 = base directory)
+    size_t depth;
+
+    // parent directory the name is opened in (the task holds a reference),
+    // NULL if the whole path is opened
+    SharedDirectory *parent;
+    // offset of the name within the path
+    size_t nameOffset;
+} DirectoryTask;
+
+
+// double ended queue of tasks, the owner works on the tail,
+// other workers steal from the head
+typedef struct
+{
+    // circular array of tasks
+    DirectoryTask *tasks;
+    // index of the first task
+    size_t head;
+    // number of tasks stored
+    size_t count;
+    // maximum allocated size, used in realloc
+    size_t allocatedSize;
+    // protects the whole deque
+    pthread_mutex_t lock;
+} TaskDeque;
+
+
+typedef struct ThreadPool ThreadPool;
+
+
+// structure stores everything that belongs to one worker thread
+typedef struct
+{
+    // pool the worker belongs to
+    ThreadPool *pool;
+    // index of the worker within the pool
+    size_t index;
+    // directories waiting to be scanned by this worker
+    TaskDeque deque;
+    // thread-local results, path and counters, merged after the traversal
+    TraversalState state;
+    // state of the random generator used to pick a victim for stealing
+    unsigned int seed;
+    // descriptor of the directory that's being scanned, shared once a subdirectory is queued
+    SharedDirectory *scanned;
+    // thread itself
+    pthread_t thread;
+} Worker;
+
+
+// function called by workers for every task, returns false on fatal error
+typedef bool (*TaskProcessor)(Worker *worker, DirectoryTask *task, void *userData);
+
+
+// structure stores the shared state of all workers
+struct ThreadPool
+{
+    // array of workers
+    Worker *workers;
+    size_t workerCount;
+
+    // protects counters below
+    pthread_mutex_t lock;
+    // signalled when a task is queued or the work is done
+    pthread_cond_t wakeUp;
+
+    // tasks which were pushed and not finished yet
+    size_t pendingTasks;
+    // tasks which are sitting in one of the deques
+    size_t queuedTasks;
+    // set when any task fails, all workers stop afterwards
+    bool failed;
+
+    // function processing one task and its argument
+    TaskProcessor processor;
+    void *userData;
+};
+
+
+/** \brief Run the work stealing traversal. Workers process the first task
+ *  and every task pushed afterwards until there's nothing left to do.
+ *
+ *  @param workerCount - number of threads used
+ *  @param firstTasks - tasks the traversal starts with, one per start directory
+ *                     (the pool takes ownership of their paths)
+ *  @param taskCount - number of the first tasks
+ *  @param processor - function called for every task
+ *  @param userData - argument passed into the processor
+ *  @param state - TraversalState structure, results and statistics of all
+ *                workers are merged into it, workers share its arguments
+ *  @return true if all tasks were processed successfully
+ *          false if any task failed or threads couldn't be created
+ */
+bool runThreadPool(size_t workerCount,
+        DirectoryTask *firstTasks,
+        size_t taskCount,
+        TaskProcessor processor,
+        void *userData,
+        TraversalState *state);
+
+
+/** \brief Push a new task into the worker's deque
+ *
+ *  @param worker - worker that found the task
+ *  @param path - path of the directory (ownership is passed to the pool)
+ *  @param depth - depth of the directory
+ *  @param parent - directory the name is opened in, the caller's reference
+ *                  is passed to the task (NULL = the path is opened)
+ *  @param nameOffset - offset of the name within the path
+ *  @return true on success
+ *          false on memory allocation fail (the reference and the path stay with the caller)
+ */
+bool pushTask(Worker *worker, char *path, size_t depth, SharedDirectory *parent, size_t nameOffset);
+
+
+/** \brief Keep a duplicate of a directory descriptor for the queued subdirectories
+ *
+ *  @param fd - descriptor of the directory
+ *  @return SharedDirectory with one reference
+ *          NULL if the descriptor couldn't be duplicated or on memory allocation fail
+ */
+SharedDirectory *shareDirectory(int fd);
+
+
+/** \brief Add a reference to a shared directory
+ *
+ *  @param directory - SharedDirectory structure
+ */
+void acquireSharedDirectory(SharedDirectory *directory);
+
+
+/** \brief Drop a reference to a shared directory, the descriptor is closed
+ *  with the last one
+ *
+ *  @param directory - SharedDirectory structure (can be NULL)
+ */
+void releaseSharedDirectory(SharedDirectory *directory);
+
+#endif
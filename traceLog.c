@@ -0,0 +1,196 @@
+#include "traceLog.h"
+#include "outputBuffer.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/** \brief Create an empty ring for one thread
+ *
+ *  @param thread - number of the thread (0 = main thread, worker i is i + 1)
+ *  @return new TraceRing structure
+ *          NULL on memory allocation fail (a message is printed)
+ */
+TraceRing *initTraceRing(size_t thread)
+{
+    TraceRing *ring = malloc(sizeof(TraceRing));
+    TraceEvent *events = calloc(TRACE_RING_EVENTS, sizeof(TraceEvent));
+    if (ring == NULL || events == NULL) {
+        fprintf(stderr, "Couldn't allocate trace buffer, thread %zu isn't traced.\n", thread);
+        free(ring);
+        free(events);
+        return NULL;
+    }
+
+    ring->events = events;
+    ring->recorded = 0;
+    ring->thread = thread;
+    ring->next = NULL;
+    return ring;
+}
+
+
+/** \brief Record one span of work, the oldest event is overwritten when the ring is full
+ *
+ *  @param ring - TraceRing of the current thread
+ *  @param name - kind of the work (static string)
+ *  @param detail - path the work was done on (copied, can be NULL)
+ *  @param start - start of the span in nanoseconds since the start of the search
+ *  @param end - end of the span in nanoseconds since the start of the search
+ */
+void recordTraceEvent(TraceRing *ring, const char *name, const char *detail, uint64_t start, uint64_t end)
+{
+    TraceEvent *event = ring->events + ring->recorded % TRACE_RING_EVENTS;
+    ring->recorded++;
+
+    free(event->detail);
+    event->name = name;
+    // an event without its path is still worth keeping when the copy fails
+    event->detail = (detail != NULL) ? strdup(detail) : NULL;
+    event->start = start;
+    event->duration = end - start;
+}
+
+
+/** \brief Chain the ring of a finished thread to another ring
+ *
+ *  @param dest - ring the other one is chained to (if NULL, src is freed)
+ *  @param src - ring of the finished thread (with its own chain)
+ */
+void appendTraceRing(TraceRing *dest, TraceRing *src)
+{
+    if (dest == NULL) {
+        freeTraceRing(src);
+        return;
+    }
+
+    while (dest->next != NULL) {
+        dest = dest->next;
+    }
+    dest->next = src;
+}
+
+
+/** \brief Write a string as a JSON string, valid UTF-8 is copied, every
+ *  other byte is written as \u00XX (the code point equal to the byte)
+ *
+ *  @param file - file the string is written into
+ *  @param text - the string
+ */
+void writeJsonString(FILE *file, const char *text)
+{
+    size_t length = strlen(text);
+    size_t i = 0;
+
+    fputc('"', file);
+    while (i < length) {
+        unsigned char c = (unsigned char) text[i];
+        size_t sequence = utf8SequenceLength(text + i, length - i);
+        if (c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if (c < 0x20 || sequence == 0) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fwrite(text + i, 1, sequence, file);
+            i += sequence;
+            continue;
+        }
+        i++;
+    }
+    fputc('"', file);
+}
+
+
+/** \brief Write the events of one ring, oldest first
+ *
+ *  @param file - trace file
+ *  @param ring - TraceRing structure
+ *  @param pid - process id written into the events
+ */
+static void writeRingEvents(FILE *file, TraceRing *ring, long pid)
+{
+    if (ring->thread == 0) {
+        fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %ld, \"tid\": 0,"
+                " \"args\": {\"name\": \"main\"}}", pid);
+    } else {
+        fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %ld, \"tid\": %zu,"
+                " \"args\": {\"name\": \"worker %zu\"}}", pid, ring->thread, ring->thread - 1);
+    }
+
+    size_t count = (ring->recorded < TRACE_RING_EVENTS) ? ring->recorded : TRACE_RING_EVENTS;
+    for (size_t i = ring->recorded - count; i < ring->recorded; i++) {
+        TraceEvent *event = ring->events + i % TRACE_RING_EVENTS;
+
+        // the timestamps are in microseconds
+        fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"find\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f,"
+                " \"pid\": %ld, \"tid\": %zu", event->name, event->start / 1e3, event->duration / 1e3,
+                pid, ring->thread);
+        if (event->detail != NULL) {
+            fprintf(file, ", \"args\": {\"path\": ");
+            writeJsonString(file, event->detail);
+            fputc('}', file);
+        }
+        fputc('}', file);
+    }
+}
+
+
+/** \brief Write the events of a ring and its chain in the Chrome trace event
+ *  format (JSON object with the traceEvents array)
+ *
+ *  @param path - path of the trace file
+ *  @param ring - TraceRing of the main thread (NULL writes an empty trace)
+ *  @return true if successful
+ *          false if the file couldn't be written (a message is printed)
+ */
+bool writeTraceFile(char *path, TraceRing *ring)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Trace file \'%s\' couldn't be created (%s).\n", path, strerror(errno));
+        return false;
+    }
+
+    long pid = (long) getpid();
+    size_t dropped = 0;
+
+    // the array starts with the process name, so every event is preceded by a comma
+    fprintf(file, "{\"traceEvents\": [\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %ld,"
+            " \"args\": {\"name\": \"find\"}}", pid);
+    for (; ring != NULL; ring = ring->next) {
+        writeRingEvents(file, ring, pid);
+        if (ring->recorded > TRACE_RING_EVENTS) {
+            dropped += ring->recorded - TRACE_RING_EVENTS;
+        }
+    }
+    fprintf(file, "\n],\n\"displayTimeUnit\": \"ms\",\n\"otherData\": {\"droppedEvents\": %zu}}\n", dropped);
+
+    bool success = !ferror(file);
+    if (fclose(file) != 0 || !success) {
+        fprintf(stderr, "Trace file \'%s\' couldn't be written.\n", path);
+        return false;
+    }
+    return true;
+}
+
+
+/** \brief Free a ring with its chain and the copied details
+ *
+ *  @param ring - TraceRing structure (can be NULL)
+ */
+void freeTraceRing(TraceRing *ring)
+{
+    while (ring != NULL) {
+        TraceRing *next = ring->next;
+        for (size_t i = 0; i < TRACE_RING_EVENTS; i++) {
+            free(ring->events[i].detail);
+        }
+        free(ring->events);
+        free(ring);
+        ring = next;
+    }
+}
@@ -0,0 +1,95 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef TRACE_LOG_DEFINED
+#define TRACE_LOG_DEFINED
+
+// number of events a thread keeps, the oldest ones are overwritten
+#define TRACE_RING_EVENTS 65536
+
+
+// one finished span of work (Chrome "complete" event, begin and end in one)
+typedef struct
+{
+    // kind of the work (static string)
+    const char *name;
+    // path the work was done on (allocated, NULL if there's none)
+    char *detail;
+    // nanoseconds since the start of the search
+    uint64_t start;
+    uint64_t duration;
+} TraceEvent;
+
+
+// events recorded by one thread, only the owning thread writes into it,
+// rings of finished threads are chained to the ring of the main thread
+typedef struct TraceRing
+{
+    // circular array of TRACE_RING_EVENTS events
+    TraceEvent *events;
+    // number of events recorded so far (the next one goes to recorded % TRACE_RING_EVENTS)
+    size_t recorded;
+    // thread the events belong to (0 = main thread, worker i is i + 1)
+    size_t thread;
+    // ring of another thread
+    struct TraceRing *next;
+} TraceRing;
+
+
+/** \brief Create an empty ring for one thread
+ *
+ *  @param thread - number of the thread (0 = main thread, worker i is i + 1)
+ *  @return new TraceRing structure
+ *          NULL on memory allocation fail (a message is printed)
+ */
+TraceRing *initTraceRing(size_t thread);
+
+
+/** \brief Record one span of work, the oldest event is overwritten when the ring is full
+ *
+ *  @param ring - TraceRing of the current thread
+ *  @param name - kind of the work (static string)
+ *  @param detail - path the work was done on (copied, can be NULL)
+ *  @param start - start of the span in nanoseconds since the start of the search
+ *  @param end - end of the span in nanoseconds since the start of the search
+ */
+void recordTraceEvent(TraceRing *ring, const char *name, const char *detail, uint64_t start, uint64_t end);
+
+
+/** \brief Chain the ring of a finished thread to another ring
+ *
+ *  @param dest - ring the other one is chained to (if NULL, src is freed)
+ *  @param src - ring of the finished thread (with its own chain)
+ */
+void appendTraceRing(TraceRing *dest, TraceRing *src);
+
+
+/** \brief Write a string as a JSON string, valid UTF-8 is copied, every
+ *  other byte is written as \u00XX (the code point equal to the byte)
+ *
+ *  @param file - file the string is written into
+ *  @param text - the string
+ */
+void writeJsonString(FILE *file, const char *text);
+
+
+/** \brief Write the events of a ring and its chain in the Chrome trace event
+ *  format (JSON object with the traceEvents array)
+ *
+ *  @param path - path of the trace file
+ *  @param ring - TraceRing of the main thread (NULL writes an empty trace)
+ *  @return true if successful
+ *          false if the file couldn't be written (a message is printed)
+ */
+bool writeTraceFile(char *path, TraceRing *ring);
+
+
+/** \brief Free a ring with its chain and the copied details
+ *
+ *  @param ring - TraceRing structure (can be NULL)
+ */
+void freeTraceRing(TraceRing *ring);
+
+#endif
@@ -0,0 +1,580 @@
+#include "treeWatcher.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(USE_INOTIFY) && defined(__linux__)
+#include <sys/inotify.h>
+#define INOTIFY_WATCHER 1
+#endif
+
+// first number of slots of both tables
+const size_t WATCH_TABLE_INITIAL_SIZE = 64;
+// events are read from the kernel into a buffer of this size
+const size_t WATCH_EVENTS_SIZE = 64 * 1024;
+
+
+/** \brief Determine if the watcher is compiled in
+ *
+ *  @return true if it is
+ */
+bool treeWatcherAvailable()
+{
+#ifdef INOTIFY_WATCHER
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+/** \brief Hash of a watch descriptor
+ *
+ *  @param wd - watch descriptor
+ *  @return the hash
+ */
+static inline size_t hashWatch(int wd)
+{
+    return (size_t) ((uint32_t) wd * 2654435761u);
+}
+
+
+/** \brief Hash of a path (FNV-1a)
+ *
+ *  @param path - the path
+ *  @param length - length of the path
+ *  @return the hash
+ */
+static uint64_t hashPath(const char *path, size_t length)
+{
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) path[i]) * 1099511628211u;
+    }
+    return hash;
+}
+
+
+/** \brief Determine if a path is a directory or lies under it
+ *
+ *  @param path - inspected path
+ *  @param directory - path of the directory
+ *  @param directoryLength - length of the directory's path
+ *  @return true if it does
+ */
+static inline bool isInSubtree(const char *path, const char *directory, size_t directoryLength)
+{
+    return strncmp(path, directory, directoryLength) == 0
+            && (path[directoryLength] == '\0' || path[directoryLength] == '/');
+}
+
+
+/** \brief Create an inotify instance with empty tables
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @return true on success
+ */
+bool initTreeWatcher(TreeWatcher *watcher)
+{
+    memset(watcher, 0, sizeof(TreeWatcher));
+    watcher->fd = -1;
+
+#ifdef INOTIFY_WATCHER
+    watcher->directories = malloc(WATCH_TABLE_INITIAL_SIZE * sizeof(WatchedDirectory));
+    watcher->matches = calloc(WATCH_TABLE_INITIAL_SIZE, sizeof(WatchedMatch));
+    watcher->events = malloc(WATCH_EVENTS_SIZE);
+    if (watcher->directories == NULL || watcher->matches == NULL || watcher->events == NULL) {
+        fprintf(stderr, "Couldn't allocate the watcher.\n");
+        freeTreeWatcher(watcher);
+        return false;
+    }
+
+    for (size_t i = 0; i < WATCH_TABLE_INITIAL_SIZE; i++) {
+        watcher->directories[i].wd = -1;
+        watcher->directories[i].path = NULL;
+    }
+    watcher->directoriesSize = WATCH_TABLE_INITIAL_SIZE;
+    watcher->matchesSize = WATCH_TABLE_INITIAL_SIZE;
+
+    watcher->fd = inotify_init1(IN_CLOEXEC);
+    if (watcher->fd < 0) {
+        fprintf(stderr, "Directories can't be watched (%s).\n", strerror(errno));
+        freeTreeWatcher(watcher);
+        return false;
+    }
+
+    return true;
+#else
+    fprintf(stderr, "Watching is not available in this build.\n");
+    return false;
+#endif
+}
+
+
+#ifdef INOTIFY_WATCHER
+// slots are only looked up and taken for directories added to inotify
+/** \brief Find the slot of a watch descriptor
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param wd - watch descriptor
+ *  @return index of its slot, or of the empty slot it would be stored in
+ */
+static size_t findDirectorySlot(TreeWatcher *watcher, int wd)
+{
+    size_t mask = watcher->directoriesSize - 1;
+    size_t slot = hashWatch(wd) & mask;
+
+    while (watcher->directories[slot].wd != -1 && watcher->directories[slot].wd != wd) {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+
+/** \brief Double the directory table when it's 3/4 full
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @return true on success
+ *          false on memory allocation fail
+ */
+static bool reserveDirectorySlot(TreeWatcher *watcher)
+{
+    if ((watcher->directoryCount + 1) * 4 <= watcher->directoriesSize * 3) {
+        return true;
+    }
+
+    WatchedDirectory *old = watcher->directories;
+    size_t oldSize = watcher->directoriesSize;
+    WatchedDirectory *directories = malloc(oldSize * 2 * sizeof(WatchedDirectory));
+    if (directories == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < oldSize * 2; i++) {
+        directories[i].wd = -1;
+        directories[i].path = NULL;
+    }
+
+    watcher->directories = directories;
+    watcher->directoriesSize = oldSize * 2;
+    for (size_t i = 0; i < oldSize; i++) {
+        if (old[i].wd != -1) {
+            watcher->directories[findDirectorySlot(watcher, old[i].wd)] = old[i];
+        }
+    }
+
+    free(old);
+    return true;
+}
+#endif
+
+
+/** \brief Empty a slot of the directory table, following entries of the
+ *  cluster are shifted back so that no lookup stops early
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param slot - index of the slot
+ */
+static void removeDirectorySlot(TreeWatcher *watcher, size_t slot)
+{
+    WatchedDirectory *directories = watcher->directories;
+    size_t mask = watcher->directoriesSize - 1;
+    size_t hole = slot;
+
+    free(directories[slot].path);
+    for (size_t next = (slot + 1) & mask; directories[next].wd != -1; next = (next + 1) & mask) {
+        size_t home = hashWatch(directories[next].wd) & mask;
+        // the entry can move only if its home isn't between the hole and itself
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            directories[hole] = directories[next];
+            hole = next;
+        }
+    }
+
+    directories[hole].wd = -1;
+    directories[hole].path = NULL;
+    watcher->directoryCount--;
+}
+
+
+/** \brief Start watching a directory
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the directory
+ *  @param depth - depth of the directory
+ *  @return true if successful
+ *          false on memory allocation fail
+ */
+bool watchDirectory(TreeWatcher *watcher, char *path, size_t depth)
+{
+#ifdef INOTIFY_WATCHER
+    // contents don't matter for the search, only names, types and attributes
+    uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB
+            | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK | ((depth == 0) ? 0 : IN_DONT_FOLLOW);
+
+    if (!reserveDirectorySlot(watcher)) {
+        return false;
+    }
+
+    int wd = inotify_add_watch(watcher->fd, path, mask);
+    if (wd < 0) {
+        fprintf(stderr, "Directory \'%s\' can't be watched (%s).\n", path, strerror(errno));
+        return true;
+    }
+
+    char *copy = strdup(path);
+    if (copy == NULL) {
+        inotify_rm_watch(watcher->fd, wd);
+        return false;
+    }
+
+    // the inode could be watched already (under its old path)
+    WatchedDirectory *directory = watcher->directories + findDirectorySlot(watcher, wd);
+    if (directory->wd == -1) {
+        watcher->directoryCount++;
+    }
+    free(directory->path);
+
+    directory->wd = wd;
+    directory->path = copy;
+    directory->depth = depth;
+    directory->generation = watcher->generation;
+    return true;
+#else
+    (void) watcher;
+    (void) path;
+    (void) depth;
+    return true;
+#endif
+}
+
+
+/** \brief Stop watching a directory and all directories under it
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the directory
+ *  @param staleOnly - only directories not seen by the current generation are removed
+ */
+void unwatchSubtree(TreeWatcher *watcher, char *path, bool staleOnly)
+{
+    size_t length = strlen(path);
+
+    // a removal shifts the next entry into the slot, so the slot is checked again
+    for (size_t i = 0; i < watcher->directoriesSize; ) {
+        WatchedDirectory *directory = watcher->directories + i;
+        if (directory->wd == -1 || !isInSubtree(directory->path, path, length)
+                || (staleOnly && directory->generation == watcher->generation)) {
+            i++;
+            continue;
+        }
+
+#ifdef INOTIFY_WATCHER
+        // the directory may not exist anymore, then the watch is gone already
+        inotify_rm_watch(watcher->fd, directory->wd);
+#endif
+        removeDirectorySlot(watcher, i);
+    }
+}
+
+
+/** \brief Find the slot of a match
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the file
+ *  @param length - length of the path
+ *  @param hash - hash of the path
+ *  @return index of its slot, or of the empty slot it would be stored in
+ */
+static size_t findMatchSlot(TreeWatcher *watcher, char *path, size_t length, uint64_t hash)
+{
+    size_t mask = watcher->matchesSize - 1;
+    size_t slot = (size_t) hash & mask;
+
+    for (WatchedMatch *match = watcher->matches + slot; match->path != NULL; match = watcher->matches + slot) {
+        if (match->hash == hash && match->length == length && memcmp(match->path, path, length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+
+/** \brief Double the match table when it's 3/4 full
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @return true on success
+ *          false on memory allocation fail
+ */
+static bool reserveMatchSlot(TreeWatcher *watcher)
+{
+    if ((watcher->matchCount + 1) * 4 <= watcher->matchesSize * 3) {
+        return true;
+    }
+
+    WatchedMatch *old = watcher->matches;
+    size_t oldSize = watcher->matchesSize;
+    WatchedMatch *matches = calloc(oldSize * 2, sizeof(WatchedMatch));
+    if (matches == NULL) {
+        return false;
+    }
+
+    watcher->matches = matches;
+    watcher->matchesSize = oldSize * 2;
+    size_t mask = watcher->matchesSize - 1;
+    for (size_t i = 0; i < oldSize; i++) {
+        if (old[i].path == NULL) {
+            continue;
+        }
+        // paths are unique, only an empty slot is searched for
+        size_t slot = (size_t) old[i].hash & mask;
+        while (matches[slot].path != NULL) {
+            slot = (slot + 1) & mask;
+        }
+        matches[slot] = old[i];
+    }
+
+    free(old);
+    return true;
+}
+
+
+/** \brief Empty a slot of the match table, following entries of the
+ *  cluster are shifted back so that no lookup stops early
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param slot - index of the slot
+ */
+static void removeMatchSlot(TreeWatcher *watcher, size_t slot)
+{
+    WatchedMatch *matches = watcher->matches;
+    size_t mask = watcher->matchesSize - 1;
+    size_t hole = slot;
+
+    free(matches[slot].path);
+    for (size_t next = (slot + 1) & mask; matches[next].path != NULL; next = (next + 1) & mask) {
+        size_t home = (size_t) matches[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            matches[hole] = matches[next];
+            hole = next;
+        }
+    }
+
+    matches[hole].path = NULL;
+    watcher->matchCount--;
+}
+
+
+/** \brief Remember a matching file
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the file
+ *  @param length - length of the path
+ *  @param added - set to true if the file wasn't a match before
+ *  @return true if successful
+ */
+bool addWatchedMatch(TreeWatcher *watcher, char *path, size_t length, bool *added)
+{
+    if (!reserveMatchSlot(watcher)) {
+        return false;
+    }
+
+    uint64_t hash = hashPath(path, length);
+    WatchedMatch *match = watcher->matches + findMatchSlot(watcher, path, length, hash);
+    *added = (match->path == NULL);
+
+    if (*added) {
+        match->path = malloc(length + 1);
+        if (match->path == NULL) {
+            return false;
+        }
+        memcpy(match->path, path, length + 1);
+        match->length = length;
+        match->hash = hash;
+        watcher->matchCount++;
+    }
+
+    match->generation = watcher->generation;
+    return true;
+}
+
+
+/** \brief Forget a matching file
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the file
+ *  @param length - length of the path
+ *  @return true if the file was a match
+ */
+bool removeWatchedMatch(TreeWatcher *watcher, char *path, size_t length)
+{
+    size_t slot = findMatchSlot(watcher, path, length, hashPath(path, length));
+    if (watcher->matches[slot].path == NULL) {
+        return false;
+    }
+
+    removeMatchSlot(watcher, slot);
+    return true;
+}
+
+
+/** \brief Forget all matching files under a directory
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the directory
+ *  @param staleOnly - only matches not seen by the current generation are removed
+ *  @param onRemoved - function called with every removed match
+ *  @param handlerData - argument passed into onRemoved
+ *  @return true if successful
+ */
+bool removeSubtreeMatches(TreeWatcher *watcher, char *path, bool staleOnly,
+        MatchHandler onRemoved, void *handlerData)
+{
+    size_t length = strlen(path);
+
+    // a removal shifts the next entry into the slot, so the slot is checked again
+    for (size_t i = 0; i < watcher->matchesSize; ) {
+        WatchedMatch *match = watcher->matches + i;
+        if (match->path == NULL || match->length <= length || match->path[length] != '/'
+                || strncmp(match->path, path, length) != 0
+                || (staleOnly && match->generation == watcher->generation)) {
+            i++;
+            continue;
+        }
+
+        if (!onRemoved(match->path, match->length, handlerData)) {
+            return false;
+        }
+        removeMatchSlot(watcher, i);
+    }
+
+    return true;
+}
+
+
+/** \brief Determine if read events are waiting to be handed out
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @return true if they are
+ */
+bool watchEventsPending(TreeWatcher *watcher)
+{
+    return watcher->eventsPosition < watcher->eventsLength;
+}
+
+
+/** \brief Hand out the next event, wait for events if there are none
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param event - the event is stored here
+ *  @return true if an event was read
+ *          false if the events couldn't be read
+ */
+bool readWatchEvent(TreeWatcher *watcher, WatchEvent *event)
+{
+#ifdef INOTIFY_WATCHER
+    while (true) {
+        if (!watchEventsPending(watcher)) {
+            ssize_t bytes = read(watcher->fd, watcher->events, WATCH_EVENTS_SIZE);
+            if (bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes <= 0) {
+                fprintf(stderr, "Events of the watched directories couldn't be read (%s).\n",
+                        (bytes < 0) ? strerror(errno) : "end of file");
+                return false;
+            }
+            watcher->eventsLength = (size_t) bytes;
+            watcher->eventsPosition = 0;
+        }
+
+        // the kernel aligns the records, so they can be read in place
+        struct inotify_event *record = (struct inotify_event *) (watcher->events + watcher->eventsPosition);
+        watcher->eventsPosition += sizeof(struct inotify_event) + record->len;
+
+        event->isDirectory = (record->mask & IN_ISDIR) != 0;
+        event->directory = NULL;
+        event->name = (record->len > 0) ? record->name : "";
+
+        if (record->mask & IN_Q_OVERFLOW) {
+            event->type = WATCH_EVENT_OVERFLOW;
+            return true;
+        }
+
+        size_t slot = findDirectorySlot(watcher, record->wd);
+        WatchedDirectory *directory = watcher->directories + slot;
+        // events of watches that were removed already
+        if (directory->wd == -1) {
+            continue;
+        }
+
+        // the directory itself is gone, its parent reports it (except for the base directory)
+        if (record->mask & (IN_IGNORED | IN_MOVE_SELF)) {
+            bool base = (directory->depth == 0);
+            if (record->mask & IN_MOVE_SELF) {
+                if (!base) {
+                    continue;
+                }
+                inotify_rm_watch(watcher->fd, directory->wd);
+            }
+            removeDirectorySlot(watcher, slot);
+            if (!base) {
+                continue;
+            }
+            event->type = WATCH_EVENT_GONE;
+            return true;
+        }
+
+        if (record->len == 0) {
+            continue;
+        }
+
+        event->directory = directory;
+        if (record->mask & (IN_CREATE | IN_MOVED_TO)) {
+            event->type = WATCH_EVENT_CREATED;
+        } else if (record->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            event->type = WATCH_EVENT_REMOVED;
+        } else if (record->mask & IN_ATTRIB) {
+            event->type = WATCH_EVENT_CHANGED;
+        } else {
+            continue;
+        }
+        return true;
+    }
+#else
+    (void) watcher;
+    (void) event;
+    return false;
+#endif
+}
+
+
+/** \brief Close the inotify instance and free the tables
+ *
+ *  @param watcher - TreeWatcher structure
+ */
+void freeTreeWatcher(TreeWatcher *watcher)
+{
+    for (size_t i = 0; i < watcher->directoriesSize; i++) {
+        free(watcher->directories[i].path);
+    }
+    for (size_t i = 0; i < watcher->matchesSize; i++) {
+        free(watcher->matches[i].path);
+    }
+
+    free(watcher->directories);
+    free(watcher->matches);
+    free(watcher->events);
+
+    if (watcher->fd >= 0)
+        close(watcher->fd);
+
+    memset(watcher, 0, sizeof(TreeWatcher));
+    watcher->fd = -1;
+}
@@ -0,0 +1,190 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef TREE_WATCHER_DEFINED
+#define TREE_WATCHER_DEFINED
+
+// kinds of events of the watched directories
+// an element was created or moved into the directory
+#define WATCH_EVENT_CREATED 0x1
+// an element was deleted or moved out of the directory
+#define WATCH_EVENT_REMOVED 0x2
+// attributes of an element changed (mode, owner, ...)
+#define WATCH_EVENT_CHANGED 0x4
+// the kernel queue overflowed, events were lost
+#define WATCH_EVENT_OVERFLOW 0x8
+// the base directory was removed or moved, nothing is watched anymore
+#define WATCH_EVENT_GONE 0x10
+
+
+// one watched directory, the slot is empty when wd is -1
+typedef struct
+{
+    int wd;
+    // path of the directory as it's printed
+    char *path;
+    size_t depth;
+    // walk that saw the directory the last time
+    uint32_t generation;
+} WatchedDirectory;
+
+
+// one file that currently matches the search, the slot is empty when path is NULL
+typedef struct
+{
+    char *path;
+    size_t length;
+    uint64_t hash;
+    // walk that saw the file the last time
+    uint32_t generation;
+} WatchedMatch;
+
+
+// inotify instance with its watched directories and the current matches,
+// both are kept in hash tables with linear probing (sizes are powers of 2)
+typedef struct
+{
+    int fd;
+
+    WatchedDirectory *directories;
+    size_t directoriesSize;
+    size_t directoryCount;
+
+    WatchedMatch *matches;
+    size_t matchesSize;
+    size_t matchCount;
+
+    // incremented before every rescan, entries that keep an older one weren't seen
+    uint32_t generation;
+    // set after the first walk, new matches are reported as events
+    bool live;
+
+    // events read from the kernel and not handed out yet
+    char *events;
+    size_t eventsLength;
+    size_t eventsPosition;
+} TreeWatcher;
+
+
+// event handed out by readWatchEvent
+typedef struct
+{
+    // WATCH_EVENT_* value
+    uint32_t type;
+    // the element is a directory
+    bool isDirectory;
+    // directory the element is in (NULL for WATCH_EVENT_OVERFLOW and WATCH_EVENT_GONE),
+    // valid until the watches change
+    const WatchedDirectory *directory;
+    // name of the element
+    char *name;
+} WatchEvent;
+
+
+/** \brief Determine if the watcher is compiled in (inotify, Linux only)
+ *
+ *  @return true if it is
+ */
+bool treeWatcherAvailable();
+
+
+/** \brief Create an inotify instance with no watches and no matches
+ *
+ *  @param watcher - TreeWatcher structure that's initialized
+ *  @return true on success
+ *          false if inotify can't be used (a message is printed)
+ */
+bool initTreeWatcher(TreeWatcher *watcher);
+
+
+/** \brief Start watching a directory (or refresh its path, when its inode
+ *  is watched already). Directories that can't be watched are reported and skipped.
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the directory
+ *  @param depth - depth of the directory (0 = base directory, followed if it's a link)
+ *  @return true if successful
+ *          false on memory allocation fail
+ */
+bool watchDirectory(TreeWatcher *watcher, char *path, size_t depth);
+
+
+/** \brief Stop watching a directory and all directories under it
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the directory
+ *  @param staleOnly - only directories that weren't seen since the generation
+ *                     was incremented are removed
+ */
+void unwatchSubtree(TreeWatcher *watcher, char *path, bool staleOnly);
+
+
+/** \brief Remember a matching file (or mark it as seen by the current generation)
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the file
+ *  @param length - length of the path
+ *  @param added - set to true if the file wasn't a match before
+ *  @return true if successful
+ *          false on memory allocation fail
+ */
+bool addWatchedMatch(TreeWatcher *watcher, char *path, size_t length, bool *added);
+
+
+/** \brief Forget a matching file
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the file
+ *  @param length - length of the path
+ *  @return true if the file was a match
+ */
+bool removeWatchedMatch(TreeWatcher *watcher, char *path, size_t length);
+
+
+// called with every match removed by removeSubtreeMatches
+typedef bool (*MatchHandler)(char *path, size_t length, void *handlerData);
+
+
+/** \brief Forget all matching files under a directory
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param path - path of the directory
+ *  @param staleOnly - only matches that weren't seen since the generation
+ *                     was incremented are removed
+ *  @param onRemoved - function called with every removed match (before it's freed)
+ *  @param handlerData - argument passed into onRemoved
+ *  @return true if successful
+ *          false if onRemoved failed (the rest of the matches is kept)
+ */
+bool removeSubtreeMatches(TreeWatcher *watcher, char *path, bool staleOnly,
+        MatchHandler onRemoved, void *handlerData);
+
+
+/** \brief Determine if read events are waiting to be handed out (the next
+ *  readWatchEvent won't block)
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @return true if they are
+ */
+bool watchEventsPending(TreeWatcher *watcher);
+
+
+/** \brief Hand out the next event of a watched directory, wait for events
+ *  if there are none. Events the search doesn't care about are skipped.
+ *
+ *  @param watcher - TreeWatcher structure
+ *  @param event - the event is stored here
+ *  @return true if an event was read
+ *          false if the events couldn't be read (a message is printed)
+ */
+bool readWatchEvent(TreeWatcher *watcher, WatchEvent *event);
+
+
+/** \brief Close the inotify instance and free the tables
+ *
+ *  @param watcher - TreeWatcher structure
+ */
+void freeTreeWatcher(TreeWatcher *watcher);
+
+#endif
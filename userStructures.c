@@ -1,10 +1,14 @@
 #include "userStructures.h"
+#include "resultSort.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-const int RESULTS_REALLOCATION = 64;
+const size_t RESULTS_INITIAL_SIZE = 64;
+const size_t PATH_CHUNK_SIZE = 1024 * 1024;
+const size_t PATH_BUFFER_INITIAL_SIZE = 256;
 
 
 /** \brief Return an initialized ParsedArguments structure,
@@ -19,6 +23,7 @@ ParsedArguments initParsedArguments()
     // is turned off by default
     pArgs.setName = false;
     pArgs.setUser = false;
+    pArgs.setGroup = false;
 
     // mask is off
     pArgs.setMask = false;
@@ -26,6 +31,12 @@ ParsedArguments initParsedArguments()
 
     // sets sorting by path (default)
     pArgs.sortType = 0;
+    pArgs.topCount = 0;
+    pArgs.orderedOutput = false;
+    pArgs.watch = false;
+    pArgs.buildIndexPath = NULL;
+    pArgs.indexPath = NULL;
+    pArgs.updateIndexPath = NULL;
 
     // minimal and maximal depth are not set by default (basically 0 to whatever)
     pArgs.setMinimalDepth = false;
@@ -33,18 +44,63 @@ ParsedArguments initParsedArguments()
     pArgs.setMaximalDepth = false;
     pArgs.maximalDepth = UINT32_MAX;
 
+    // nothing is pruned by default
+    pArgs.pruneNames.items = NULL;
+    pArgs.pruneNames.count = 0;
+    pArgs.pruneNames.allocatedSize = 0;
+    pArgs.excludedPaths = pArgs.pruneNames;
+    pArgs.startDirectories = pArgs.pruneNames;
+
     // show hidden files is off
     pArgs.setShowAll = false;
 
     // default linebreak is \n
     pArgs.lineBreak = '\n';
+    pArgs.outputFormat = OUTPUT_FORMAT_LINES;
 
     // show help is set to false
     pArgs.showHelp = false;
 
+    // serial traversal by default
+    pArgs.threadCount = 1;
+
+    // filters are compiled before the search, their order is fixed by default
+    pArgs.adaptiveFilters = false;
+    pArgs.filters = initFilterPipeline(false);
+
+    // statistics are not shown, no stat fields are needed
+    pArgs.showStatistics = false;
+    pArgs.statisticsJson = false;
+    pArgs.tracePath = NULL;
+    pArgs.statFields = 0;
+
+    // the faster reader is used whenever it's compiled in
+    pArgs.useGetdents = getdentsAvailable();
+
+    // io_uring is off
+    pArgs.useIoUring = false;
+
     // pointers set to NULL
-    pArgs.nameArg = NULL;
-    pArgs.usernameArg = NULL;
+    pArgs.namePatterns.items = NULL;
+    pArgs.namePatterns.count = 0;
+    pArgs.namePatterns.allocatedSize = 0;
+    pArgs.patternFiles = pArgs.namePatterns;
+    pArgs.patterns.transitions = NULL;
+    pArgs.patterns.matches = NULL;
+    pArgs.annotatePattern = false;
+
+    // no glob or regex, they're compiled before the search
+    pArgs.setGlob = false;
+    pArgs.globArg = NULL;
+    pArgs.setRegex = false;
+    pArgs.regexArg = NULL;
+    pArgs.ignoreCase = false;
+    memset(&pArgs.globPattern, 0, sizeof(NamePattern));
+    memset(&pArgs.regexPattern, 0, sizeof(NamePattern));
+    pArgs.userIds.ids = NULL;
+    pArgs.userIds.count = 0;
+    pArgs.userIds.allocatedSize = 0;
+    pArgs.groupIds = pArgs.userIds;
     pArgs.startDirectory = NULL;
     pArgs.useless = NULL;
 
@@ -52,6 +108,140 @@ ParsedArguments initParsedArguments()
 }
 
 
+/** \brief Free all of the resources used in ParsedArguments structure
+ *
+ *  @param pArgs - ParsedArguments structure
+ */
+void freeParsedArguments(ParsedArguments *pArgs)
+{
+    if (pArgs->userIds.ids != NULL)
+        free(pArgs->userIds.ids);
+    if (pArgs->groupIds.ids != NULL)
+        free(pArgs->groupIds.ids);
+
+    for (size_t i = 0; i < pArgs->patternFiles.count; i++) {
+        free(pArgs->patternFiles.items[i]);
+    }
+
+    freePatternSet(&pArgs->patterns);
+    freeNamePattern(&pArgs->globPattern);
+    freeNamePattern(&pArgs->regexPattern);
+
+    if (pArgs->namePatterns.items != NULL)
+        free(pArgs->namePatterns.items);
+    if (pArgs->patternFiles.items != NULL)
+        free(pArgs->patternFiles.items);
+    if (pArgs->pruneNames.items != NULL)
+        free(pArgs->pruneNames.items);
+    if (pArgs->excludedPaths.items != NULL)
+        free(pArgs->excludedPaths.items);
+    if (pArgs->startDirectories.items != NULL)
+        free(pArgs->startDirectories.items);
+
+    pArgs->userIds.ids = NULL;
+    pArgs->groupIds.ids = NULL;
+    pArgs->namePatterns.items = NULL;
+    pArgs->patternFiles.items = NULL;
+    pArgs->pruneNames.items = NULL;
+    pArgs->excludedPaths.items = NULL;
+    pArgs->startDirectories.items = NULL;
+}
+
+
+/** \brief Append a string to the list, the list grows geometrically
+ *
+ *  @param list - StringList structure
+ *  @param item - the string (only the pointer is stored)
+ *  @return true on success
+ *          false on fail with memory allocation
+ */
+bool addToStringList(StringList *list, char *item)
+{
+    if (list->count == list->allocatedSize) {
+        size_t newSize = (list->allocatedSize == 0) ? 4 : list->allocatedSize * 2;
+        char **reallocated = realloc(list->items, newSize * sizeof(char *));
+        if (reallocated == NULL) {
+            return false;
+        }
+        list->items = reallocated;
+        list->allocatedSize = newSize;
+    }
+
+    list->items[list->count++] = item;
+    return true;
+}
+
+
+/** \brief Find position of an id in the set (or position it would be inserted at)
+ *
+ *  @param set - IdSet structure
+ *  @param id - user or group id
+ *  @return index of the first id that's not smaller than id
+ */
+static size_t findIdPosition(IdSet *set, id_t id)
+{
+    size_t low = 0;
+    size_t high = set->count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (set->ids[middle] < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+
+/** \brief Insert an id into the set, the set stays sorted
+ *
+ *  @param set - IdSet structure
+ *  @param id - user or group id
+ *  @return true on success
+ *          false on fail with memory allocation
+ */
+bool addToIdSet(IdSet *set, id_t id)
+{
+    size_t position = findIdPosition(set, id);
+
+    // already present
+    if (position < set->count && set->ids[position] == id) {
+        return true;
+    }
+
+    if (set->count == set->allocatedSize) {
+        size_t newSize = (set->allocatedSize == 0) ? 4 : set->allocatedSize * 2;
+        id_t *reallocated = realloc(set->ids, newSize * sizeof(id_t));
+        if (reallocated == NULL) {
+            return false;
+        }
+        set->ids = reallocated;
+        set->allocatedSize = newSize;
+    }
+
+    memmove(set->ids + position + 1, set->ids + position, (set->count - position) * sizeof(id_t));
+    set->ids[position] = id;
+    set->count++;
+    return true;
+}
+
+
+/** \brief Look an id up in the set
+ *
+ *  @param set - IdSet structure
+ *  @param id - user or group id
+ *  @return true if the id is present
+ */
+bool idSetContains(IdSet *set, id_t id)
+{
+    size_t position = findIdPosition(set, id);
+    return (position < set->count && set->ids[position] == id);
+}
+
+
 /** \brief Return an initialized Results structure,
  *  loaded with default values
  * 
@@ -63,6 +253,10 @@ Results initResults()
     res.arrayAllocatedSize = 0;
     res.arrayIndex = 0;
     res.resultsArray = NULL;
+    res.pathChunks = NULL;
+    res.pathBytes = 0;
+    res.limit = 0;
+    res.sortType = 0;
     return res;
 }
 
@@ -73,86 +267,236 @@ Results initResults()
  */
 void freeResults(Results *res)
 {
-    Result *current = NULL;
+    // paths of a bounded heap are allocated one by one
+    for (size_t i = 0; res->limit > 0 && i < res->arrayIndex; i++) {
+        free(res->resultsArray[i].filePath);
+    }
 
-    // loop through all results
-    for (size_t i = 0; i < res->arrayIndex; i++) {
-        current = res->resultsArray + i;
-        // if the result has been allocated, free it
-        if (current->filePath != NULL)
-            free(current->filePath);
+    // paths are freed chunk by chunk
+    while (res->pathChunks != NULL) {
+        PathChunk *next = res->pathChunks->next;
+        free(res->pathChunks);
+        res->pathChunks = next;
     }
 
     // free the array of results
     if (res->resultsArray != NULL)
         free(res->resultsArray);
+
+    *res = initResults();
 }
 
 
-/** \brief Create a path string (either to file or to directory)
- * 
- *  @param previousPath - previous part of the path
- *  @param currentElement - name of a current element (file / directory)
- *  @param result - pointer to store the desired string
+/** \brief Return an empty PathBuffer structure, memory is allocated on the first use
+ *
+ *  @return PathBuffer structure
+ */
+PathBuffer initPathBuffer()
+{
+    PathBuffer path;
+    path.path = NULL;
+    path.length = 0;
+    path.allocatedSize = 0;
+    return path;
+}
+
+
+/** \brief Make sure the buffer can hold a path of given length
+ *
+ *  @param path - PathBuffer structure
+ *  @param length - desired length of the path (without nullchar)
  *  @return true if successful
+ *          false if an allocation error occurred
  */
-bool createFilePath(char *previousPath, char *currentElement, char **result)
+static bool reservePath(PathBuffer *path, size_t length)
 {
-    // allocate room for a new string, all initialized to 0
-    // (+2 because we add a backslash, and a nullchar to properly terminate a string)
-    *result = calloc(strlen(previousPath) + strlen(currentElement) + 2, sizeof(char));
+    // enough room (+1 for the nullchar)
+    if (length + 1 <= path->allocatedSize) {
+        return true;
+    }
 
-    // allocation unsuccessful
-    if (*result == NULL) {
+    // grow geometrically, so that deep trees cause only a few reallocations
+    size_t newSize = (path->allocatedSize == 0) ? PATH_BUFFER_INITIAL_SIZE : path->allocatedSize;
+    while (newSize < length + 1) {
+        newSize *= 2;
+    }
+
+    char *reallocated = realloc(path->path, newSize);
+    if (reallocated == NULL) {
+        return false;
+    }
+
+    path->path = reallocated;
+    path->allocatedSize = newSize;
+    return true;
+}
+
+
+/** \brief Copy a path into the buffer, previous content is discarded
+ *
+ *  @param path - PathBuffer structure
+ *  @param newPath - path to be copied
+ *  @return true if successful
+ */
+bool setPath(PathBuffer *path, char *newPath)
+{
+    size_t length = strlen(newPath);
+    if (!reservePath(path, length)) {
         return false;
     }
 
-    // copy previous path
-    strcpy(*result, previousPath);
-    // add a backslash
-    strcat(*result, "/");
-    // add current element's name
-    strcat(*result, currentElement);
+    memcpy(path->path, newPath, length + 1);
+    path->length = length;
+    return true;
+}
+
+
+/** \brief Append a path element (either file or directory) to the path
+ *
+ *  @param path - PathBuffer structure
+ *  @param currentElement - name of a current element (file / directory)
+ *  @return true if successful
+ */
+bool appendToPath(PathBuffer *path, char *currentElement)
+{
+    return appendWithSeparator(path, '/', currentElement);
+}
+
+
+/** \brief Append a separator and a text at the end of the path
+ *
+ *  @param path - PathBuffer structure
+ *  @param separator - character put between the path and the text
+ *  @param text - the text
+ *  @return true on success
+ *          false on fail with memory allocation
+ */
+bool appendWithSeparator(PathBuffer *path, char separator, char *text)
+{
+    size_t textLength = strlen(text);
+
+    // +1 because we add a separator
+    if (!reservePath(path, path->length + textLength + 1)) {
+        return false;
+    }
 
-    // allocation successful
+    // add the separator and the text (including its nullchar)
+    path->path[path->length] = separator;
+    memcpy(path->path + path->length + 1, text, textLength + 1);
+    path->length += textLength + 1;
     return true;
 }
 
 
+/** \brief Cut the path back, used when the traversal returns from an element
+ *
+ *  @param path - PathBuffer structure
+ *  @param length - new length of the path
+ */
+void truncatePath(PathBuffer *path, size_t length)
+{
+    path->length = length;
+    path->path[length] = '\0';
+}
+
+
+/** \brief Free the memory used by the path
+ *
+ *  @param path - PathBuffer structure
+ */
+void freePathBuffer(PathBuffer *path)
+{
+    if (path->path != NULL)
+        free(path->path);
+    *path = initPathBuffer();
+}
+
+
+/** \brief Copy a path into the newest chunk, a new chunk is allocated
+ *  when there's not enough room left
+ *
+ *  @param res - Results structure
+ *  @param filePath - path to be copied
+ *  @param pathLength - length of the path
+ *  @return copy of the path, NULL on fail with memory allocation
+ */
+static char *storePath(Results *res, char *filePath, size_t pathLength)
+{
+    PathChunk *chunk = res->pathChunks;
+
+    if (chunk == NULL || chunk->size - chunk->used < pathLength + 1) {
+        // paths longer than a chunk get a chunk of their own
+        size_t size = (pathLength + 1 > PATH_CHUNK_SIZE) ? pathLength + 1 : PATH_CHUNK_SIZE;
+        chunk = malloc(sizeof(PathChunk) + size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+
+        chunk->next = res->pathChunks;
+        chunk->used = 0;
+        chunk->size = size;
+        res->pathChunks = chunk;
+    }
+
+    char *copy = chunk->data + chunk->used;
+    memcpy(copy, filePath, pathLength);
+    copy[pathLength] = '\0';
+    chunk->used += pathLength + 1;
+    res->pathBytes += pathLength + 1;
+    return copy;
+}
+
+
 /** \brief Add a new Result into Results array. If memory is insufficient
- *         attempt to reallocate it and expands the array.
+ *         attempt to reallocate it and double the array.
  * 
  *  @param res - Results structure
- *  @param filePath - pointer that's stored in a new Result
- *  @param fileSize - size of the file which's path is stored in a new Result
+ *  @param filePath - path that's copied into a new Result
+ *  @param pathLength - length of the path
+ *  @param stats - stats of the file (its size, mode and owner are kept)
+ *  @param pattern - index of the pattern the file matched (NO_PATTERN if not annotated)
  *  @return true on success
  *          false on fail with memory allocation
  */
-bool createResult(Results *res, char *filePath, size_t fileSize)
+bool createResult(Results *res, char *filePath, size_t pathLength, const struct stat *stats, int32_t pattern)
 {
-    // try to reallocate the array with new size (+ 64 results)
+    // only the best results are kept
+    if (res->limit > 0) {
+        return offerTopResult(res, filePath, pathLength, stats, pattern);
+    }
+
+    // try to reallocate the array with twice the size, so that copying stays linear
     if (res->arrayAllocatedSize <= res->arrayIndex) {
-        // store new maximal size (current size is stored within arrayIndex)
-        res->arrayAllocatedSize = res->arrayAllocatedSize + RESULTS_REALLOCATION;
+        size_t newSize = (res->arrayAllocatedSize == 0) ? RESULTS_INITIAL_SIZE : res->arrayAllocatedSize * 2;
 
         // reallocate current array with new size
-        Result *reallocated = realloc(res->resultsArray, res->arrayAllocatedSize * sizeof(Result));
+        Result *reallocated = realloc(res->resultsArray, newSize * sizeof(Result));
         
         // the reallocation is unsuccessful, finish with error
         if (reallocated == NULL) {
             return false;
         }
 
-        // rewrite original pointer to new one
+        // rewrite original pointer to new one and store new maximal size
         res->resultsArray = reallocated;
+        res->arrayAllocatedSize = newSize;
+    }
+
+    char *storedPath = storePath(res, filePath, pathLength);
+    if (storedPath == NULL) {
+        return false;
     }
 
     // Point at the new result
     Result *newResult = res->resultsArray + res->arrayIndex;
 
     // Populate the new record
-    newResult->filePath = filePath;
-    newResult->fileSize = fileSize;
+    newResult->filePath = storedPath;
+    newResult->fileSize = stats->st_size;
+    newResult->fileMode = stats->st_mode;
+    newResult->fileOwner = stats->st_uid;
+    newResult->pattern = pattern;
+    setSortKeys(newResult);
 
     // increment the next element index pointer
     res->arrayIndex++;
@@ -160,3 +504,283 @@ bool createResult(Results *res, char *filePath, size_t fileSize)
     // the operation was successful
     return true;
 }
+
+
+/** \brief Move all results from src to the end of dest, src is emptied
+ *
+ *  @param dest - Results structure results are added into
+ *  @param src - Results structure that's emptied (its chunks are moved to dest)
+ *  @return true on success
+ *          false on fail with memory allocation
+ */
+bool mergeResults(Results *dest, Results *src)
+{
+    // nothing to merge
+    if (src->arrayIndex == 0) {
+        return true;
+    }
+
+    // results of bounded heaps compete for the places in dest
+    if (dest->limit > 0) {
+        return mergeTopResults(dest, src);
+    }
+
+    // make room for all of the results at once
+    if (dest->arrayAllocatedSize < dest->arrayIndex + src->arrayIndex) {
+        size_t newSize = dest->arrayIndex + src->arrayIndex;
+        Result *reallocated = realloc(dest->resultsArray, newSize * sizeof(Result));
+
+        if (reallocated == NULL) {
+            return false;
+        }
+
+        dest->resultsArray = reallocated;
+        dest->arrayAllocatedSize = newSize;
+    }
+
+    memcpy(dest->resultsArray + dest->arrayIndex, src->resultsArray, src->arrayIndex * sizeof(Result));
+    dest->arrayIndex += src->arrayIndex;
+    src->arrayIndex = 0;
+    dest->pathBytes += src->pathBytes;
+    src->pathBytes = 0;
+
+    // chunks of src are linked behind the newest chunk of dest (which is still used for new paths)
+    PathChunk *lastChunk = src->pathChunks;
+    while (lastChunk != NULL && lastChunk->next != NULL) {
+        lastChunk = lastChunk->next;
+    }
+
+    if (lastChunk != NULL && dest->pathChunks == NULL) {
+        dest->pathChunks = src->pathChunks;
+    } else if (lastChunk != NULL) {
+        lastChunk->next = dest->pathChunks->next;
+        dest->pathChunks->next = src->pathChunks;
+    }
+
+    // paths are owned by dest now
+    src->pathChunks = NULL;
+    return true;
+}
+
+
+/** \brief Return an initialized TraversalState structure
+ *
+ *  @param pArgs - ParsedArguments structure used by the traversal
+ *  @return TraversalState structure
+ */
+TraversalState initTraversalState(ParsedArguments *pArgs)
+{
+    TraversalState state;
+    state.pArgs = pArgs;
+    state.path = initPathBuffer();
+    state.results = initResults();
+    state.results.limit = pArgs->topCount;
+    state.results.sortType = pArgs->sortType;
+    state.readBuffers = initReadBufferStack();
+    state.filters = pArgs->filters;
+
+    // batching only makes sense when stats are needed, without io_uring
+    // the synchronous path is used (batches would reorder the ordered output)
+    state.batchStats = initStatBatch(&state.statBatch, pArgs->statFields,
+            pArgs->useIoUring && pArgs->statFields != 0 && !pArgs->orderedOutput);
+
+    // streamed results go to stdout
+    state.output = initOutputBuffer(STDOUT_FILENO);
+    state.startTime = getMonotonicTime();
+    state.timed = pArgs->showStatistics || pArgs->tracePath != NULL;
+    state.trace = (pArgs->tracePath != NULL) ? initTraceRing(0) : NULL;
+    state.watcher = NULL;
+    state.roots = NULL;
+    state.rootCount = 0;
+    // all counters start at zero
+    memset(&state.stats, 0, sizeof(RunStatistics));
+    return state;
+}
+
+
+/** \brief Keep a directory among the slowest ones, the fastest of them is
+ *  replaced when the array is full, the path is owned by the statistics then
+ *
+ *  @param stats - RunStatistics structure
+ *  @param path - allocated path of the directory
+ *  @param time - nanoseconds spent in the directory (longer than the threshold)
+ */
+static void offerSlowDirectory(RunStatistics *stats, char *path, uint64_t time)
+{
+    if (stats->slowestCount < SLOWEST_DIRECTORIES) {
+        stats->slowestDirectories[stats->slowestCount].path = path;
+        stats->slowestDirectories[stats->slowestCount++].time = time;
+    } else {
+        // the fastest of the kept directories is replaced
+        size_t fastest = 0;
+        for (size_t i = 1; i < SLOWEST_DIRECTORIES; i++) {
+            if (stats->slowestDirectories[i].time < stats->slowestDirectories[fastest].time) {
+                fastest = i;
+            }
+        }
+        free(stats->slowestDirectories[fastest].path);
+        stats->slowestDirectories[fastest].path = path;
+        stats->slowestDirectories[fastest].time = time;
+    }
+
+    if (stats->slowestCount == SLOWEST_DIRECTORIES) {
+        stats->slowestThreshold = UINT64_MAX;
+        for (size_t i = 0; i < SLOWEST_DIRECTORIES; i++) {
+            if (stats->slowestDirectories[i].time < stats->slowestThreshold) {
+                stats->slowestThreshold = stats->slowestDirectories[i].time;
+            }
+        }
+    }
+}
+
+
+/** \brief Count a directory in the histogram and among the slowest ones
+ *
+ *  @param stats - RunStatistics structure
+ *  @param path - path of the directory
+ *  @param time - nanoseconds spent in the directory
+ */
+void recordDirectoryTime(RunStatistics *stats, char *path, uint64_t time)
+{
+    stats->directoryTime += time;
+
+    // bucket i counts times under 2^i microseconds
+    size_t bucket = 0;
+    for (uint64_t micros = time / 1000; micros > 0 && bucket < DIRECTORY_HISTOGRAM_BUCKETS - 1; micros >>= 1) {
+        bucket++;
+    }
+    stats->directoryHistogram[bucket]++;
+
+    // most directories are faster than the slowest ones, nothing is allocated for them
+    if (stats->slowestCount == SLOWEST_DIRECTORIES && time <= stats->slowestThreshold) {
+        return;
+    }
+
+    // the statistics are kept without the path if it can't be copied
+    char *copy = strdup(path);
+    if (copy != NULL) {
+        offerSlowDirectory(stats, copy, time);
+    }
+}
+
+
+/** \brief Free the paths of the slowest directories
+ *
+ *  @param stats - RunStatistics structure
+ */
+void freeRunStatistics(RunStatistics *stats)
+{
+    for (size_t i = 0; i < stats->slowestCount; i++) {
+        free(stats->slowestDirectories[i].path);
+    }
+    stats->slowestCount = 0;
+    stats->slowestThreshold = 0;
+}
+
+
+/** \brief Get the number of bytes allocated for the paths of the results
+ *  (the used ones are in res->pathBytes)
+ *
+ *  @param res - Results structure
+ *  @return allocated bytes
+ */
+size_t resultPathAllocatedBytes(Results *res)
+{
+    // the paths of a limited heap are allocated one by one, exactly as long as they are
+    if (res->limit > 0) {
+        return res->pathBytes;
+    }
+
+    size_t bytes = 0;
+    for (PathChunk *chunk = res->pathChunks; chunk != NULL; chunk = chunk->next) {
+        bytes += chunk->size;
+    }
+    return bytes;
+}
+
+
+/** \brief Add all counters of src to dest
+ *
+ *  @param dest - RunStatistics structure
+ *  @param src - RunStatistics structure
+ */
+void mergeStatistics(RunStatistics *dest, RunStatistics *src)
+{
+    dest->directories += src->directories;
+    dest->directoriesPruned += src->directoriesPruned;
+    dest->directoriesRescanned += src->directoriesRescanned;
+    dest->directoriesReused += src->directoriesReused;
+    dest->entries += src->entries;
+    dest->statCalls += src->statCalls;
+    dest->statsAvoided += src->statsAvoided;
+    dest->statBatches += src->statBatches;
+    dest->matches += src->matches;
+    dest->searchTime += src->searchTime;
+    dest->directoryTime += src->directoryTime;
+    dest->statTime += src->statTime;
+    dest->sortTime += src->sortTime;
+    dest->outputTime += src->outputTime;
+
+    for (size_t i = 0; i < DIRECTORY_HISTOGRAM_BUCKETS; i++) {
+        dest->directoryHistogram[i] += src->directoryHistogram[i];
+    }
+
+    // paths of the slowest directories are moved, not copied
+    for (size_t i = 0; i < src->slowestCount; i++) {
+        SlowDirectory *slow = src->slowestDirectories + i;
+        if (dest->slowestCount == SLOWEST_DIRECTORIES && slow->time <= dest->slowestThreshold) {
+            free(slow->path);
+        } else {
+            offerSlowDirectory(dest, slow->path, slow->time);
+        }
+    }
+    src->slowestCount = 0;
+    src->slowestThreshold = 0;
+
+    // the first result of all runs is kept
+    if (dest->firstResultTime == 0 || (src->firstResultTime != 0 && src->firstResultTime < dest->firstResultTime)) {
+        dest->firstResultTime = src->firstResultTime;
+    }
+}
+
+
+/** \brief Merge results and statistics of src into dest, write src's output
+ *
+ *  @param dest - TraversalState structure
+ *  @param src - TraversalState structure
+ *  @return true on success
+ *          false on fail with memory allocation or output
+ */
+bool mergeTraversalState(TraversalState *dest, TraversalState *src)
+{
+    mergeStatistics(&dest->stats, &src->stats);
+    mergeFilterPipeline(&dest->filters, &src->filters);
+    appendTraceRing(dest->trace, src->trace);
+    src->trace = NULL;
+
+    if (!flushOutput(&src->output)) {
+        return false;
+    }
+
+    if (!mergeResults(&dest->results, &src->results)) {
+        fprintf(stderr, "Couldn't merge results.\n");
+        return false;
+    }
+    return true;
+}
+
+
+/** \brief Free all of the resources used in TraversalState structure
+ *
+ *  @param state - TraversalState structure
+ */
+void freeTraversalState(TraversalState *state)
+{
+    freeResults(&state->results);
+    freePathBuffer(&state->path);
+    freeReadBufferStack(&state->readBuffers);
+    freeStatBatch(&state->statBatch);
+    freeOutputBuffer(&state->output);
+    freeRunStatistics(&state->stats);
+    freeTraceRing(state->trace);
+}
@@ -1,31 +1,105 @@
+#include "directoryReader.h"
+#include "filterPipeline.h"
+#include "namePattern.h"
+#include "patternSet.h"
+#include "outputBuffer.h"
+#include "statBatch.h"
+#include "traceLog.h"
+#include "treeWatcher.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 // fix multiple imports
 #ifndef USER_STRUCTURES_DEFINED
 #define USER_STRUCTURES_DEFINED
 
+// sorted set of user or group ids, resolved while parsing the arguments
+typedef struct
+{
+    // ids in ascending order
+    id_t *ids;
+    size_t count;
+    // maximum allocated size, used in realloc
+    size_t allocatedSize;
+} IdSet;
+
+
+// list of strings given by a repeated opt (they point into the arguments)
+typedef struct
+{
+    char **items;
+    size_t count;
+    // maximum allocated size, used in realloc
+    size_t allocatedSize;
+} StringList;
+
+
 // structure stores necessary info for find algorithm
 typedef struct
 {
-    // start directory in which to start
+    // start directory in which to start (the first one of startDirectories)
     char *startDirectory;
+    // all start directories in the order they were given
+    StringList startDirectories;
 
-    // if true, the files have to contain the specified string in their name
+    // if true, the files have to contain one of the specified strings in their name
     bool setName;
-    char *nameArg;
+    StringList namePatterns;
+    // contents of pattern files ("-N"), the patterns point into them
+    StringList patternFiles;
+    // namePatterns compiled before the traversal starts
+    PatternSet patterns;
+    // results are annotated with the pattern that matched
+    bool annotatePattern;
+
+    // if true, the whole name of the files has to match the GLOB
+    bool setGlob;
+    char *globArg;
+    NamePattern globPattern;
+
+    // if true, the name of the files has to match the REGEX
+    bool setRegex;
+    char *regexArg;
+    NamePattern regexPattern;
+
+    // glob and regex ignore case of letters
+    bool ignoreCase;
 
-    // default => sorts by path, if set to false sorts by the file size
+    // 0 => sorts by file name, 1 => by path, 2 => by the file size,
+    // 3 => results are not sorted, but streamed as they are found
     uint8_t sortType;
 
+    // only this many results that sort first are kept (0 = all of them)
+    size_t topCount;
+
+    // directories are walked in the order of paths, results sorted by path
+    // are written as they are found
+    bool orderedOutput;
+
+    // the tree is watched after the search, changes of the results are reported
+    bool watch;
+
+    // the tree is written into this index file instead of being searched
+    char *buildIndexPath;
+    // the search is answered from this index file instead of the filesystem
+    char *indexPath;
+    // this index file is refreshed (only changed directories are read)
+    char *updateIndexPath;
+
     bool setMask;
     int mask;
 
-    // if true, the owner of the files is USER (get from argument)
+    // if true, the owner of the files is one of the USERs (get from arguments)
     bool setUser;
-    char *usernameArg;
+    IdSet userIds;
+
+    // if true, the group of the files is one of the GROUPs (get from arguments)
+    bool setGroup;
+    IdSet groupIds;
 
     // sets minimal depth of files
     bool setMinimalDepth;
@@ -35,15 +109,50 @@ typedef struct
     bool setMaximalDepth;
     uint32_t maximalDepth;
 
+    // directories with these names are not searched
+    StringList pruneNames;
+
+    // directories with these paths (and everything under them) are not searched
+    StringList excludedPaths;
+
     // sets algorithm to look for hidden objects
     bool setShowAll;
 
     // sets line breaks to Nullchar instead
     char lineBreak;
 
+    // format of the results (OUTPUT_FORMAT_* value)
+    uint8_t outputFormat;
+
     // sets the program to display depth, then stops
     bool showHelp;
 
+    // number of threads used for the traversal (1 = serial recursion)
+    uint32_t threadCount;
+
+    // prints run statistics on stderr after the search (as JSON)
+    bool showStatistics;
+    bool statisticsJson;
+
+    // file the Chrome trace of the run is written into (NULL = no tracing)
+    char *tracePath;
+
+    // directories are read by getdents64 instead of readdir
+    bool useGetdents;
+
+    // stat calls are batched and submitted to io_uring
+    bool useIoUring;
+
+    // fields of struct stat the enabled checks need (STAT_FIELD_* flags),
+    // computed before the traversal starts
+    uint8_t statFields;
+
+    // filter steps are reordered at runtime by their rejection rates
+    bool adaptiveFilters;
+
+    // enabled checks of regular files, compiled before the traversal starts
+    FilterPipeline filters;
+
     // used to get rid of warnings
     void *useless;
 } ParsedArguments;
@@ -57,9 +166,34 @@ typedef struct
 
     // size
     size_t fileSize;
+
+    // permissions and owner (only written by "-F json")
+    uint32_t fileMode;
+    uint32_t fileOwner;
+
+    // sort keys: folded prefix of the file name packed into an integer
+    // and offset of the file name within the path (see setSortKeys)
+    uint64_t nameKey;
+    uint32_t nameOffset;
+
+    // index of the pattern that matched (NO_PATTERN if not annotated)
+    int32_t pattern;
 } Result;
 
 
+// one large block of memory, path strings of results are stored in it
+typedef struct PathChunk
+{
+    // chunk allocated before this one
+    struct PathChunk *next;
+    // bytes used so far
+    size_t used;
+    // size of data
+    size_t size;
+    char data[];
+} PathChunk;
+
+
 // structure stores array of results, plus currently allocated size and number of
 // elements stored in the array so far
 typedef struct
@@ -70,9 +204,135 @@ typedef struct
     size_t arrayIndex;
     // maximum allocated size, used in realloc
     size_t arrayAllocatedSize;
+    // list of chunks file paths are stored in (the newest first),
+    // they are all freed at once
+    PathChunk *pathChunks;
+    // bytes of the stored paths (with their terminators)
+    size_t pathBytes;
+    // at most this many results are kept (0 = no limit), the array is a heap
+    // with the result that sorts last on top then, every path is allocated on its own
+    size_t limit;
+    // order of the heap (sort type from ParsedArguments)
+    uint8_t sortType;
 } Results;
 
 
+// structure stores a path that grows and shrinks as the traversal
+// descends into directories and returns from them
+typedef struct
+{
+    // the path itself (always properly terminated)
+    char *path;
+    // length of the path
+    size_t length;
+    // maximum allocated size, used in realloc
+    size_t allocatedSize;
+} PathBuffer;
+
+
+// number of the slowest directories reported by the statistics
+#define SLOWEST_DIRECTORIES 10
+// buckets of the histogram of directory times
+#define DIRECTORY_HISTOGRAM_BUCKETS 24
+
+
+// directory that took long to search
+typedef struct
+{
+    // path of the directory (allocated)
+    char *path;
+    // nanoseconds
+    uint64_t time;
+} SlowDirectory;
+
+
+// structure stores counters collected during the traversal
+typedef struct
+{
+    // directories opened
+    size_t directories;
+    // directory entries read (without '.' and '..')
+    size_t entries;
+    // stat calls issued
+    size_t statCalls;
+    // directories which were never opened because of depth or prune rules
+    size_t directoriesPruned;
+    // directories of an index update which were read again / taken from the old index
+    size_t directoriesRescanned;
+    size_t directoriesReused;
+    // entries classified and filtered without any stat call
+    size_t statsAvoided;
+    // batches of stat calls submitted to io_uring
+    size_t statBatches;
+    // nanoseconds from the start until the first result was output (0 = none yet)
+    uint64_t firstResultTime;
+    // files that passed all checks
+    size_t matches;
+
+    // nanoseconds spent in the phases (times are only measured with "-S"),
+    // directory and stat times are summed over all threads
+    uint64_t searchTime;
+    // directories opened, read and checked (with their stat calls, without subdirectories)
+    uint64_t directoryTime;
+    uint64_t statTime;
+    uint64_t sortTime;
+    uint64_t outputTime;
+
+    // number of directories by their time, bucket i counts times under 2^i microseconds
+    // (the last one counts the rest)
+    size_t directoryHistogram[DIRECTORY_HISTOGRAM_BUCKETS];
+    // directories that took the longest (unordered), the shortest of them
+    // is the threshold when the array is full
+    SlowDirectory slowestDirectories[SLOWEST_DIRECTORIES];
+    size_t slowestCount;
+    uint64_t slowestThreshold;
+} RunStatistics;
+
+
+// device and inode of a start directory, same ones mean the same directory
+typedef struct
+{
+    dev_t device;
+    ino_t inode;
+} DirectoryIdentity;
+
+
+// structure stores everything one traversing thread works with
+typedef struct
+{
+    // arguments of the search (shared, read only)
+    ParsedArguments *pArgs;
+    // path of the element that's currently inspected
+    PathBuffer path;
+    // results found so far
+    Results results;
+    // counters of the traversal
+    RunStatistics stats;
+    // copy of the compiled filters (with counters of this thread)
+    FilterPipeline filters;
+    // buffers of the getdents reader
+    ReadBufferStack readBuffers;
+    // pending stat requests and io_uring instance
+    StatBatch statBatch;
+    // set when io_uring could be set up for the stat requests
+    bool batchStats;
+    // results of the streaming mode are written here instead of being stored
+    OutputBuffer output;
+    // time the search started (getMonotonicTime)
+    uint64_t startTime;
+    // phases, directories and stat calls are timed ("-S" or "-T")
+    bool timed;
+    // events of this thread ("-T", NULL otherwise)
+    TraceRing *trace;
+    // watched directories and current matches of the watch mode (NULL otherwise)
+    TreeWatcher *watcher;
+    // start directories of a search with several ones (shared, read only, NULL otherwise),
+    // a walk leaves the trees of the other ones to their own walks
+    const DirectoryIdentity *roots;
+    size_t rootCount;
+} TraversalState;
+
+
 /** \brief Create a ParsedArguments structure with default values
  * 
  *  @return ParsedArguments structure
@@ -80,6 +340,42 @@ typedef struct
 ParsedArguments initParsedArguments();
 
 
+/** \brief Free heap memory used by ParsedArguments structure
+ *
+ *  @param pArgs - ParsedArguments structure
+ */
+void freeParsedArguments(ParsedArguments *pArgs);
+
+
+/** \brief Add an id into a sorted set (nothing happens if it's there already)
+ *
+ *  @param set - IdSet structure
+ *  @param id - user or group id
+ *  @return true if successful
+ *          false if an allocation error occurred
+ */
+bool addToIdSet(IdSet *set, id_t id);
+
+
+/** \brief Determine if an id is in the set (binary search, no library calls)
+ *
+ *  @param set - IdSet structure
+ *  @param id - user or group id
+ *  @return true if the id is in the set
+ */
+bool idSetContains(IdSet *set, id_t id);
+
+
+/** \brief Add a string at the end of a list
+ *
+ *  @param list - StringList structure
+ *  @param item - the string (it's not copied)
+ *  @return true if successful
+ *          false if an allocation error occurred
+ */
+bool addToStringList(StringList *list, char *item);
+
+
 /** \brief Create a Results structure
  *
  *  @return new Results structure
@@ -87,26 +383,145 @@ ParsedArguments initParsedArguments();
 Results initResults();
 
 
-/** \brief Add a file into a results array, if memory is exceeded it reallocates the whole array with additional memory
+/** \brief Add a file into a results array, if memory is exceeded it reallocates the whole array
+ *  to twice its size. The path is copied into the chunks of the Results structure.
+ *  With a limit the file is only kept if it's among the best results (offerTopResult).
  * 
  *  @param res - Results structure containing array of Result structure
  *  @param filePath - path to file
- *  @param fileSize - size of file
+ *  @param pathLength - length of the path
+ *  @param stats - stats of the file (its size, mode and owner are kept)
+ *  @param pattern - index of the pattern the file matched (NO_PATTERN if not annotated)
  *  @return true if a new result could be created (no allocation errors)
  *          false if an allocation error occurred
  */
-bool createResult(Results *res, char *filePath, size_t fileSize);
+bool createResult(Results *res, char *filePath, size_t pathLength, const struct stat *stats, int32_t pattern);
 
 
-/** \brief Create a new filePath, used either with directories, or with files themselves
- * 
- *  @param previousPath - path so far
+/** \brief Create an empty PathBuffer structure
+ *
+ *  @return new PathBuffer structure
+ */
+PathBuffer initPathBuffer();
+
+
+/** \brief Replace content of the path buffer with a new path
+ *
+ *  @param path - PathBuffer structure
+ *  @param newPath - path that's copied into the buffer
+ *  @return true if successful
+ *          false if an allocation error occurred
+ */
+bool setPath(PathBuffer *path, char *newPath);
+
+
+/** \brief Append '/' and a name of an element at the end of the path
+ *
+ *  @param path - PathBuffer structure
  *  @param currentElement - name of a current object (file / directory)
- *  @param result - stores a new string
- *  @return true if a new result could be created (no allocation errors)
- *          false if an allocation error occurred (result will not get initialized)
+ *  @return true if successful
+ *          false if an allocation error occurred (path is left untouched)
+ */
+bool appendToPath(PathBuffer *path, char *currentElement);
+
+
+/** \brief Append a separator and a text at the end of the path
+ *
+ *  @param path - PathBuffer structure
+ *  @param separator - character put between the path and the text
+ *  @param text - the text
+ *  @return true if successful
+ *          false if an allocation error occurred (path is left untouched)
+ */
+bool appendWithSeparator(PathBuffer *path, char separator, char *text);
+
+
+/** \brief Cut the path back to the given length
+ *
+ *  @param path - PathBuffer structure
+ *  @param length - new length of the path (not larger than the current one)
+ */
+void truncatePath(PathBuffer *path, size_t length);
+
+
+/** \brief Free heap memory used by PathBuffer
+ *
+ *  @param path - PathBuffer structure
+ */
+void freePathBuffer(PathBuffer *path);
+
+
+/** \brief Move all results from one Results structure into another one
+ *
+ *  @param dest - Results structure results are added into
+ *  @param src - Results structure that's emptied (its paths are owned by dest afterwards),
+ *              with a limit of dest only the best results of both are kept
+ *  @return true if successful
+ *          false if an allocation error occurred (src is left untouched)
+ */
+bool mergeResults(Results *dest, Results *src);
+
+
+/** \brief Create a TraversalState structure with empty results and path,
+ *  set up io_uring if it's desired (statFields have to be known already)
+ *
+ *  @param pArgs - ParsedArguments structure used by the traversal
+ *  @return new TraversalState structure
+ */
+TraversalState initTraversalState(ParsedArguments *pArgs);
+
+
+/** \brief Count a searched directory in the histogram, keep its path
+ *  if it's one of the slowest
+ *
+ *  @param stats - RunStatistics structure
+ *  @param path - path of the directory (copied if it's kept)
+ *  @param time - nanoseconds spent in the directory
+ */
+void recordDirectoryTime(RunStatistics *stats, char *path, uint64_t time);
+
+
+/** \brief Free the paths of the slowest directories
+ *
+ *  @param stats - RunStatistics structure
+ */
+void freeRunStatistics(RunStatistics *stats);
+
+
+/** \brief Get the number of bytes allocated for the paths of the results
+ *  (the used ones are in res->pathBytes)
+ *
+ *  @param res - Results structure
+ *  @return allocated bytes
+ */
+size_t resultPathAllocatedBytes(Results *res);
+
+
+/** \brief Add counters of one run into another, the slowest directories
+ *  of src are moved into dest
+ *
+ *  @param dest - RunStatistics structure the counters are added into
+ *  @param src - RunStatistics structure that's added
+ */
+void mergeStatistics(RunStatistics *dest, RunStatistics *src);
+
+
+/** \brief Move results, counters and trace events of one traversal into another one,
+ *  output of src is written
+ *
+ *  @param dest - TraversalState structure results are added into
+ *  @param src - TraversalState structure that's emptied
+ *  @return true if successful
+ *          false if an allocation or write error occurred
+ */
+bool mergeTraversalState(TraversalState *dest, TraversalState *src);
+
+
+/** \brief Free heap memory used by TraversalState (its results, path, buffers and io_uring)
+ *
+ *  @param state - TraversalState structure
  */
-bool createFilePath(char *previousPath, char *currentElement, char **result);
+void freeTraversalState(TraversalState *state);
 
 
 /** \brief Free heap memory used by Results array